@@ -71,36 +71,110 @@ enum dicelang_error_flavour {
 
 /**
  * @brief Dicelang token, dependent on some text source code.
- * The characters pointed in the value::source field should have a longer or matching lifetime as tokens referencing them.
+ * The characters pointed in the source field should have a longer or matching lifetime as tokens referencing them.
+ * Tokens do not store where they are in the source code : it is found back from the text with dicelang_token_position() when needed.
  */
 struct dicelang_token {
-    /** Token nature. */
-    enum dicelang_token_flavour flavour;
-
     /** Value information, references the source code. */
-    struct { const char *source; size_t source_length; } value;
-    /** Position information of the token in the source code file. */
-    struct { u32 line, col; } where;
+    const char *source;
+    /** Number of characters of the value. */
+    u32 source_length;
+
+    /** Token nature, one of enum dicelang_token_flavour. */
+    u8 flavour;
+};
+
+/**
+ * @brief Position of some character in the source code, counted from 1. Tokens that are not from the source code are at (0:0).
+ */
+struct dicelang_position {
+    u32 line, col;
 };
 
 /** Further range definition specificaly to store tokens. Defined so the compiler knows what it is working with. */
 typedef RANGE(struct dicelang_token) RANGE_TOKEN;
 
+/** Index standing for the absence of a node, where a parse node would otherwise link to another one. */
+#define DICELANG_PARSE_NODE_NONE (UINT32_MAX)
+
 /**
  * @brief Node of a parse tree.
- * Contains a syntax node linked to a set of children and a parent ;
- * if the syntax is a terminal one (a token), then the node shouldn't have children.
+ * All the nodes of a tree are stored in the same range, and link to each other with their index in it. The root node is the first one.
+ * If the syntax is a terminal one (a token), then the node shouldn't have children.
  */
 struct dicelang_parse_node {
     /** Token (terminal or nonterminal) that generated the node, and leads how it will be interpreted. */
     struct dicelang_token token;
 
-    /** Eventual parent node ; might be NULL. */
-    struct dicelang_parse_node *parent;
-    /** Eventual children nodes ; might be NULL, especially for terminal tokens. */
-    RANGE(struct dicelang_parse_node *) *children;
+    /** Index of the parent node ; DICELANG_PARSE_NODE_NONE for the root. */
+    u32 parent;
+    /** Index of the first and last children nodes ; DICELANG_PARSE_NODE_NONE if the node has none, especially for terminal tokens. */
+    u32 first_child, last_child;
+    /** Index of the next node under the same parent ; DICELANG_PARSE_NODE_NONE for the last child. */
+    u32 next_sibling;
+};
+
+/** Further range definition specificaly to store a parse tree. */
+typedef RANGE(struct dicelang_parse_node) RANGE_PARSE_NODE;
+
+// Distributions are only handled through pointers outside of the interpreter.
+struct dicelang_distrib;
+
+// Compilers and interpreters are only handled through pointers, and keep their state between programs compiled and run one after the other.
+struct dicelang_compiler;
+struct dicelang_interpreter;
+struct dicelang_options;
+
+// Contexts are only handled through pointers, and keep their variables between the sources they evaluate.
+struct dicelang_context;
+
+/** Implementation of a builtin function. It reads its arguments from input, and writes its result to output if it returns one. */
+typedef void (*dicelang_script_func)(struct dicelang_distrib *input, struct dicelang_distrib *output, const struct dicelang_options *options, struct allocator alloc);
+
+/**
+ * @brief Instructions of the flat program a parse tree is compiled to.
+ * They work on a stack of values : operators pop their operands and push their result.
+ */
+enum dicelang_opcode {
+    DBC_push_const,             ///< Pushes the value written in the instruction's token.
+    DBC_load_var,               ///< Pushes the value of the variable in the instruction's slot.
+    DBC_add,                    ///< Pops two values and pushes their sum.
+    DBC_substract,              ///< Pops two values and pushes their difference.
+    DBC_multiply,               ///< Pops two values and pushes their product.
+    DBC_dice,                   ///< Pops a number of faces and pushes the roll of such a die.
+    DBC_call,                   ///< Pops the arguments of the instruction's function, and may push its result.
+    DBC_store,                  ///< Pops a value into the variable in the instruction's slot.
+    DBC_end_statement,          ///< Releases all values and temporaries of the statement that just ended.
+
+    DBC_NUMBER,                 ///< Meta enum member to have a count the number of other members.
+};
+
+/**
+ * @brief Single instruction of a compiled program.
+ */
+struct dicelang_instruction {
+    /** What the instruction does. */
+    enum dicelang_opcode opcode;
+
+    /** Slot of the variable loaded or stored, given to each name by the compiler. */
+    u32 slot;
+
+    /** Function called, resolved by the compiler. */
+    dicelang_script_func function;
+    /** Number of arguments of a function call. */
+    u32 nb_args;
+    /** Whether the called function computes a result. */
+    bool returns_value;
+    /** Whether a function call leaves its result on the stack, as a value in some expression. */
+    bool keeps_result;
+
+    /** Constant the instruction pushes. Also locates the errors the instruction can raise. */
+    struct dicelang_token token;
 };
 
+/** Further range definition specificaly to store instructions. */
+typedef RANGE(struct dicelang_instruction) RANGE_INSTRUCTION;
+
 /**
  * @brief Describes an error the system can report.
  */
@@ -114,20 +188,71 @@ struct dicelang_error {
     const char *what;
 };
 
+/**
+ * @brief How the print builtin writes a distribution.
+ */
+enum dicelang_print_format {
+    /** One line per value, with its probability and a bar proportional to it. */
+    DPRINT_text,
+    /** A "value,probability" header, then one line per value. */
+    DPRINT_csv,
+};
+
+/**
+ * @brief Settings a program is interpreted with.
+ */
+struct dicelang_options {
+    /** Stores probabilities as doubles instead of exact counts, dropping the values less likely than the epsilon. */
+    bool approximate;
+    /** Smallest probability kept by the approximate mode. */
+    f64 epsilon;
+
+    /** Stream the builtins write to. Standard output if NULL. */
+    FILE *output;
+    /** How the print builtin writes distributions. */
+    enum dicelang_print_format format;
+};
+
+/// Smallest probability kept by the approximate mode when none is given.
+#define DICELANG_DEFAULT_EPSILON (1e-12)
+
 /**
  * @brief Contains all the information needed to represent & interpet a dicelang program.
  *
  */
 struct dicelang_program {
-    /** Text from the read file. */
+    /** Text from the read file ; NULL if the program was created from a buffer. */
     RANGE(const char) *text;
+    /** Null-terminated text of the program, which tokens reference. Either the text read from a file, or the caller's buffer. */
+    const char *source_code;
+    /** Line of the script the source code starts at. Streamed programs only keep the last line they read. */
+    u32 first_line;
     /** Parse tree generated from the text. */
-    struct dicelang_parse_node *parse_tree;
+    RANGE_PARSE_NODE *parse_tree;
+    /** Instructions compiled from the parse tree, which can be interpreted any number of times. */
+    RANGE_INSTRUCTION *code;
+    /** Numeric settings, read from the "#pragma" lines of the text. */
+    struct dicelang_options options;
 
     /** Current error. Set by functions lexing, parsing and interpreting the script. */
     struct dicelang_error error;
 };
 
+/**
+ * @brief Read-only view on a distribution held by a context, giving the probability of each of its values.
+ * The view is valid until the context evaluates another source, is reset, or is destroyed.
+ */
+struct dicelang_distrib_view {
+    /** Viewed distribution, owned by the context. */
+    const struct dicelang_distrib *distrib;
+    /** Number of distinct values of the distribution. */
+    size_t length;
+
+    /** Sum of the counts of the values, scaled by 2^exponent so it stays in the range of a double. */
+    f64 total;
+    i32 exponent;
+};
+
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
@@ -139,29 +264,82 @@ extern const char *DTOK_DSTX_names[];
 
 // Load a program from a file.
 struct dicelang_program dicelang_program_create_from_file(FILE *from_file, allocator alloc);
+// Load a program from some text, without copying it.
+struct dicelang_program dicelang_program_create_from_buffer(const char *source_code, allocator alloc);
+// Interprets a program from a file one statement at a time, keeping in memory only the statement being interpreted.
+struct dicelang_program dicelang_program_stream_from_file(FILE *from_file, const struct dicelang_options *options, allocator alloc);
 // Releases memory taken by a loaded program.
 void dicelang_program_destroy(struct dicelang_program *program, allocator alloc);
 // Prints the curretn error to some file.
-void dicelang_error_print(struct dicelang_error err, FILE *to_file);
+void dicelang_error_print(struct dicelang_error err, const char *source_code, u32 first_line, FILE *to_file);
 
 // Creates a set of tokens representing the given source code.
 RANGE_TOKEN *dicelang_tokenize(const char *source_code, struct dicelang_error *error_sink, struct allocator alloc);
 // Prints debug token information to some file.
-void dicelang_token_dump(RANGE_TOKEN *tokens, FILE *to_file);
+void dicelang_token_dump(RANGE_TOKEN *tokens, const char *source_code, FILE *to_file);
 // Prints one token to a file.
-void dicelang_token_print(struct dicelang_token token, FILE *to_file);
+void dicelang_token_print(struct dicelang_token token, struct dicelang_position where, FILE *to_file);
+// Finds the line and column of a token by reading the source code up to it.
+struct dicelang_position dicelang_token_position(struct dicelang_token token, const char *source_code);
+// Moves a position forward over some text.
+struct dicelang_position dicelang_position_advance(struct dicelang_position from, const char *from_text, const char *to_text);
 
 // Create a parse tree from an array of tokens.
-struct dicelang_parse_node *dicelang_parse(RANGE_TOKEN *tokens, struct dicelang_error *error_sink, allocator alloc);
+RANGE_PARSE_NODE *dicelang_parse(const RANGE_TOKEN *tokens, struct dicelang_error *error_sink, allocator alloc);
+// Runs the unit tests of the parser.
+void dicelang_parse_test(void);
 // Dumps the description of the whole tree of nodes to some file, depth-wise.
-void dicelang_parse_node_dump(const struct dicelang_parse_node *node, FILE *to_file);
+void dicelang_parse_node_dump(const RANGE_PARSE_NODE *tree, const char *source_code, FILE *to_file);
 // Prints a single parse tree node to a file.
-void dicelang_parse_node_print(const struct dicelang_parse_node *node, FILE *to_file);
-// Destroys a parse node and all its children recursively.
-void dicelang_parse_node_destroy(struct dicelang_parse_node **node, struct allocator alloc);
+void dicelang_parse_node_print(const RANGE_PARSE_NODE *tree, u32 node, const char *source_code, FILE *to_file);
+// Destroys a parse tree and all its nodes at once.
+void dicelang_parse_node_destroy(RANGE_PARSE_NODE **tree, struct allocator alloc);
+
+// Lowers a parse tree to a flat array of instructions.
+RANGE_INSTRUCTION *dicelang_compile(const RANGE_PARSE_NODE *tree, struct dicelang_error *error_sink, struct allocator alloc);
+// Creates a compiler keeping the names it knows from one compilation to the next.
+struct dicelang_compiler *dicelang_compiler_create(struct allocator alloc);
+// Releases a compiler.
+void dicelang_compiler_destroy(struct dicelang_compiler **compiler);
+// Lowers a parse tree to a flat array of instructions, using the names known from previous compilations.
+RANGE_INSTRUCTION *dicelang_compiler_compile(struct dicelang_compiler *compiler, const RANGE_PARSE_NODE *tree, struct dicelang_error *error_sink);
+// Forgets the variables known from previous compilations, keeping the builtin functions.
+void dicelang_compiler_forget(struct dicelang_compiler *compiler);
+// Finds the slot given to a variable by previous compilations.
+bool dicelang_compiler_find_variable(const struct dicelang_compiler *compiler, const char *name, size_t len_name, u32 *out_slot);
+
+// Interprets compiled instructions to produce a the user can work with.
+void dicelang_interpret(const RANGE_INSTRUCTION *code, struct dicelang_options options, struct dicelang_error *error_sink, struct allocator alloc);
+// Creates an interpreter keeping its variables from one run to the next.
+struct dicelang_interpreter *dicelang_interpreter_create(struct dicelang_options options, struct allocator alloc);
+// Releases an interpreter.
+void dicelang_interpreter_destroy(struct dicelang_interpreter **interp);
+// Interprets compiled instructions, using the variables set by previous runs.
+void dicelang_interpreter_run(struct dicelang_interpreter *interp, const RANGE_INSTRUCTION *code, struct dicelang_error *error_sink);
+// Reads the value of a variable set by previous runs.
+const struct dicelang_distrib *dicelang_interpreter_variable(const struct dicelang_interpreter *interp, u32 slot);
+// Releases the values of the variables set by previous runs, keeping the working memory of the interpreter.
+void dicelang_interpreter_forget(struct dicelang_interpreter *interp);
+// Changes where and how the builtins of the next runs write.
+void dicelang_interpreter_redirect(struct dicelang_interpreter *interp, FILE *output, enum dicelang_print_format format);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
 
-// Interprets a parse tree to produce a the user can work with.
-void dicelang_interpret(struct dicelang_parse_node *tree, struct dicelang_error *error_sink, struct allocator alloc);
+// Creates a context keeping its variables from one evaluated source to the next.
+struct dicelang_context *dicelang_context_create(struct dicelang_options options, struct allocator alloc);
+// Releases a context and its variables.
+void dicelang_context_destroy(struct dicelang_context **context);
+// Forgets all the variables of a context.
+void dicelang_context_reset(struct dicelang_context *context);
+// Changes where and how the builtins of the next evaluated sources write.
+void dicelang_context_redirect(struct dicelang_context *context, FILE *output, enum dicelang_print_format format);
+// Lexes, parses, compiles and interprets some source code, using the variables set by previously evaluated sources.
+void dicelang_context_evaluate(struct dicelang_context *context, const char *source_code, struct dicelang_error *error_sink);
+// Views the value of a variable set by an evaluated source.
+bool dicelang_context_variable(const struct dicelang_context *context, const char *name, struct dicelang_distrib_view *out_view);
+// Reads the values of a viewed distribution one after the other, in increasing order, with their probability.
+bool dicelang_distrib_view_next(const struct dicelang_distrib_view *view, size_t *cursor, i32 *out_value, f64 *out_probability);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
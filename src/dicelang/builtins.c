@@ -0,0 +1,103 @@
+/**
+ * @file builtins.c
+ * @author gabriel
+ * @brief Implementation of the functions available to all scripts.
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "builtins.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static void dicelang_builtin_print(struct dicelang_distrib *input, struct dicelang_distrib *output, const struct dicelang_options *options, struct allocator alloc);
+static void dicelang_builtin_count(struct dicelang_distrib *input, struct dicelang_distrib *output, const struct dicelang_options *options, struct allocator alloc);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Adds all builtin functions to a function map, so calls to them can be resolved.
+ *
+ * @param[inout] map
+ * @param[in] alloc
+ */
+void dicelang_builtins_register(struct dicelang_function_map *map, struct allocator alloc)
+{
+    dicelang_function_map_set(map, "print", 5, &dicelang_builtin_print, 1, false, alloc);
+    dicelang_function_map_set(map, "count", 5, &dicelang_builtin_count, 2, true, alloc);
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static void dicelang_builtin_print(struct dicelang_distrib *input, struct dicelang_distrib *output, const struct dicelang_options *options, struct allocator alloc)
+{
+    (void) output;
+    (void) alloc;
+
+    FILE *to_file = options->output ? options->output : stdout;
+
+    f64 sum = 0.;
+    f64 max = 0.;
+    f64 count = 0.;
+    size_t length = 0;
+    size_t cursor = 0;
+    struct dicelang_entry entry = { };
+    f32 ratio = 0.f;
+    f32 relative_ratio = 0.f;
+
+    // counts wider than 64 bits are scaled down so their sum stays in the range of a double
+    i32 exponent = (input->width > 2) ? -32 * (i32) (input->width - 2) : 0;
+
+    while (dicelang_distrib_next_entry(*input, &cursor, &entry)) {
+        count = dicelang_count_to_f64(entry.count, exponent);
+        sum += count;
+        length += 1;
+
+        if (count > max) {
+            max = count;
+        }
+    }
+
+    if (options->format == DPRINT_csv) {
+        fprintf(to_file, "value,probability\n");
+        cursor = 0;
+        while (dicelang_distrib_next_entry(*input, &cursor, &entry)) {
+            fprintf(to_file, "%d,%.17g\n", entry.val, dicelang_count_to_f64(entry.count, exponent) / sum);
+        }
+        return;
+    }
+
+    if (input->approx.enabled) {
+        fprintf(to_file, "%ld --- (%.3e discarded)\n", length, input->approx.discarded);
+    } else {
+        fprintf(to_file, "%ld ---\n", length);
+    }
+    cursor = 0;
+    while (dicelang_distrib_next_entry(*input, &cursor, &entry)) {
+        count = dicelang_count_to_f64(entry.count, exponent);
+        ratio = (f32) count / (f32) sum;
+        relative_ratio = (f32) count / (f32) max;
+
+        fprintf(to_file, "% 4d\t%.3f ", entry.val, ratio);
+
+        for (size_t j = 0 ; j < (size_t) (relative_ratio * 40.) ; j++) {
+            fputc('|', to_file);
+        }
+
+        fputc('\n', to_file);
+    }
+}
+
+static void dicelang_builtin_count(struct dicelang_distrib *input, struct dicelang_distrib *output, const struct dicelang_options *options, struct allocator alloc)
+{
+    (void) input;
+    (void) output;
+    (void) options;
+    (void) alloc;
+
+}
@@ -0,0 +1,19 @@
+/**
+ * @file builtins.h
+ * @author gabriel
+ * @brief Functions available to all scripts.
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef __BUILTINS_H__
+#define __BUILTINS_H__
+
+#include "containers/func_hashmap.h"
+
+// Adds all builtin functions to a function map.
+void dicelang_builtins_register(struct dicelang_function_map *map, struct allocator alloc);
+
+#endif
@@ -0,0 +1,458 @@
+/**
+ * @file compiler.c
+ * @author gabriel
+ * @brief Compiler implementation file. Lowers a parse tree to a flat array of instructions, so it can be interpreted without walking the tree.
+ * Names are resolved along the way : variables get slots, and calls get the builtin function they call.
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <ustd/range.h>
+
+#include <dicelang.h>
+
+#include "builtins.h"
+#include "containers/var_hashmap.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief State of a compiler : the names known so far, kept from one compilation to the next, and the compilation in progress.
+ */
+struct dicelang_compiler {
+    struct allocator alloc;
+
+    struct dicelang_variable_map variables;
+    u32 nb_slots;
+    struct dicelang_function_map functions;
+
+    /** Compiled tree. */
+    const RANGE_PARSE_NODE *tree;
+    /** Emitted instructions. */
+    RANGE_INSTRUCTION *code;
+    /** Reason the compilation stopped, or NULL. */
+    const char *failure;
+    /** Token the compilation stopped at. */
+    struct dicelang_token failure_token;
+};
+
+/**
+ * @brief Node of the tree being compiled, with the number of values its compiled children leave on the stack.
+ */
+struct dicelang_compile_frame {
+    u32 node;
+
+    /** Index of the next child to compile. */
+    u32 next_child;
+    size_t produced;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static size_t dicelang_compile_node(struct dicelang_compiler *compiler, u32 node, size_t produced);
+static void dicelang_compile_emit(struct dicelang_compiler *compiler, struct dicelang_instruction instruction, size_t times);
+static u32 dicelang_compile_slot_of(struct dicelang_compiler *compiler, struct dicelang_token identifier);
+static bool dicelang_compile_call(struct dicelang_compiler *compiler, struct dicelang_token identifier, size_t nb_args, bool keeps_result);
+static bool dicelang_compile_has_child(const RANGE_PARSE_NODE *tree, u32 node, enum dicelang_token_flavour what);
+static bool dicelang_compile_first_child_is(const RANGE_PARSE_NODE *tree, u32 node, enum dicelang_token_flavour what);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Lowers a parse tree to the instructions of a stack machine, with a compiler that is thrown away afterwards.
+ *
+ * @param[in] tree Compiled tree.
+ * @param[inout] error_sink Error reporting structure.
+ * @param[in] alloc Allocator used for the instructions.
+ * @return RANGE_INSTRUCTION *
+ */
+RANGE_INSTRUCTION *dicelang_compile(const RANGE_PARSE_NODE *tree, struct dicelang_error *error_sink, struct allocator alloc)
+{
+    struct dicelang_compiler *compiler = nullptr;
+    RANGE_INSTRUCTION *code = nullptr;
+
+    if (!tree || (tree->length == 0)) {
+        return nullptr;
+    }
+
+    compiler = dicelang_compiler_create(alloc);
+    if (!compiler) {
+        error_sink->flavour = DERR_INTERNAL;
+        error_sink->what = "compiler could not allocate its working memory.";
+        return nullptr;
+    }
+
+    code = dicelang_compiler_compile(compiler, tree, error_sink);
+    dicelang_compiler_destroy(&compiler);
+
+    return code;
+}
+
+/**
+ * @brief Creates a compiler that knows of the builtin functions, and of no variable yet.
+ *
+ * @param[in] alloc Allocator used for the compiler and the instructions it emits.
+ * @return struct dicelang_compiler *
+ */
+struct dicelang_compiler *dicelang_compiler_create(struct allocator alloc)
+{
+    struct dicelang_compiler *compiler = alloc.malloc(alloc, sizeof(*compiler));
+
+    if (!compiler) {
+        return nullptr;
+    }
+
+    *compiler = (struct dicelang_compiler) {
+            .alloc = alloc,
+            .variables = dicelang_variable_map_create(8, alloc),
+            .functions = dicelang_function_map_create(8, alloc),
+    };
+
+    if (!compiler->variables.vars || !compiler->functions.funcs) {
+        dicelang_compiler_destroy(&compiler);
+        return nullptr;
+    }
+
+    dicelang_builtins_register(&compiler->functions, alloc);
+
+    return compiler;
+}
+
+/**
+ * @brief Releases a compiler and the names it knows.
+ *
+ * @param[inout] compiler
+ */
+void dicelang_compiler_destroy(struct dicelang_compiler **compiler)
+{
+    struct allocator alloc = { };
+
+    if (!compiler || !*compiler) {
+        return;
+    }
+
+    alloc = (*compiler)->alloc;
+
+    dicelang_variable_map_destroy(&(*compiler)->variables, alloc);
+    dicelang_function_map_destroy(&(*compiler)->functions, alloc);
+    alloc.free(alloc, *compiler);
+
+    *compiler = nullptr;
+}
+
+/**
+ * @brief Lowers a parse tree to the instructions of a stack machine. The tree is read depth-wise with an explicit stack,
+ * and each node emits its instructions once all of its children were compiled.
+ * Operators fold all the values their children leave on the stack, from the last one to the first one.
+ * Each variable name gets its own slot, and calls are bound to their builtin. Calls to unknown functions, or with the wrong number of
+ * arguments, stop the compilation : the instructions emitted before the faulty call are kept.
+ * Slots given in previous compilations are kept, so trees compiled one after the other can be interpreted one after the other by the same interpreter.
+ *
+ * @param[inout] compiler Compiler, with the names it already knows.
+ * @param[in] tree Compiled tree.
+ * @param[inout] error_sink Error reporting structure.
+ * @return RANGE_INSTRUCTION *
+ */
+RANGE_INSTRUCTION *dicelang_compiler_compile(struct dicelang_compiler *compiler, const RANGE_PARSE_NODE *tree, struct dicelang_error *error_sink)
+{
+    struct allocator alloc = { };
+    RANGE_INSTRUCTION *code = nullptr;
+    RANGE(struct dicelang_compile_frame) *frames = nullptr;
+    struct dicelang_compile_frame *current = nullptr;
+    u32 child = DICELANG_PARSE_NODE_NONE;
+    size_t produced = 0;
+
+    if (!compiler || !tree || (tree->length == 0)) {
+        return nullptr;
+    }
+
+    alloc = compiler->alloc;
+    compiler->tree = tree;
+    compiler->failure = nullptr;
+    compiler->code = range_create_dynamic(alloc, sizeof(*compiler->code->data), 64);
+    frames = range_create_dynamic(alloc, sizeof(*frames->data), 16);
+
+    if (!compiler->code || !frames) {
+        error_sink->flavour = DERR_INTERNAL;
+        error_sink->what = "compiler could not allocate its working memory.";
+        range_destroy_dynamic(alloc, &RANGE_TO_ANY(compiler->code));
+        range_destroy_dynamic(alloc, &RANGE_TO_ANY(frames));
+        return nullptr;
+    }
+
+    range_push(RANGE_TO_ANY(frames), &(struct dicelang_compile_frame) { .node = 0, .next_child = tree->data[0].first_child });
+
+    while (!compiler->failure && (frames->length > 0)) {
+        current = frames->data + (frames->length - 1);
+
+        if (current->next_child != DICELANG_PARSE_NODE_NONE) {
+            child = current->next_child;
+            current->next_child = tree->data[child].next_sibling;
+
+            frames = range_ensure_capacity(alloc, RANGE_TO_ANY(frames), 1);
+            range_push(RANGE_TO_ANY(frames), &(struct dicelang_compile_frame) { .node = child, .next_child = tree->data[child].first_child });
+        } else {
+            produced = dicelang_compile_node(compiler, current->node, current->produced);
+            range_pop(RANGE_TO_ANY(frames));
+
+            if (frames->length > 0) {
+                RANGE_LAST(frames).produced += produced;
+            }
+        }
+    }
+
+    // an earlier error (from the parser) is the one reported
+    if (compiler->failure && (error_sink->flavour == DERR_NONE)) {
+        error_sink->flavour = DERR_INTERPRET;
+        error_sink->token = compiler->failure_token;
+        error_sink->what = compiler->failure;
+    }
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(frames));
+
+    // the instructions are the caller's
+    code = compiler->code;
+    compiler->code = nullptr;
+    compiler->tree = nullptr;
+
+    return code;
+}
+
+/**
+ * @brief Finds the slot a compiler gave to some variable, without giving one to a name it does not know.
+ *
+ * @param[in] compiler
+ * @param[in] name Name of the variable, not necessarily null-terminated.
+ * @param[in] len_name Number of characters of the name.
+ * @param[out] out_slot Slot of the variable, if it was found.
+ * @return false if no compiled program named this variable.
+ */
+bool dicelang_compiler_find_variable(const struct dicelang_compiler *compiler, const char *name, size_t len_name, u32 *out_slot)
+{
+    if (!compiler || !name) {
+        return false;
+    }
+
+    return dicelang_variable_map_get(compiler->variables, name, len_name, out_slot);
+}
+
+/**
+ * @brief Forgets all the variables a compiler gave a slot to. The builtin functions stay known, and the next variables get slots from 0.
+ *
+ * @param[inout] compiler
+ */
+void dicelang_compiler_forget(struct dicelang_compiler *compiler)
+{
+    if (!compiler) {
+        return;
+    }
+
+    dicelang_variable_map_clear(&compiler->variables, compiler->alloc);
+    compiler->nb_slots = 0;
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Emits the instructions of a node whose children were all compiled.
+ *
+ * @param[inout] compiler
+ * @param[in] node Index of the compiled node.
+ * @param[in] produced Number of values the children of the node leave on the stack.
+ * @return Number of values the node leaves on the stack.
+ */
+static size_t dicelang_compile_node(struct dicelang_compiler *compiler, u32 node, size_t produced)
+{
+    const struct dicelang_parse_node *syntax = compiler->tree->data + node;
+    struct dicelang_token first_token = { };
+    bool keeps_result = false;
+
+    if (syntax->first_child != DICELANG_PARSE_NODE_NONE) {
+        first_token = compiler->tree->data[syntax->first_child].token;
+    }
+
+    switch (syntax->token.flavour) {
+        case DTOK_value:
+            dicelang_compile_emit(compiler, (struct dicelang_instruction) { .opcode = DBC_push_const, .token = syntax->token }, 1);
+            return 1;
+
+        case DSTX_variable_access:
+            if (!dicelang_compile_first_child_is(compiler->tree, node, DTOK_identifier)) {
+                return produced;
+            }
+            dicelang_compile_emit(compiler, (struct dicelang_instruction) {
+                    .opcode = DBC_load_var,
+                    .slot = dicelang_compile_slot_of(compiler, first_token),
+                    .token = first_token }, 1);
+            return produced + 1;
+
+        case DSTX_dice:
+            if (produced == 1) {
+                dicelang_compile_emit(compiler, (struct dicelang_instruction) { .opcode = DBC_dice, .token = first_token }, 1);
+            }
+            return produced;
+
+        case DSTX_multiplication:
+            if (produced == 0) {
+                return 0;
+            }
+            dicelang_compile_emit(compiler, (struct dicelang_instruction) { .opcode = DBC_multiply, .token = syntax->token }, produced - 1);
+            return 1;
+
+        case DSTX_addition:
+            if (produced == 0) {
+                return 0;
+            }
+            dicelang_compile_emit(compiler, (struct dicelang_instruction) {
+                    .opcode = dicelang_compile_has_child(compiler->tree, node, DTOK_op_addition) ? DBC_add : DBC_substract,
+                    .token = syntax->token }, produced - 1);
+            return 1;
+
+        case DSTX_function_call:
+            if (!dicelang_compile_first_child_is(compiler->tree, node, DTOK_identifier)) {
+                return produced;
+            }
+            // calls in expressions are the only ones whose result is used
+            keeps_result = (syntax->parent != DICELANG_PARSE_NODE_NONE) && (compiler->tree->data[syntax->parent].token.flavour == DSTX_operand);
+            if (!dicelang_compile_call(compiler, first_token, produced, keeps_result)) {
+                return 0;
+            }
+            return keeps_result ? 1 : 0;
+
+        case DSTX_assignment:
+            if ((produced != 1) || !dicelang_compile_first_child_is(compiler->tree, node, DTOK_identifier)) {
+                return produced;
+            }
+            dicelang_compile_emit(compiler, (struct dicelang_instruction) {
+                    .opcode = DBC_store,
+                    .slot = dicelang_compile_slot_of(compiler, first_token),
+                    .token = first_token }, 1);
+            return 0;
+
+        case DSTX_statement:
+            dicelang_compile_emit(compiler, (struct dicelang_instruction) { .opcode = DBC_end_statement, .token = syntax->token }, 1);
+            return 0;
+
+        default:
+            return produced;
+    }
+}
+
+/**
+ * @brief Appends some instruction to the compiled code a number of times.
+ *
+ * @param[inout] compiler
+ * @param[in] instruction
+ * @param[in] times
+ */
+static void dicelang_compile_emit(struct dicelang_compiler *compiler, struct dicelang_instruction instruction, size_t times)
+{
+    if (times == 0) {
+        return;
+    }
+
+    compiler->code = range_ensure_capacity(compiler->alloc, RANGE_TO_ANY(compiler->code), times);
+    for (size_t i = 0 ; i < times ; i++) {
+        range_push(RANGE_TO_ANY(compiler->code), &instruction);
+    }
+}
+
+/**
+ * @brief Finds the slot of a variable, giving the next free one to names seen for the first time.
+ *
+ * @param[inout] compiler
+ * @param[in] identifier
+ * @return u32
+ */
+static u32 dicelang_compile_slot_of(struct dicelang_compiler *compiler, struct dicelang_token identifier)
+{
+    u32 slot = 0;
+
+    if (dicelang_variable_map_get(compiler->variables, identifier.source, identifier.source_length, &slot)) {
+        return slot;
+    }
+
+    slot = compiler->nb_slots;
+    if (dicelang_variable_map_set(&compiler->variables, identifier.source, identifier.source_length, slot, compiler->alloc)) {
+        compiler->nb_slots += 1;
+    }
+
+    return slot;
+}
+
+/**
+ * @brief Emits the call to a builtin function, checking how it is called.
+ *
+ * @param[inout] compiler
+ * @param[in] identifier Name of the called function.
+ * @param[in] nb_args Number of values given to the function.
+ * @param[in] keeps_result Whether the result of the call is used.
+ * @return false if the call is invalid, which stops the compilation.
+ */
+static bool dicelang_compile_call(struct dicelang_compiler *compiler, struct dicelang_token identifier, size_t nb_args, bool keeps_result)
+{
+    struct dicelang_function called = { };
+
+    if (!dicelang_function_map_get(compiler->functions, identifier.source, identifier.source_length, &called)) {
+        compiler->failure = "unknown function.";
+    } else if (called.nb_args != nb_args) {
+        compiler->failure = "wrong number of arguments.";
+    } else if (keeps_result && !called.returns_value) {
+        compiler->failure = "function does not return a value.";
+    }
+
+    if (compiler->failure) {
+        compiler->failure_token = identifier;
+        return false;
+    }
+
+    dicelang_compile_emit(compiler, (struct dicelang_instruction) {
+            .opcode = DBC_call,
+            .function = called.func_impl,
+            .nb_args = (u32) nb_args,
+            .returns_value = called.returns_value,
+            .keeps_result = keeps_result,
+            .token = identifier }, 1);
+
+    return true;
+}
+
+/**
+ * @brief Checks if a node has a direct child of some flavour.
+ *
+ * @param[in] tree
+ * @param[in] node
+ * @param[in] what
+ * @return bool
+ */
+static bool dicelang_compile_has_child(const RANGE_PARSE_NODE *tree, u32 node, enum dicelang_token_flavour what)
+{
+    bool found = false;
+    u32 child = tree->data[node].first_child;
+
+    while (!found && (child != DICELANG_PARSE_NODE_NONE)) {
+        found = tree->data[child].token.flavour == what;
+        child = tree->data[child].next_sibling;
+    }
+
+    return found;
+}
+
+/**
+ * @brief Checks the flavour of the first child of a node. Malformed nodes left by a syntax error might lack it.
+ *
+ * @param[in] tree
+ * @param[in] node
+ * @param[in] what
+ * @return bool
+ */
+static bool dicelang_compile_first_child_is(const RANGE_PARSE_NODE *tree, u32 node, enum dicelang_token_flavour what)
+{
+    return (tree->data[node].first_child != DICELANG_PARSE_NODE_NONE) && (tree->data[tree->data[node].first_child].token.flavour == what);
+}
@@ -0,0 +1,280 @@
+
+#include <string.h>
+
+#include "arena.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Alignment of all allocations made in an arena.
+#define DICELANG_ARENA_ALIGNMENT (16u)
+
+/**
+ * @brief Block of memory allocations are bumped from. Each allocation is preceded by its size.
+ */
+struct dicelang_arena_chunk {
+    struct dicelang_arena_chunk *next;
+    size_t used;
+    size_t last;
+    _Alignas(DICELANG_ARENA_ALIGNMENT) byte data[];
+};
+
+/**
+ * @brief
+ *
+ */
+struct dicelang_arena {
+    struct allocator parent;
+    struct dicelang_arena_chunk *chunks;
+};
+
+/**
+ * @brief Header written before each allocation of an arena.
+ */
+struct dicelang_arena_header {
+    _Alignas(DICELANG_ARENA_ALIGNMENT) size_t size;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static void *dicelang_arena_malloc(struct allocator alloc, size_t size);
+static void dicelang_arena_free(struct allocator alloc, void *ptr);
+static void *dicelang_arena_realloc(struct allocator alloc, void *ptr, size_t size);
+
+static struct dicelang_arena_chunk *dicelang_arena_owner(struct dicelang_arena *arena, const void *ptr);
+static size_t dicelang_arena_round(size_t size);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Creates an arena, with a first chunk allocated from the parent allocator.
+ *
+ * @param parent Allocator the chunks and large allocations are taken from.
+ * @return struct dicelang_arena*
+ */
+struct dicelang_arena *dicelang_arena_create(struct allocator parent)
+{
+    struct dicelang_arena *arena = parent.malloc(parent, sizeof(*arena));
+
+    if (!arena) {
+        return nullptr;
+    }
+
+    *arena = (struct dicelang_arena) { .parent = parent };
+
+    arena->chunks = parent.malloc(parent, sizeof(*arena->chunks) + DICELANG_ARENA_CHUNK_SIZE);
+    if (arena->chunks) {
+        *arena->chunks = (struct dicelang_arena_chunk) { };
+    }
+
+    return arena;
+}
+
+/**
+ * @brief Releases an arena and all of its chunks. Large allocations forwarded to the parent allocator should have been freed beforehand.
+ *
+ * @param arena
+ */
+void dicelang_arena_destroy(struct dicelang_arena **arena)
+{
+    struct dicelang_arena_chunk *next = nullptr;
+    struct allocator parent = { };
+
+    if (!arena || !*arena) {
+        return;
+    }
+
+    parent = (*arena)->parent;
+    while ((*arena)->chunks) {
+        next = (*arena)->chunks->next;
+        parent.free(parent, (*arena)->chunks);
+        (*arena)->chunks = next;
+    }
+
+    parent.free(parent, *arena);
+    *arena = nullptr;
+}
+
+/**
+ * @brief Releases all allocations of an arena at once. Its first chunk is kept for the next allocations.
+ *
+ * @param arena
+ */
+void dicelang_arena_reset(struct dicelang_arena *arena)
+{
+    struct dicelang_arena_chunk *next = nullptr;
+
+    if (!arena || !arena->chunks) {
+        return;
+    }
+
+    // the chunks are stacked, the first one allocated is the last of the list
+    while (arena->chunks->next) {
+        next = arena->chunks->next;
+        arena->parent.free(arena->parent, arena->chunks);
+        arena->chunks = next;
+    }
+
+    arena->chunks->used = 0;
+    arena->chunks->last = 0;
+}
+
+/**
+ * @brief Allocator interface of an arena. Freeing memory of the arena does nothing, unless it is the last allocation.
+ *
+ * @param arena
+ * @return struct allocator
+ */
+struct allocator dicelang_arena_allocator(struct dicelang_arena *arena)
+{
+    if (!arena) {
+        return make_system_allocator();
+    }
+
+    return (struct allocator) {
+            .malloc = &dicelang_arena_malloc,
+            .free = &dicelang_arena_free,
+            .realloc = &dicelang_arena_realloc,
+            .allocator_data = arena,
+    };
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Bumps an allocation from the current chunk, starting a new chunk if it is full.
+ *
+ * @param alloc
+ * @param size
+ * @return void*
+ */
+static void *dicelang_arena_malloc(struct allocator alloc, size_t size)
+{
+    struct dicelang_arena *arena = alloc.allocator_data;
+    struct dicelang_arena_chunk *chunk = nullptr;
+    struct dicelang_arena_header *header = nullptr;
+    size_t needed = sizeof(*header) + dicelang_arena_round(size);
+
+    if (needed > (DICELANG_ARENA_CHUNK_SIZE / 4)) {
+        return arena->parent.malloc(arena->parent, size);
+    }
+
+    if (!arena->chunks || (arena->chunks->used + needed > DICELANG_ARENA_CHUNK_SIZE)) {
+        chunk = arena->parent.malloc(arena->parent, sizeof(*chunk) + DICELANG_ARENA_CHUNK_SIZE);
+        if (!chunk) {
+            return nullptr;
+        }
+        *chunk = (struct dicelang_arena_chunk) { .next = arena->chunks };
+        arena->chunks = chunk;
+    }
+
+    chunk = arena->chunks;
+    header = (struct dicelang_arena_header *) (chunk->data + chunk->used);
+    header->size = size;
+
+    chunk->last = chunk->used;
+    chunk->used += needed;
+
+    return header + 1;
+}
+
+/**
+ * @brief Gives back the last allocation of the current chunk, and forwards memory the arena does not own to its parent.
+ * Other allocations are released when the arena is reset.
+ *
+ * @param alloc
+ * @param ptr
+ */
+static void dicelang_arena_free(struct allocator alloc, void *ptr)
+{
+    struct dicelang_arena *arena = alloc.allocator_data;
+    struct dicelang_arena_chunk *chunk = nullptr;
+
+    if (!ptr) {
+        return;
+    }
+
+    chunk = dicelang_arena_owner(arena, ptr);
+    if (!chunk) {
+        arena->parent.free(arena->parent, ptr);
+        return;
+    }
+
+    if ((chunk == arena->chunks) && ((byte *) ptr == chunk->data + chunk->last + sizeof(struct dicelang_arena_header))) {
+        chunk->used = chunk->last;
+    }
+}
+
+/**
+ * @brief Grows the last allocation in place when the chunk has room for it, and moves the other ones.
+ *
+ * @param alloc
+ * @param ptr
+ * @param size
+ * @return void*
+ */
+static void *dicelang_arena_realloc(struct allocator alloc, void *ptr, size_t size)
+{
+    struct dicelang_arena *arena = alloc.allocator_data;
+    struct dicelang_arena_chunk *chunk = nullptr;
+    struct dicelang_arena_header *header = nullptr;
+    void *moved = nullptr;
+
+    if (!ptr) {
+        return dicelang_arena_malloc(alloc, size);
+    }
+
+    chunk = dicelang_arena_owner(arena, ptr);
+    if (!chunk) {
+        return arena->parent.realloc(arena->parent, ptr, size);
+    }
+
+    header = (struct dicelang_arena_header *) ptr - 1;
+
+    if ((chunk == arena->chunks) && ((byte *) header == chunk->data + chunk->last)
+            && (chunk->last + sizeof(*header) + dicelang_arena_round(size) <= DICELANG_ARENA_CHUNK_SIZE)
+            && (sizeof(*header) + dicelang_arena_round(size) <= (DICELANG_ARENA_CHUNK_SIZE / 4))) {
+        header->size = size;
+        chunk->used = chunk->last + sizeof(*header) + dicelang_arena_round(size);
+        return ptr;
+    }
+
+    moved = dicelang_arena_malloc(alloc, size);
+    if (moved) {
+        memcpy(moved, ptr, (header->size < size) ? header->size : size);
+    }
+
+    return moved;
+}
+
+/**
+ * @brief Finds the chunk of an arena some memory was allocated from.
+ *
+ * @param arena
+ * @param ptr
+ * @return The chunk, or NULL if the memory does not come from the arena.
+ */
+static struct dicelang_arena_chunk *dicelang_arena_owner(struct dicelang_arena *arena, const void *ptr)
+{
+    struct dicelang_arena_chunk *chunk = arena->chunks;
+
+    while (chunk && (((const byte *) ptr < chunk->data) || ((const byte *) ptr >= chunk->data + DICELANG_ARENA_CHUNK_SIZE))) {
+        chunk = chunk->next;
+    }
+
+    return chunk;
+}
+
+/**
+ * @brief Rounds a size up to the alignment of the arena.
+ *
+ * @param size
+ * @return size_t
+ */
+static size_t dicelang_arena_round(size_t size)
+{
+    return (size + (DICELANG_ARENA_ALIGNMENT - 1)) & ~((size_t) DICELANG_ARENA_ALIGNMENT - 1);
+}
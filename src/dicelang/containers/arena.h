@@ -0,0 +1,28 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <ustd/allocation.h>
+#include <ustd/range.h>
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Size of the blocks an arena allocates from its parent allocator.
+#define DICELANG_ARENA_CHUNK_SIZE ((size_t) 1u << 16u)
+
+/**
+ * @brief Bump allocator for short-lived memory, released all at once when the arena is reset.
+ * Allocations too large for its chunks are forwarded to the parent allocator, and so are the frees of memory the arena does not own.
+ */
+struct dicelang_arena;
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+struct dicelang_arena *dicelang_arena_create(struct allocator parent);
+void dicelang_arena_destroy(struct dicelang_arena **arena);
+
+void dicelang_arena_reset(struct dicelang_arena *arena);
+struct allocator dicelang_arena_allocator(struct dicelang_arena *arena);
+
+#endif
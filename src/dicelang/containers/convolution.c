@@ -0,0 +1,299 @@
+
+#include <string.h>
+
+#include "convolution.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Prime modulus of the form c * 2^k + 1, with a primitive root, on which a number-theoretic transform can be computed.
+ */
+struct dicelang_ntt_prime {
+    u32 modulus;
+    u32 root;
+};
+
+/**
+ * @brief Three NTT-friendly primes. Their product is above 2^86, so reconstructing a convolution of 32 bits planes with the chinese
+ * remainder theorem is exact for any length accepted by the transform.
+ */
+static const struct dicelang_ntt_prime dicelang_ntt_primes[3] = {
+        { .modulus = 998244353u, .root = 3u },      // 119 * 2^23 + 1
+        { .modulus = 167772161u, .root = 3u },      //   5 * 2^25 + 1
+        { .modulus = 469762049u, .root = 3u },      //   7 * 2^26 + 1
+};
+
+__extension__ typedef unsigned __int128 dicelang_u128;
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static u32 dicelang_ntt_pow(u32 base, u32 exponent, u32 modulus);
+static void dicelang_ntt_transform(u32 *data, size_t length, struct dicelang_ntt_prime prime, bool inverse);
+static dicelang_u128 dicelang_ntt_reconstruct(const u32 residues[3]);
+static u32 dicelang_ntt_plane(const u32 *count, size_t plane, size_t plane_bits);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Convolves two arrays of counts with a number-theoretic transform : out[k] += sum of lhs[i] * rhs[j] for all i + j = k.
+ * The result is computed modulo three primes and reconstructed, so it is the same as the one of the naive pairwise product,
+ * in O((n + m) log(n + m)) instead of O(n * m).
+ * Counts wider than 32 bits are cut in 16 bits planes that are convolved with each other and recombined, so that the sum landing
+ * on each plane still fits under the product of the primes.
+ *
+ * @param[in] lhs Left hand side counts, lhs_width limbs each.
+ * @param[in] lhs_length Number of left hand side counts.
+ * @param[in] lhs_width Number of limbs of each left hand side count.
+ * @param[in] rhs Right hand side counts, rhs_width limbs each.
+ * @param[in] rhs_length Number of right hand side counts.
+ * @param[in] rhs_width Number of limbs of each right hand side count.
+ * @param[in] rhs_reversed Reads the right hand side from its end, to compute a difference instead of a sum.
+ * @param[inout] out Accumulator of at least lhs_length + rhs_length - 1 counts, out_width limbs each, wide enough to hold the result.
+ * @param[in] out_width Number of limbs of each result count.
+ * @param[in] alloc Allocator used for the transform buffers.
+ * @return false if the convolution could not be computed (the result is too long, or memory is missing), in which case out is untouched.
+ */
+bool dicelang_convolution_ntt(const u32 *lhs, size_t lhs_length, u32 lhs_width, const u32 *rhs, size_t rhs_length, u32 rhs_width,
+                              bool rhs_reversed, u32 *out, u32 out_width, struct allocator alloc)
+{
+    size_t out_length = 0;
+    size_t length = 1;
+    size_t plane_bits = 0;
+    size_t lhs_planes = 0;
+    size_t rhs_planes = 0;
+    size_t out_planes = 0;
+    u32 *buffers = nullptr;
+    u32 *lhs_transforms = nullptr;
+    u32 *rhs_transforms = nullptr;
+    u32 *residues[3] = { };
+    u32 *acc = nullptr;
+    const u32 *lhs_plane = nullptr;
+    const u32 *rhs_plane = nullptr;
+    const u32 *rhs_count = nullptr;
+    dicelang_u128 value = 0;
+    u32 modulus = 0;
+
+    if (!lhs || !rhs || !out || (lhs_length == 0) || (rhs_length == 0) || (lhs_width == 0) || (rhs_width == 0) || (out_width == 0)) {
+        return false;
+    }
+
+    out_length = lhs_length + rhs_length - 1;
+    while (length < out_length) {
+        length <<= 1;
+    }
+
+    if (length > DICELANG_CONVOLUTION_NTT_MAX_LENGTH) {
+        return false;
+    }
+
+    plane_bits = ((lhs_width == 1) && (rhs_width == 1)) ? 32 : 16;
+    lhs_planes = (32 * (size_t) lhs_width) / plane_bits;
+    rhs_planes = (32 * (size_t) rhs_width) / plane_bits;
+    out_planes = lhs_planes + rhs_planes - 1;
+
+    buffers = alloc.malloc(alloc, (lhs_planes + rhs_planes + (3 * out_planes)) * length * sizeof(*buffers));
+    if (!buffers) {
+        return false;
+    }
+
+    lhs_transforms = buffers;
+    rhs_transforms = lhs_transforms + (lhs_planes * length);
+    for (size_t p = 0 ; p < 3 ; p++) {
+        residues[p] = rhs_transforms + (rhs_planes * length) + (p * out_planes * length);
+    }
+
+    for (size_t p = 0 ; p < 3 ; p++) {
+        modulus = dicelang_ntt_primes[p].modulus;
+
+        memset(buffers, 0, (lhs_planes + rhs_planes) * length * sizeof(*buffers));
+        memset(residues[p], 0, out_planes * length * sizeof(*buffers));
+
+        for (size_t i = 0 ; i < lhs_length ; i++) {
+            for (size_t a = 0 ; a < lhs_planes ; a++) {
+                lhs_transforms[(a * length) + i] = dicelang_ntt_plane(lhs + (i * lhs_width), a, plane_bits) % modulus;
+            }
+        }
+        for (size_t i = 0 ; i < rhs_length ; i++) {
+            rhs_count = rhs + ((rhs_reversed ? (rhs_length - 1 - i) : i) * rhs_width);
+            for (size_t b = 0 ; b < rhs_planes ; b++) {
+                rhs_transforms[(b * length) + i] = dicelang_ntt_plane(rhs_count, b, plane_bits) % modulus;
+            }
+        }
+
+        for (size_t a = 0 ; a < lhs_planes ; a++) {
+            dicelang_ntt_transform(lhs_transforms + (a * length), length, dicelang_ntt_primes[p], false);
+        }
+        for (size_t b = 0 ; b < rhs_planes ; b++) {
+            dicelang_ntt_transform(rhs_transforms + (b * length), length, dicelang_ntt_primes[p], false);
+        }
+
+        // each pair of planes lands on the plane of the sum of their ranks
+        for (size_t a = 0 ; a < lhs_planes ; a++) {
+            lhs_plane = lhs_transforms + (a * length);
+            for (size_t b = 0 ; b < rhs_planes ; b++) {
+                rhs_plane = rhs_transforms + (b * length);
+                acc = residues[p] + ((a + b) * length);
+                for (size_t i = 0 ; i < length ; i++) {
+                    acc[i] = (u32) ((acc[i] + ((u64) lhs_plane[i] * rhs_plane[i])) % modulus);
+                }
+            }
+        }
+
+        for (size_t r = 0 ; r < out_planes ; r++) {
+            dicelang_ntt_transform(residues[p] + (r * length), length, dicelang_ntt_primes[p], true);
+        }
+    }
+
+    for (size_t i = 0 ; i < out_length ; i++) {
+        for (size_t r = 0 ; r < out_planes ; r++) {
+            value = dicelang_ntt_reconstruct((u32[3]) { residues[0][(r * length) + i], residues[1][(r * length) + i], residues[2][(r * length) + i] });
+            if (value != 0) {
+                dicelang_count_add_shifted(out + (i * out_width), out_width, (u64) value, (u64) (value >> 64), r * plane_bits);
+            }
+        }
+    }
+
+    alloc.free(alloc, buffers);
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Modular exponentiation.
+ *
+ * @param base
+ * @param exponent
+ * @param modulus
+ * @return
+ */
+static u32 dicelang_ntt_pow(u32 base, u32 exponent, u32 modulus)
+{
+    u64 result = 1u;
+    u64 factor = base % modulus;
+
+    while (exponent > 0) {
+        if (exponent & 1u) {
+            result = (result * factor) % modulus;
+        }
+        factor = (factor * factor) % modulus;
+        exponent >>= 1u;
+    }
+
+    return (u32) result;
+}
+
+/**
+ * @brief In-place iterative number-theoretic transform (or its inverse) of an array whose length is a power of two.
+ *
+ * @param[inout] data Transformed values, all below the prime's modulus.
+ * @param[in] length Number of values, power of two.
+ * @param[in] prime Prime field of the transform.
+ * @param[in] inverse Computes the inverse transform, including the division by the length.
+ */
+static void dicelang_ntt_transform(u32 *data, size_t length, struct dicelang_ntt_prime prime, bool inverse)
+{
+    u32 modulus = prime.modulus;
+    u32 tmp = 0;
+    u64 root = 0;
+    u64 twiddle = 0;
+    u32 even = 0;
+    u32 odd = 0;
+    size_t j = 0;
+    size_t bit = 0;
+
+    // bit-reversal permutation
+    for (size_t i = 1 ; i < length ; i++) {
+        bit = length >> 1;
+        while (j & bit) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            tmp = data[i];
+            data[i] = data[j];
+            data[j] = tmp;
+        }
+    }
+
+    // butterflies
+    for (size_t half = 1 ; half < length ; half <<= 1) {
+        root = dicelang_ntt_pow(prime.root, (modulus - 1) / (u32) (half << 1), modulus);
+        if (inverse) {
+            root = dicelang_ntt_pow((u32) root, modulus - 2, modulus);
+        }
+
+        for (size_t start = 0 ; start < length ; start += (half << 1)) {
+            twiddle = 1u;
+            for (size_t k = 0 ; k < half ; k++) {
+                even = data[start + k];
+                odd = (u32) ((data[start + k + half] * twiddle) % modulus);
+
+                data[start + k] = (even + odd >= modulus) ? (even + odd - modulus) : (even + odd);
+                data[start + k + half] = (even >= odd) ? (even - odd) : (even + modulus - odd);
+
+                twiddle = (twiddle * root) % modulus;
+            }
+        }
+    }
+
+    if (inverse) {
+        root = dicelang_ntt_pow((u32) (length % modulus), modulus - 2, modulus);
+        for (size_t i = 0 ; i < length ; i++) {
+            data[i] = (u32) ((data[i] * root) % modulus);
+        }
+    }
+}
+
+/**
+ * @brief Rebuilds a value from its residues modulo the three NTT primes (Garner's algorithm).
+ *
+ * @param residues Residues modulo each of the primes, in order.
+ * @return
+ */
+static dicelang_u128 dicelang_ntt_reconstruct(const u32 residues[3])
+{
+    const u64 m0 = dicelang_ntt_primes[0].modulus;
+    const u64 m1 = dicelang_ntt_primes[1].modulus;
+    const u64 m2 = dicelang_ntt_primes[2].modulus;
+
+    const u64 inv_m0_mod_m1 = 47450712u;       // (m0)^-1 mod m1
+    const u64 inv_m0m1_mod_m2 = 115990628u;    // (m0 * m1)^-1 mod m2
+
+    u64 digit_1 = 0;
+    u64 digit_2 = 0;
+    u64 partial = 0;
+
+    digit_1 = ((residues[1] + m1 - (residues[0] % m1)) % m1) * inv_m0_mod_m1 % m1;
+
+    partial = (residues[0] + m0 * digit_1) % m2;
+    digit_2 = ((residues[2] + m2 - partial) % m2) * inv_m0m1_mod_m2 % m2;
+
+    return (dicelang_u128) residues[0] + ((dicelang_u128) m0 * digit_1) + ((dicelang_u128) (m0 * m1) * digit_2);
+}
+
+/**
+ * @brief Extracts some bits of a count, cut in planes of 16 or 32 bits.
+ *
+ * @param count Limbs of the count.
+ * @param plane Rank of the plane, from the least significant one.
+ * @param plane_bits Number of bits of a plane.
+ * @return
+ */
+static u32 dicelang_ntt_plane(const u32 *count, size_t plane, size_t plane_bits)
+{
+    u32 limb = count[(plane * plane_bits) / 32];
+
+    if (plane_bits == 32) {
+        return limb;
+    }
+
+    return (limb >> ((plane * plane_bits) % 32)) & ((1u << plane_bits) - 1u);
+}
@@ -0,0 +1,20 @@
+#ifndef __CONVOLUTION_H__
+#define __CONVOLUTION_H__
+
+#include <ustd/range.h>
+
+#include "count.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Longest convolution result the number-theoretic transform can produce.
+#define DICELANG_CONVOLUTION_NTT_MAX_LENGTH ((size_t) 1u << 23u)
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+bool dicelang_convolution_ntt(const u32 *lhs, size_t lhs_length, u32 lhs_width, const u32 *rhs, size_t rhs_length, u32 rhs_width,
+                              bool rhs_reversed, u32 *out, u32 out_width, struct allocator alloc);
+
+#endif
@@ -0,0 +1,239 @@
+
+#include <math.h>
+#include <string.h>
+
+#include "count.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Number of limbs needed to store counts of some number of bits. Counts are kept on u32, u64 or u128 while they
+ * can, and on as many limbs as needed past 128 bits.
+ *
+ * @param nb_bits
+ * @return
+ */
+u32 dicelang_count_width_for_bits(size_t nb_bits)
+{
+    if (nb_bits <= 32) {
+        return 1;
+    }
+    if (nb_bits <= 64) {
+        return 2;
+    }
+    if (nb_bits <= 128) {
+        return 4;
+    }
+    return (u32) ((nb_bits + 31) / 32);
+}
+
+/**
+ * @brief Position of the highest set bit of a count, plus one. Zero for a zero count.
+ *
+ * @param limbs
+ * @param width
+ * @return
+ */
+size_t dicelang_count_bit_length(const u32 *limbs, u32 width)
+{
+    u32 top = width;
+
+    while ((top > 0) && (limbs[top - 1] == 0)) {
+        top -= 1;
+    }
+
+    if (top == 0) {
+        return 0;
+    }
+
+    return (32 * (size_t) (top - 1)) + (32 - (size_t) __builtin_clz(limbs[top - 1]));
+}
+
+/**
+ * @brief
+ *
+ * @param limbs
+ * @param width
+ * @return
+ */
+bool dicelang_count_is_zero(const u32 *limbs, u32 width)
+{
+    for (size_t i = 0 ; i < width ; i++) {
+        if (limbs[i] != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Copies a count to some storage of another width, zero-extending it (or truncating it).
+ *
+ * @param[out] to
+ * @param[in] to_width
+ * @param[in] from
+ * @param[in] from_width
+ */
+void dicelang_count_copy(u32 *to, u32 to_width, const u32 *from, u32 from_width)
+{
+    for (size_t i = 0 ; i < to_width ; i++) {
+        to[i] = (i < from_width) ? from[i] : 0;
+    }
+}
+
+/**
+ * @brief Adds a count to another one, modulo 2^(32 * acc_width).
+ *
+ * @param[inout] acc
+ * @param[in] acc_width
+ * @param[in] value
+ * @param[in] value_width
+ */
+void dicelang_count_add(u32 *acc, u32 acc_width, const u32 *value, u32 value_width)
+{
+    u64 carry = 0;
+
+    for (size_t i = 0 ; (i < acc_width) && ((i < value_width) || carry) ; i++) {
+        carry += (u64) acc[i] + ((i < value_width) ? value[i] : 0);
+        acc[i] = (u32) carry;
+        carry >>= 32;
+    }
+}
+
+/**
+ * @brief Substracts a count from another one, modulo 2^(32 * acc_width).
+ *
+ * @param[inout] acc
+ * @param[in] acc_width
+ * @param[in] value
+ * @param[in] value_width
+ */
+void dicelang_count_sub(u32 *acc, u32 acc_width, const u32 *value, u32 value_width)
+{
+    u64 borrow = 0;
+    u64 taken = 0;
+
+    for (size_t i = 0 ; (i < acc_width) && ((i < value_width) || borrow) ; i++) {
+        taken = ((i < value_width) ? value[i] : 0) + borrow;
+        borrow = (taken > acc[i]);
+        acc[i] = (u32) ((u64) acc[i] - taken);
+    }
+}
+
+/**
+ * @brief Adds the product of two counts to a third one, modulo 2^(32 * acc_width).
+ *
+ * @param[inout] acc
+ * @param[in] acc_width
+ * @param[in] lhs
+ * @param[in] lhs_width
+ * @param[in] rhs
+ * @param[in] rhs_width
+ */
+void dicelang_count_mul_add(u32 *acc, u32 acc_width, const u32 *lhs, u32 lhs_width, const u32 *rhs, u32 rhs_width)
+{
+    u64 carry = 0;
+    size_t k = 0;
+
+    for (size_t i = 0 ; (i < lhs_width) && (i < acc_width) ; i++) {
+        if (lhs[i] == 0) {
+            continue;
+        }
+
+        carry = 0;
+        for (size_t j = 0 ; (j < rhs_width) && (i + j < acc_width) ; j++) {
+            carry += ((u64) lhs[i] * rhs[j]) + acc[i + j];
+            acc[i + j] = (u32) carry;
+            carry >>= 32;
+        }
+        for (k = i + rhs_width ; (k < acc_width) && carry ; k++) {
+            carry += acc[k];
+            acc[k] = (u32) carry;
+            carry >>= 32;
+        }
+    }
+}
+
+/**
+ * @brief Adds a 128 bits value, shifted left by some number of bits, to a count, modulo 2^(32 * acc_width).
+ *
+ * @param[inout] acc
+ * @param[in] acc_width
+ * @param[in] value_low Lower 64 bits of the value.
+ * @param[in] value_high Upper 64 bits of the value.
+ * @param[in] shift Number of bits the value is shifted by.
+ */
+void dicelang_count_add_shifted(u32 *acc, u32 acc_width, u64 value_low, u64 value_high, size_t shift)
+{
+    u32 parts[5] = { };
+    size_t bit_shift = shift % 32;
+
+    parts[0] = (u32) value_low;
+    parts[1] = (u32) (value_low >> 32);
+    parts[2] = (u32) value_high;
+    parts[3] = (u32) (value_high >> 32);
+
+    if (bit_shift > 0) {
+        for (size_t i = 4 ; i > 0 ; i--) {
+            parts[i] = (parts[i] << bit_shift) | (parts[i - 1] >> (32 - bit_shift));
+        }
+        parts[0] <<= bit_shift;
+    }
+
+    if ((shift / 32) >= acc_width) {
+        return;
+    }
+
+    dicelang_count_add(acc + (shift / 32), acc_width - (u32) (shift / 32), parts, 5);
+}
+
+/**
+ * @brief Reads a count into a u64.
+ *
+ * @param[in] count
+ * @param[out] out_value
+ * @return false if the count does not fit on 64 bits.
+ */
+bool dicelang_count_to_u64(struct dicelang_count count, u64 *out_value)
+{
+    if (!count.limbs || !out_value || count.approximate || (dicelang_count_bit_length(count.limbs, count.width) > 64)) {
+        return false;
+    }
+
+    *out_value = count.limbs[0];
+    if (count.width > 1) {
+        *out_value |= (u64) count.limbs[1] << 32;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Approximates a count multiplied by 2^exponent. Scaling the counts of a distribution down by the same amount lets ratios
+ * between counts too large for a double still be computed.
+ *
+ * @param count
+ * @param exponent
+ * @return
+ */
+f64 dicelang_count_to_f64(struct dicelang_count count, i32 exponent)
+{
+    f64 value = 0.;
+
+    if (!count.limbs) {
+        return 0.;
+    }
+
+    if (count.approximate) {
+        memcpy(&value, count.limbs, sizeof(value));
+        return ldexp(value, exponent);
+    }
+
+    for (size_t i = count.width ; i > 0 ; i--) {
+        value += ldexp((f64) count.limbs[i - 1], (i32) (32 * (i - 1)) + exponent);
+    }
+
+    return value;
+}
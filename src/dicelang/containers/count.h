@@ -0,0 +1,36 @@
+#ifndef __COUNT_H__
+#define __COUNT_H__
+
+#include <ustd/range.h>
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Read-only view on a count stored on some number of 32 bits limbs, least significant limb first.
+ * Counts use 1, 2 or 4 limbs (u32, u64, u128) and grow to any number of limbs when they need to.
+ * Approximate counts are instead a f64 probability, stored on two limbs.
+ */
+struct dicelang_count {
+    const u32 *limbs;
+    u32 width;
+    bool approximate;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+u32 dicelang_count_width_for_bits(size_t nb_bits);
+size_t dicelang_count_bit_length(const u32 *limbs, u32 width);
+bool dicelang_count_is_zero(const u32 *limbs, u32 width);
+
+void dicelang_count_copy(u32 *to, u32 to_width, const u32 *from, u32 from_width);
+void dicelang_count_add(u32 *acc, u32 acc_width, const u32 *value, u32 value_width);
+void dicelang_count_sub(u32 *acc, u32 acc_width, const u32 *value, u32 value_width);
+void dicelang_count_mul_add(u32 *acc, u32 acc_width, const u32 *lhs, u32 lhs_width, const u32 *rhs, u32 rhs_width);
+void dicelang_count_add_shifted(u32 *acc, u32 acc_width, u64 value_low, u64 value_high, size_t shift);
+
+bool dicelang_count_to_u64(struct dicelang_count count, u64 *out_value);
+f64 dicelang_count_to_f64(struct dicelang_count count, i32 exponent);
+
+#endif
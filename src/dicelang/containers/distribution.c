@@ -1,59 +1,167 @@
 
+#include <math.h>
+#include <string.h>
+
 #include <ustd/math.h>
 #include <ustd/sorting.h>
 #include <ustd/testutilities.h>
 
 #include "distribution.h"
+#include "convolution.h"
+#include "kernel.h"
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-static f32 dicelang_token_value(const char *bytes, size_t length);
+/// Spans up to this number of values are always stored densely, whatever their number of gaps.
+#define DICELANG_DISTRIB_DENSE_MIN_SPAN (64)
+/// Maximum ratio between the span of a dense distribution and its number of values before it falls back to the sparse form.
+#define DICELANG_DISTRIB_DENSE_MAX_GAP_RATIO (4)
+/// Number of powers of two needed to decompose any positive i32 repetition factor.
+#define DICELANG_DISTRIB_MAX_POWERS (31)
+/// Minimum number of counts in both dense operands of a sum or difference before it is computed through a number-theoretic transform.
+#define DICELANG_DISTRIB_NTT_MIN_LENGTH (128)
+/// Maximum number of pairs of values sorted at once when combining into a sparse distribution.
+#define DICELANG_DISTRIB_BATCH_MAX_PAIRS ((size_t) 1u << 24u)
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
 
+static f32 dicelang_token_value(const char *bytes, size_t length);
 
-static void dicelang_distrib_push_value(struct dicelang_distrib *target, struct dicelang_entry value, struct allocator alloc);
+static struct dicelang_distrib dicelang_distrib_create_like(struct dicelang_distrib model, struct allocator alloc);
+static void dicelang_distrib_push_one(struct dicelang_distrib *target, i32 val, struct allocator alloc);
+static void dicelang_distrib_push_value(struct dicelang_distrib *target, i32 val, struct dicelang_count count, struct allocator alloc);
 static void dicelang_distrib_push_distrib(struct dicelang_distrib *out_into, struct dicelang_distrib from, struct allocator alloc);
+static bool dicelang_distrib_merge(struct dicelang_distrib *out_into, struct dicelang_distrib from, f64 from_scale, struct allocator alloc);
+static u32 *dicelang_distrib_slot_of(struct dicelang_distrib *target, i32 val, struct allocator alloc);
+static void dicelang_distrib_clear(struct dicelang_distrib *target);
+static void dicelang_distrib_reset_like(struct dicelang_distrib *target, struct dicelang_distrib model, struct allocator alloc);
+static void dicelang_distrib_swap(struct dicelang_distrib *lhs, struct dicelang_distrib *rhs);
+
+static i32 dicelang_value_compare(const void *lhs, const void *rhs);
+
+// -------------------------------------------------------------------------------------------------
+
+static bool dicelang_distrib_bounds(struct dicelang_distrib d, i32 *out_min, i32 *out_max);
+static size_t dicelang_distrib_nb_slots(struct dicelang_distrib d);
+static u32 *dicelang_distrib_slot(struct dicelang_distrib d, size_t index);
+static bool dicelang_distrib_fits_dense(i64 span, size_t nb_values);
+
+static void dicelang_distrib_reserve(struct dicelang_distrib *target, i32 min, i32 max, size_t nb_values, struct allocator alloc);
+static void dicelang_distrib_pack(struct dicelang_distrib *target, struct allocator alloc);
+static void dicelang_distrib_to_sparse(struct dicelang_distrib *target, struct allocator alloc);
+static void dicelang_distrib_to_dense(struct dicelang_distrib *target, struct allocator alloc);
+
+// -------------------------------------------------------------------------------------------------
+
+static size_t dicelang_distrib_max_bits(struct dicelang_distrib d);
+static size_t dicelang_distrib_product_bits(struct dicelang_distrib lhs, struct dicelang_distrib rhs);
+static void dicelang_distrib_widen(struct dicelang_distrib *target, u32 width, struct allocator alloc);
+static void dicelang_distrib_narrow(struct dicelang_distrib *target);
+static size_t dicelang_ceil_log2(size_t n);
+
+static void dicelang_distrib_slot_add(struct dicelang_distrib d, u32 *slot, const u32 *value, u32 value_width);
+static void dicelang_distrib_slot_sub(struct dicelang_distrib d, u32 *slot, const u32 *value, u32 value_width);
+static void dicelang_distrib_slot_mul_add(struct dicelang_distrib d, u32 *slot, const u32 *lhs, u32 lhs_width, const u32 *rhs, u32 rhs_width);
+
+// -------------------------------------------------------------------------------------------------
 
-static i32 dicelang_entry_compare(const void *lhs, const void *rhs);
+static void dicelang_distrib_prune(struct dicelang_distrib *target);
+static void dicelang_distrib_weigh_product(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs);
+static f64 dicelang_weight_get(const u32 *limbs);
+static void dicelang_weight_set(u32 *limbs, f64 weight);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-typedef struct dicelang_entry (*dicelang_distrib_modif_func)(struct dicelang_entry lhs, struct dicelang_entry rhs);
+/**
+ * @brief Operators combining each pair of values of two distributions. Each one has its own kernel.
+ */
+enum dicelang_distrib_operator {
+    DOP_add,
+    DOP_substract,
+
+    DOP_NUMBER,
+};
+
+/**
+ * @brief Pairwise combination of two distributions, specialized for one operator.
+ */
+typedef void (*dicelang_distrib_combine_kernel)(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
+
+/**
+ * @brief Result of the combination of one value of each operand, sorted by value before being reduced.
+ */
+struct dicelang_distrib_pair {
+    /** Resulting value, with its sign bit flipped so that values sort as unsigned integers. */
+    u32 key;
+    /** Index of the left hand side entry. */
+    u32 lhs_index;
+    /** Index of the right hand side entry. */
+    u32 rhs_index;
+};
+
+/**
+ * @brief Scratch memory of a pairwise combination into a sparse distribution : all entries of both operands, and their pairs.
+ */
+struct dicelang_distrib_batch {
+    struct dicelang_entry *lhs_entries;
+    size_t nb_lhs;
+    struct dicelang_entry *rhs_entries;
+    size_t nb_rhs;
+
+    struct dicelang_distrib_pair *pairs;
+    struct dicelang_distrib_pair *buffer;
+};
 
-static void dicelang_distrib_combine(struct dicelang_distrib *out_into, dicelang_distrib_modif_func f, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
-static void dicelang_distrib_transform(struct dicelang_distrib *target, dicelang_distrib_modif_func f, struct dicelang_entry seed);
+static void dicelang_distrib_combine(struct dicelang_distrib *out_into, enum dicelang_distrib_operator op, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
+static void dicelang_distrib_convolve(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, bool substract, struct allocator alloc);
+static bool dicelang_distrib_convolve_direct(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, bool substract, i32 min, struct allocator alloc);
+static void dicelang_distrib_roll_uniform(struct dicelang_distrib *out_into, struct dicelang_distrib from, struct dicelang_distrib die, struct allocator alloc);
+static bool dicelang_distrib_is_uniform(struct dicelang_distrib d);
 
-static struct dicelang_entry dicelang_distrib_add_entries(struct dicelang_entry lhs, struct dicelang_entry rhs);
-static struct dicelang_entry dicelang_distrib_sub_entries(struct dicelang_entry lhs, struct dicelang_entry rhs);
-static struct dicelang_entry dicelang_distrib_mult_entries(struct dicelang_entry lhs, struct dicelang_entry rhs);
+static bool dicelang_distrib_batch_create(struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct dicelang_distrib_batch *out_batch, struct allocator alloc);
+static void dicelang_distrib_batch_reduce(struct dicelang_distrib *out_into, struct dicelang_distrib_batch batch, struct allocator alloc);
+static void dicelang_distrib_batch_sort(struct dicelang_distrib_pair *pairs, struct dicelang_distrib_pair *buffer, size_t length);
+
+static inline i32 dicelang_distrib_add_values(i32 lhs, i32 rhs);
+static inline i32 dicelang_distrib_sub_values(i32 lhs, i32 rhs);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
+/// Count of a single roll.
+static const u32 dicelang_count_one = 1u;
 
 /**
  * @brief
  *
  * @param token
+ * @param options Numeric mode of the distribution. Distributions computed from this one inherit it.
  * @param alloc
  * @return struct dicelang_distrib
  */
-struct dicelang_distrib dicelang_distrib_create(struct dicelang_token token, struct allocator alloc)
+struct dicelang_distrib dicelang_distrib_create(struct dicelang_token token, struct dicelang_options options, struct allocator alloc)
 {
     struct dicelang_distrib new_distrib = { };
 
-    if ((token.flavour != DTOK_value) || !token.value.source || !token.value.source_length) {
+    if ((token.flavour != DTOK_value) || !token.source || !token.source_length) {
         return (struct dicelang_distrib) { };
     }
 
     new_distrib = dicelang_distrib_create_empty(alloc);
 
-    if (!new_distrib.values) {
+    if (!dicelang_distrib_is_valid(new_distrib)) {
         return (struct dicelang_distrib) { };
     }
 
-    dicelang_distrib_push_value(&new_distrib, (struct dicelang_entry) { .val = dicelang_token_value(token.value.source, token.value.source_length), .count = 1 }, alloc);
+    if (options.approximate) {
+        new_distrib.width = 2;
+        new_distrib.approx = (struct dicelang_distrib_approx) { .enabled = true, .epsilon = options.epsilon, .log_weight = 0., .discarded = 0. };
+    }
+
+    dicelang_distrib_push_one(&new_distrib, (i32) dicelang_token_value(token.source, token.source_length), alloc);
 
     return new_distrib;
 }
@@ -67,12 +175,69 @@ struct dicelang_distrib dicelang_distrib_create(struct dicelang_token token, str
  */
 struct dicelang_distrib dicelang_distrib_copy(struct dicelang_distrib from, struct allocator alloc)
 {
-    struct dicelang_distrib new_distrib = { };
-    new_distrib.values = range_create_dynamic_from_copy_of(alloc, RANGE_TO_ANY(from.values));
+    struct dicelang_distrib new_distrib = { .offset = from.offset, .width = from.width, .approx = from.approx };
+
+    if (from.counts) {
+        new_distrib.counts = range_create_dynamic_from_copy_of(alloc, RANGE_TO_ANY(from.counts));
+    }
+    if (from.values) {
+        new_distrib.values = range_create_dynamic_from_copy_of(alloc, RANGE_TO_ANY(from.values));
+    }
 
     return new_distrib;
 }
 
+/**
+ * @brief Creates a new reference to the storage of a distribution, without copying it. Both distributions should be destroyed.
+ *
+ * @param from Shared distribution.
+ * @param alloc
+ * @return struct dicelang_distrib
+ */
+struct dicelang_distrib dicelang_distrib_share(struct dicelang_distrib *from, struct allocator alloc)
+{
+    if (!from || !dicelang_distrib_is_valid(*from)) {
+        return (struct dicelang_distrib) { };
+    }
+
+    if (!from->references) {
+        from->references = alloc.malloc(alloc, sizeof(*from->references));
+        if (!from->references) {
+            return dicelang_distrib_copy(*from, alloc);
+        }
+        *from->references = 1;
+    }
+
+    *from->references += 1;
+
+    return *from;
+}
+
+/**
+ * @brief Gives a distribution its own storage if it shares it with other ones, so it can be modified.
+ *
+ * @param target
+ * @param alloc
+ */
+void dicelang_distrib_unshare(struct dicelang_distrib *target, struct allocator alloc)
+{
+    struct dicelang_distrib own = { };
+
+    if (!target || !target->references) {
+        return;
+    }
+
+    if (*target->references == 1) {
+        alloc.free(alloc, target->references);
+        target->references = nullptr;
+        return;
+    }
+
+    own = dicelang_distrib_copy(*target, alloc);
+    dicelang_distrib_destroy(target, alloc);
+    *target = own;
+}
+
 /**
  * @brief
  *
@@ -85,20 +250,79 @@ void dicelang_distrib_destroy(struct dicelang_distrib *distrib, struct allocator
         return;
     }
 
+    // other distributions still use the storage
+    if (distrib->references && (*distrib->references > 1)) {
+        *distrib->references -= 1;
+        *distrib = (struct dicelang_distrib) { };
+        return;
+    }
+
+    if (distrib->references) {
+        alloc.free(alloc, distrib->references);
+    }
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(distrib->counts));
     range_destroy_dynamic(alloc, &RANGE_TO_ANY(distrib->values));
 
     *distrib = (struct dicelang_distrib) { };
 }
 
 /**
- * @brief
+ * @brief Checks that a distribution holds some storage, dense or sparse.
+ *
+ * @param d
+ * @return
+ */
+bool dicelang_distrib_is_valid(struct dicelang_distrib d)
+{
+    return (d.counts != nullptr) && (d.width > 0);
+}
+
+/**
+ * @brief Checks that a distribution has no value with a non-zero count.
  *
  * @param d
  * @return
  */
 bool dicelang_distrib_is_empty(struct dicelang_distrib d)
 {
-    return ((d.values) && (d.values->length > 0));
+    size_t cursor = 0;
+    struct dicelang_entry entry = { };
+
+    return !dicelang_distrib_next_entry(d, &cursor, &entry);
+}
+
+/**
+ * @brief Iterates over the values of a distribution with a non-zero count, in increasing order, whatever the storage.
+ * The cursor should start at 0 and is advanced by the function. Counts of the entries point inside the distribution.
+ *
+ * @param[in] d Iterated distribution.
+ * @param[inout] cursor Iteration state.
+ * @param[out] out_entry Next value and its count.
+ * @return true if an entry was produced, false if the iteration is over.
+ */
+bool dicelang_distrib_next_entry(struct dicelang_distrib d, size_t *cursor, struct dicelang_entry *out_entry)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(d);
+
+    if (!cursor || !out_entry) {
+        return false;
+    }
+
+    while ((*cursor < nb_slots) && dicelang_count_is_zero(dicelang_distrib_slot(d, *cursor), d.width)) {
+        *cursor += 1;
+    }
+
+    if (*cursor >= nb_slots) {
+        return false;
+    }
+
+    *out_entry = (struct dicelang_entry) {
+            .val = d.values ? d.values->data[*cursor] : d.offset + (i32) *cursor,
+            .count = { .limbs = dicelang_distrib_slot(d, *cursor), .width = d.width, .approximate = d.approx.enabled },
+    };
+    *cursor += 1;
+
+    return true;
 }
 
 /**
@@ -113,20 +337,47 @@ struct dicelang_distrib dicelang_distrib_add(struct dicelang_distrib lhs, struct
 {
     struct dicelang_distrib added = { };
 
-    if (!lhs.values || !rhs.values) {
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
         return (struct dicelang_distrib) { };
     }
 
-    added = dicelang_distrib_create_empty(alloc);
+    added = dicelang_distrib_create_like(lhs, alloc);
+    dicelang_distrib_add_into(&added, lhs, rhs, alloc);
 
-    if ((lhs.values->length == 0) || (rhs.values->length == 0)) {
-        dicelang_distrib_push_distrib(&added, lhs, alloc);
-        dicelang_distrib_push_distrib(&added, rhs, alloc);
-        return added;
+    return added;
+}
+
+/**
+ * @brief Adds two distributions into an existing one, reusing its storage. The previous values of the destination are dropped.
+ * The destination should not share its storage with the operands.
+ *
+ * @param[inout] out_into Destination of the sum.
+ * @param[in] lhs
+ * @param[in] rhs
+ * @param[in] alloc
+ */
+void dicelang_distrib_add_into(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc)
+{
+    if (!out_into) {
+        return;
     }
 
-    dicelang_distrib_combine(&added, &dicelang_distrib_add_entries, lhs, rhs, alloc);
-    return added;
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
+        dicelang_distrib_clear(out_into);
+        return;
+    }
+
+    dicelang_distrib_reset_like(out_into, lhs, alloc);
+
+    if (dicelang_distrib_is_empty(lhs) || dicelang_distrib_is_empty(rhs)) {
+        dicelang_distrib_push_distrib(out_into, lhs, alloc);
+        dicelang_distrib_push_distrib(out_into, rhs, alloc);
+        dicelang_distrib_pack(out_into, alloc);
+        return;
+    }
+
+    dicelang_distrib_convolve(out_into, lhs, rhs, false, alloc);
+    dicelang_distrib_pack(out_into, alloc);
 }
 
 /**
@@ -141,71 +392,169 @@ struct dicelang_distrib dicelang_distrib_substract(struct dicelang_distrib lhs,
 {
     struct dicelang_distrib diff = { };
 
-    if (!lhs.values || !rhs.values) {
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
         return (struct dicelang_distrib) { };
     }
 
-    if (rhs.values->length == 0) {
-        dicelang_distrib_push_distrib(&diff, lhs, alloc);
-        return diff;
+    diff = dicelang_distrib_create_like(lhs, alloc);
+    dicelang_distrib_substract_into(&diff, lhs, rhs, alloc);
+
+    return diff;
+}
+
+/**
+ * @brief Substracts two distributions into an existing one, reusing its storage. The previous values of the destination are dropped.
+ * The destination should not share its storage with the operands.
+ *
+ * @param[inout] out_into Destination of the difference.
+ * @param[in] lhs
+ * @param[in] rhs
+ * @param[in] alloc
+ */
+void dicelang_distrib_substract_into(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc)
+{
+    if (!out_into) {
+        return;
     }
 
-    if (rhs.values->length == 0) {
-        dicelang_distrib_push_distrib(&diff, lhs, alloc);
-        dicelang_distrib_transform(&diff, &dicelang_distrib_mult_entries, (struct dicelang_entry) { .val = -1, .count = 1 });
-        return diff;
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
+        dicelang_distrib_clear(out_into);
+        return;
     }
 
-    diff = dicelang_distrib_create_empty(alloc);
-    dicelang_distrib_combine(&diff, &dicelang_distrib_sub_entries, lhs, rhs, alloc);
+    dicelang_distrib_reset_like(out_into, lhs, alloc);
 
-    return diff;
+    if (dicelang_distrib_is_empty(rhs)) {
+        dicelang_distrib_push_distrib(out_into, lhs, alloc);
+        dicelang_distrib_pack(out_into, alloc);
+        return;
+    }
+
+    dicelang_distrib_convolve(out_into, lhs, rhs, true, alloc);
+    dicelang_distrib_pack(out_into, alloc);
 }
 
 /**
- * @brief
+ * @brief Repeats the right hand side expression as many times as each value of the left hand side, and gathers all results.
+ * Repetitions are built by binary powering : rhs, 2 * rhs, 4 * rhs, ... are computed once and shared by all left hand side values,
+ * and as those values are visited in increasing order, each one only adds the missing repetitions to the previous result.
+ * Uniform right hand sides (dice pools) skip the powers and roll one more die at a time with a sliding window sum.
  *
- * @param lhs
- * @param rhs
+ * @param lhs Number of repetitions.
+ * @param rhs Repeated expression.
  * @param alloc
  * @return
  */
 struct dicelang_distrib dicelang_distrib_multiply(struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc)
 {
     struct dicelang_distrib mult = { };
+
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
+        return (struct dicelang_distrib) { };
+    }
+
+    mult = dicelang_distrib_create_like(rhs, alloc);
+    dicelang_distrib_multiply_into(&mult, lhs, rhs, alloc);
+
+    return mult;
+}
+
+/**
+ * @brief Multiplies two distributions into an existing one, reusing its storage. The previous values of the destination are dropped.
+ * The destination should not share its storage with the operands.
+ *
+ * @param[inout] out_into Destination of the product.
+ * @param[in] lhs Number of repetitions.
+ * @param[in] rhs Repeated expression.
+ * @param[in] alloc
+ */
+void dicelang_distrib_multiply_into(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc)
+{
     struct dicelang_distrib sum = { };
     struct dicelang_distrib buffer = { };
+    struct dicelang_distrib powers[DICELANG_DISTRIB_MAX_POWERS] = { };
+    struct dicelang_entry lhs_entry = { };
+    size_t nb_powers = 0;
+    size_t cursor = 0;
+    i32 sum_factor = 0;
+    i32 missing = 0;
+    bool uniform = false;
+
+    if (!out_into) {
+        return;
+    }
 
-    if (!lhs.values || !rhs.values) {
-        return (struct dicelang_distrib) { };
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
+        dicelang_distrib_clear(out_into);
+        return;
     }
 
-    mult = dicelang_distrib_create_empty(alloc);
-    sum = dicelang_distrib_create_empty(alloc);
-    buffer = dicelang_distrib_create_empty(alloc);
+    uniform = dicelang_distrib_is_uniform(rhs);
+
+    dicelang_distrib_reset_like(out_into, rhs, alloc);
+    sum = dicelang_distrib_create_like(rhs, alloc);
+    buffer = dicelang_distrib_create_like(rhs, alloc);
+
+    // the sum starts as 0 * rhs
+    dicelang_distrib_push_one(&sum, 0, alloc);
+
+    // powers[0] is borrowed from the caller
+    powers[0] = rhs;
+    nb_powers = 1;
+
+    while (dicelang_distrib_next_entry(lhs, &cursor, &lhs_entry)) {
+        // lhs values are visited in increasing order, non-positive ones repeat nothing
+        missing = ((lhs_entry.val > 0) ? lhs_entry.val : 0) - sum_factor;
+        sum_factor += missing;
+
+        for ( ; uniform && (missing > 0) ; missing--) {
+            dicelang_distrib_clear(&buffer);
+            dicelang_distrib_roll_uniform(&buffer, sum, rhs, alloc);
+            dicelang_distrib_swap(&sum, &buffer);
+
+            // dropping the tails keeps the support of approximate sums bounded
+            if (sum.approx.enabled) {
+                dicelang_distrib_pack(&sum, alloc);
+            }
+        }
 
-    for (size_t i_lhs = 0 ; i_lhs < lhs.values->length ; i_lhs++) {
-        // empty out the sum temporary distrib
-        range_clear(RANGE_TO_ANY(sum.values));
-        dicelang_distrib_push_value(&sum, (struct dicelang_entry) { 0, 1 }, alloc);
+        for (size_t bit = 0 ; missing > 0 ; bit++, missing >>= 1) {
+            if ((missing & 1) == 0) {
+                continue;
+            }
 
-        for (f32 i = 0 ; i < lhs.values->data[i_lhs].val ; i++) {
-            // empty out the buffer and take the addition result (reallocation of result may make a seg fault if the sum is passed directly)
-            range_clear(RANGE_TO_ANY(buffer.values));
-            dicelang_distrib_combine(&buffer, &dicelang_distrib_add_entries, sum, rhs, alloc);
+            while (nb_powers <= bit) {
+                powers[nb_powers] = dicelang_distrib_create_like(rhs, alloc);
+                dicelang_distrib_convolve(powers + nb_powers, powers[nb_powers - 1], powers[nb_powers - 1], false, alloc);
+                if (rhs.approx.enabled) {
+                    dicelang_distrib_pack(powers + nb_powers, alloc);
+                } else {
+                    dicelang_distrib_narrow(powers + nb_powers);
+                }
+                nb_powers += 1;
+            }
 
-            // transfer the buffer contents into the sum
-            range_clear(RANGE_TO_ANY(sum.values));
-            dicelang_distrib_push_distrib(&sum, buffer, alloc);
+            // the result lands in the buffer, which then becomes the sum
+            dicelang_distrib_clear(&buffer);
+            dicelang_distrib_convolve(&buffer, sum, powers[bit], false, alloc);
+            if (buffer.approx.enabled) {
+                dicelang_distrib_pack(&buffer, alloc);
+            } else {
+                dicelang_distrib_narrow(&buffer);
+            }
+            dicelang_distrib_swap(&sum, &buffer);
         }
 
-        dicelang_distrib_push_distrib(&mult, sum, alloc);
+        dicelang_distrib_push_distrib(out_into, sum, alloc);
     }
 
+    for (size_t i = 1 ; i < nb_powers ; i++) {
+        dicelang_distrib_destroy(powers + i, alloc);
+    }
     dicelang_distrib_destroy(&sum, alloc);
     dicelang_distrib_destroy(&buffer, alloc);
 
-    return mult;
+    dicelang_distrib_pack(out_into, alloc);
 }
 
 /**
@@ -220,42 +569,78 @@ struct dicelang_distrib dicelang_distrib_union(struct dicelang_distrib lhs, stru
 {
     struct dicelang_distrib new_distrib = { };
 
-    if (!lhs.values || !rhs.values) {
+    if (!dicelang_distrib_is_valid(lhs) || !dicelang_distrib_is_valid(rhs)) {
         return (struct dicelang_distrib) { };
     }
 
-    new_distrib = dicelang_distrib_create_empty(alloc);
+    new_distrib = dicelang_distrib_create_like(lhs, alloc);
 
     dicelang_distrib_push_distrib(&new_distrib, lhs, alloc);
     dicelang_distrib_push_distrib(&new_distrib, rhs, alloc);
+    dicelang_distrib_pack(&new_distrib, alloc);
 
     return new_distrib;
 }
 
 /**
- * @brief
+ * @brief Creates the distribution of rolling a die with as many faces as each value of the source distribution.
+ * All faces are laid out in a single dense pass : the count of a face k is the sum of the counts of all values >= k.
  *
- * @param lhs
- * @param rhs
+ * @param from
  * @param alloc
  * @return
  */
 struct dicelang_distrib dicelang_distrib_dice(struct dicelang_distrib from, struct allocator alloc)
 {
     struct dicelang_distrib new_distrib = { };
-
-    if (!from.values) {
+    struct dicelang_entry entry = { };
+    size_t cursor = 0;
+    size_t nb_slots = 0;
+    i32 min = 0;
+    i32 max = 0;
+    f64 mean = 0.;
+    f64 kept = 0.;
+
+    if (!dicelang_distrib_is_valid(from)) {
         return (struct dicelang_distrib) { };
     }
 
-    new_distrib = dicelang_distrib_create_empty(alloc);
+    new_distrib = dicelang_distrib_create_like(from, alloc);
+
+    if (!dicelang_distrib_bounds(from, &min, &max) || (max <= 0)) {
+        return new_distrib;
+    }
+
+    // a face gathers the counts of all the dice it belongs to
+    dicelang_distrib_widen(&new_distrib, dicelang_count_width_for_bits(dicelang_distrib_max_bits(from) + dicelang_ceil_log2(dicelang_distrib_nb_slots(from))), alloc);
 
-    for (size_t i = 0 ; i < from.values->length ; i++) {
-        for (i32 k = 0 ; k < from.values->data[i].val ; k++) {
-            dicelang_distrib_push_value(&new_distrib, (struct dicelang_entry) { .val = k + 1, .count = from.values->data[i].count }, alloc);
+    // a window without gaps always fits the dense form
+    dicelang_distrib_reserve(&new_distrib, 1, max, (size_t) max, alloc);
+
+    // each die marks its highest face, then the marks are accumulated downwards
+    while (dicelang_distrib_next_entry(from, &cursor, &entry)) {
+        if (entry.val > 0) {
+            dicelang_distrib_slot_add(new_distrib, dicelang_distrib_slot(new_distrib, (size_t) entry.val - 1), entry.count.limbs, entry.count.width);
+            mean += (from.approx.enabled) ? (dicelang_weight_get(entry.count.limbs) * entry.val) : 0.;
+        }
+    }
+    nb_slots = dicelang_distrib_nb_slots(new_distrib);
+    for (size_t i = nb_slots - 1 ; i > 0 ; i--) {
+        dicelang_distrib_slot_add(new_distrib, dicelang_distrib_slot(new_distrib, i - 1), dicelang_distrib_slot(new_distrib, i), new_distrib.width);
+    }
+
+    // a value v of weight w rolls w * v times : the faces are normalized by the mean value, and the discarded mass is carried over
+    if (new_distrib.approx.enabled && (mean > 0.)) {
+        kept = 1. - from.approx.discarded;
+        for (size_t i = 0 ; i < nb_slots ; i++) {
+            dicelang_weight_set(dicelang_distrib_slot(new_distrib, i), dicelang_weight_get(dicelang_distrib_slot(new_distrib, i)) * kept / mean);
         }
+        new_distrib.approx.log_weight = from.approx.log_weight + log2(mean / kept);
+        new_distrib.approx.discarded = from.approx.discarded;
     }
 
+    dicelang_distrib_pack(&new_distrib, alloc);
+
     return new_distrib;
 }
 
@@ -295,7 +680,7 @@ static f32 dicelang_token_value(const char *bytes, size_t length)
 }
 
 /**
- * @brief
+ * @brief Creates an empty distribution, in the dense form, with counts on 32 bits.
  *
  * @param alloc
  * @return struct dicelang_distrib
@@ -305,10 +690,12 @@ struct dicelang_distrib dicelang_distrib_create_empty(struct allocator alloc)
     struct dicelang_distrib new_distrib = { };
 
     new_distrib = (struct dicelang_distrib) {
-            .values = range_create_dynamic(alloc, sizeof(*new_distrib.values->data), 8),
+            .offset = 0,
+            .width = 1,
+            .counts = range_create_dynamic(alloc, sizeof(*new_distrib.counts->data), 8),
     };
 
-    if (!new_distrib.values) {
+    if (!new_distrib.counts) {
         return (struct dicelang_distrib) { };
     }
 
@@ -316,125 +703,1337 @@ struct dicelang_distrib dicelang_distrib_create_empty(struct allocator alloc)
 }
 
 /**
- * @brief
+ * @brief Creates an empty distribution in the same numeric mode as another one.
  *
- * @param target
- * @param pushed
+ * @param model
  * @param alloc
+ * @return
  */
-static void dicelang_distrib_push_value(struct dicelang_distrib *target, struct dicelang_entry value, struct allocator alloc)
+static struct dicelang_distrib dicelang_distrib_create_like(struct dicelang_distrib model, struct allocator alloc)
 {
-    size_t index = 0;
-
-    if (!target || (value.count == 0)) {
-        return;
-    }
+    struct dicelang_distrib new_distrib = dicelang_distrib_create_empty(alloc);
 
-    if (sorted_range_find_in(RANGE_TO_ANY(target->values), &dicelang_entry_compare, &value, &index)) {
-        target->values->data[index].count += value.count;
-        return;
+    if (dicelang_distrib_is_valid(new_distrib) && model.approx.enabled) {
+        new_distrib.width = 2;
+        new_distrib.approx = (struct dicelang_distrib_approx) { .enabled = true, .epsilon = model.approx.epsilon, .log_weight = -INFINITY, .discarded = 0. };
     }
 
-    target->values = range_ensure_capacity(alloc, RANGE_TO_ANY(target->values), 1);
-    range_insert_value(RANGE_TO_ANY(target->values), index, &value);
+    return new_distrib;
 }
 
 /**
- * @brief
+ * @brief Adds a single roll of some value to a distribution : a count of one, or a probability of one in the approximate mode.
  *
- * @param out_into
- * @param from
+ * @param target
+ * @param val
  * @param alloc
  */
-static void dicelang_distrib_push_distrib(struct dicelang_distrib *out_into, struct dicelang_distrib from, struct allocator alloc)
+static void dicelang_distrib_push_one(struct dicelang_distrib *target, i32 val, struct allocator alloc)
 {
-    if (!out_into || !from.values) {
+    u32 probability[2] = { };
+
+    if (!target->approx.enabled) {
+        dicelang_distrib_push_value(target, val, (struct dicelang_count) { .limbs = &dicelang_count_one, .width = 1 }, alloc);
         return;
     }
 
-    for (size_t i = 0 ; i < from.values->length ; i++) {
-        dicelang_distrib_push_value(out_into, from.values->data[i], alloc);
-    }
+    dicelang_weight_set(probability, 1.);
+    dicelang_distrib_push_value(target, val, (struct dicelang_count) { .limbs = probability, .width = 2, .approximate = true }, alloc);
+    target->approx.log_weight = 0.;
 }
 
 /**
- * @brief
+ * @brief Adds some count to a value of a distribution. The count is truncated to the width of the distribution, which
+ * should have been widened beforehand.
  *
- * @param lhs
- * @param rhs
- * @return i32
+ * @param target
+ * @param val
+ * @param count
+ * @param alloc
  */
-static i32 dicelang_entry_compare(const void *lhs, const void *rhs)
+static void dicelang_distrib_push_value(struct dicelang_distrib *target, i32 val, struct dicelang_count count, struct allocator alloc)
 {
-    i32 lhs_val = *(i32 *) lhs;
-    i32 rhs_val = *(i32 *) rhs;
+    u32 *slot = nullptr;
 
-    return (lhs_val > rhs_val) - (lhs_val < rhs_val);
-}
+    if (!target || !dicelang_distrib_is_valid(*target) || dicelang_count_is_zero(count.limbs, count.width)) {
+        return;
+    }
 
-// -------------------------------------------------------------------------------------------------
-// -------------------------------------------------------------------------------------------------
+    slot = dicelang_distrib_slot_of(target, val, alloc);
+
+    if (slot) {
+        dicelang_distrib_slot_add(*target, slot, count.limbs, count.width);
+    }
+}
 
 /**
- * @brief
+ * @brief Adds all counts of a distribution to another one, widening it so the sums cannot overflow.
+ * Approximate distributions are mixed in proportion of their weights instead.
  *
  * @param out_into
- * @param f
- * @param lhs
- * @param rhs
+ * @param from
  * @param alloc
  */
-static void dicelang_distrib_combine(struct dicelang_distrib *out_into, dicelang_distrib_modif_func f, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc)
+static void dicelang_distrib_push_distrib(struct dicelang_distrib *out_into, struct dicelang_distrib from, struct allocator alloc)
 {
-    struct dicelang_entry tmp_entry = { };
+    struct dicelang_entry entry = { };
+    size_t cursor = 0;
+    size_t nb_bits = 0;
+    size_t into_bits = 0;
+    i32 min = 0;
+    i32 max = 0;
+    u32 probability[2] = { };
+    f64 total_weight = 0.;
+    f64 into_scale = 0.;
+    f64 from_scale = 0.;
+
+    if (!out_into || !dicelang_distrib_bounds(from, &min, &max)) {
+        return;
+    }
 
-    for (size_t i_lhs = 0 ; i_lhs < lhs.values->length ; i_lhs++) {
-        for (size_t i_rhs = 0 ; i_rhs < rhs.values->length ; i_rhs++) {
-            tmp_entry = f(lhs.values->data[i_lhs], rhs.values->data[i_rhs]);
-            dicelang_distrib_push_value(out_into, tmp_entry, alloc);
+    dicelang_distrib_unshare(out_into, alloc);
+
+    if (out_into->approx.enabled) {
+        // log2(2^a + 2^b), written so that it neither overflows nor chokes on an empty (-infinite) weight
+        total_weight = (out_into->approx.log_weight > from.approx.log_weight) ? out_into->approx.log_weight : from.approx.log_weight;
+        total_weight += log2(exp2(out_into->approx.log_weight - total_weight) + exp2(from.approx.log_weight - total_weight));
+        into_scale = exp2(out_into->approx.log_weight - total_weight);
+        from_scale = exp2(from.approx.log_weight - total_weight);
+
+        for (size_t i = 0 ; i < dicelang_distrib_nb_slots(*out_into) ; i++) {
+            dicelang_weight_set(dicelang_distrib_slot(*out_into, i), dicelang_weight_get(dicelang_distrib_slot(*out_into, i)) * into_scale);
+        }
+
+        dicelang_distrib_reserve(out_into, min, max, dicelang_distrib_nb_slots(from), alloc);
+        if (!dicelang_distrib_merge(out_into, from, from_scale, alloc)) {
+            while (dicelang_distrib_next_entry(from, &cursor, &entry)) {
+                dicelang_weight_set(probability, dicelang_weight_get(entry.count.limbs) * from_scale);
+                dicelang_distrib_push_value(out_into, entry.val, (struct dicelang_count) { .limbs = probability, .width = 2, .approximate = true }, alloc);
+            }
         }
+
+        out_into->approx.discarded = (out_into->approx.discarded * into_scale) + (from.approx.discarded * from_scale);
+        out_into->approx.log_weight = total_weight;
+        return;
+    }
+
+    // a sum of two counts takes at most one more bit than the widest of them
+    nb_bits = dicelang_distrib_max_bits(from);
+    into_bits = dicelang_distrib_max_bits(*out_into);
+    if (into_bits > 0) {
+        nb_bits = ((into_bits > nb_bits) ? into_bits : nb_bits) + 1;
+    }
+    dicelang_distrib_widen(out_into, dicelang_count_width_for_bits(nb_bits), alloc);
+
+    dicelang_distrib_reserve(out_into, min, max, dicelang_distrib_nb_slots(from), alloc);
+
+    if (dicelang_distrib_merge(out_into, from, 1., alloc)) {
+        return;
+    }
+
+    while (dicelang_distrib_next_entry(from, &cursor, &entry)) {
+        dicelang_distrib_push_value(out_into, entry.val, entry.count, alloc);
     }
 }
 
 /**
- * @brief
+ * @brief Adds all counts of a distribution to another one in a single pass, as the values of both are sorted.
+ * A dense target has the counts added at their position, and a sparse one is merged with the source into storage sized once
+ * for both of them, which then replaces its own. The target should have been widened and reserved beforehand.
  *
- * @param target
- * @param f
- * @param seed
+ * @param out_into
+ * @param from
+ * @param from_scale Factor applied to the probabilities of an approximate source.
+ * @param alloc
+ * @return false if the storage of the merge could not be allocated, in which case out_into is untouched.
  */
-static void dicelang_distrib_transform(struct dicelang_distrib *target, dicelang_distrib_modif_func f, struct dicelang_entry seed)
+static bool dicelang_distrib_merge(struct dicelang_distrib *out_into, struct dicelang_distrib from, f64 from_scale, struct allocator alloc)
 {
-    for (size_t i = 0 ; i < target->values->length ; i++) {
-        target->values->data[i] = f(target->values->data[i], seed);
+    RANGE(i32) *values = nullptr;
+    RANGE(u32) *counts = nullptr;
+    struct dicelang_entry entry = { };
+    size_t cursor = 0;
+    size_t into_index = 0;
+    size_t into_length = 0;
+    size_t capacity = 0;
+    bool from_found = false;
+    bool take_into = false;
+    bool take_from = false;
+    u32 probability[2] = { };
+    u32 *slot = nullptr;
+
+    if (!out_into->counts) {
+        return false;
+    }
+
+    from_found = dicelang_distrib_next_entry(from, &cursor, &entry);
+
+    if (!out_into->values) {
+        for ( ; from_found ; from_found = dicelang_distrib_next_entry(from, &cursor, &entry)) {
+            if (out_into->approx.enabled) {
+                dicelang_weight_set(probability, dicelang_weight_get(entry.count.limbs) * from_scale);
+                entry.count.limbs = probability;
+            }
+            slot = dicelang_distrib_slot(*out_into, (size_t) ((i64) entry.val - (i64) out_into->offset));
+            dicelang_distrib_slot_add(*out_into, slot, entry.count.limbs, entry.count.width);
+        }
+        return true;
+    }
+
+    into_length = out_into->values->length;
+    capacity = into_length + dicelang_distrib_nb_slots(from);
+    values = range_create_dynamic(alloc, sizeof(*values->data), capacity);
+    counts = range_create_dynamic(alloc, sizeof(*counts->data), capacity * out_into->width);
+    if (!values || !counts) {
+        range_destroy_dynamic(alloc, &RANGE_TO_ANY(values));
+        range_destroy_dynamic(alloc, &RANGE_TO_ANY(counts));
+        return false;
+    }
+
+    while ((into_index < into_length) || from_found) {
+        take_into = (into_index < into_length) && (!from_found || (out_into->values->data[into_index] <= entry.val));
+        take_from = from_found && ((into_index >= into_length) || (entry.val <= out_into->values->data[into_index]));
+
+        slot = counts->data + counts->length;
+        memset(slot, 0, out_into->width * sizeof(*counts->data));
+        values->data[values->length] = take_into ? out_into->values->data[into_index] : entry.val;
+        values->length += 1;
+        counts->length += out_into->width;
+
+        if (take_into) {
+            memcpy(slot, dicelang_distrib_slot(*out_into, into_index), out_into->width * sizeof(*counts->data));
+            into_index += 1;
+        }
+        if (take_from) {
+            if (out_into->approx.enabled) {
+                dicelang_weight_set(probability, dicelang_weight_get(entry.count.limbs) * from_scale);
+                entry.count.limbs = probability;
+            }
+            dicelang_distrib_slot_add(*out_into, slot, entry.count.limbs, entry.count.width);
+            from_found = dicelang_distrib_next_entry(from, &cursor, &entry);
+        }
     }
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(out_into->values));
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(out_into->counts));
+    out_into->values = (void *) values;
+    out_into->counts = (void *) counts;
+
+    return true;
 }
 
 /**
- * @brief
+ * @brief Finds the count of a value in a distribution, making room for it if the value is not there yet.
+ * Dense distributions have their window extended if the value falls outside of it.
  *
+ * @param target
+ * @param val
+ * @param alloc
+ * @return The limbs of the count of the value, or NULL if the storage could not grow.
  */
-static struct dicelang_entry dicelang_distrib_add_entries(struct dicelang_entry lhs, struct dicelang_entry rhs)
+static u32 *dicelang_distrib_slot_of(struct dicelang_distrib *target, i32 val, struct allocator alloc)
 {
-    return (struct dicelang_entry) { .val = lhs.val + rhs.val, .count = lhs.count * rhs.count };
+    size_t nb_slots = dicelang_distrib_nb_slots(*target);
+    size_t index = 0;
+
+    dicelang_distrib_unshare(target, alloc);
+
+    if (!target->values && ((nb_slots == 0) || (val < target->offset) || (val >= target->offset + (i64) nb_slots))) {
+        dicelang_distrib_reserve(target, val, val, 1, alloc);
+    }
+
+    if (!target->counts) {
+        return nullptr;
+    }
+
+    if (!target->values) {
+        return dicelang_distrib_slot(*target, (size_t) ((i64) val - (i64) target->offset));
+    }
+
+    if (sorted_range_find_in(RANGE_TO_ANY(target->values), &dicelang_value_compare, &val, &index)) {
+        return dicelang_distrib_slot(*target, index);
+    }
+
+    target->values = range_ensure_capacity(alloc, RANGE_TO_ANY(target->values), 1);
+    target->counts = range_ensure_capacity(alloc, RANGE_TO_ANY(target->counts), target->width);
+    if (!target->values || !target->counts) {
+        return nullptr;
+    }
+
+    range_insert_value(RANGE_TO_ANY(target->values), index, &val);
+
+    // the counts follow the values, one slot of width limbs each
+    memmove(target->counts->data + ((index + 1) * target->width), target->counts->data + (index * target->width),
+            (target->counts->length - (index * target->width)) * sizeof(*target->counts->data));
+    memset(target->counts->data + (index * target->width), 0, target->width * sizeof(*target->counts->data));
+    target->counts->length += target->width;
+
+    return dicelang_distrib_slot(*target, index);
+}
+
+/**
+ * @brief Removes all values from a distribution, keeping its storage. Its counts go back to 32 bits.
+ *
+ * @param target
+ */
+static void dicelang_distrib_clear(struct dicelang_distrib *target)
+{
+    if (!target) {
+        return;
+    }
+
+    target->offset = 0;
+    target->width = target->approx.enabled ? 2 : 1;
+    if (target->approx.enabled) {
+        target->approx.log_weight = -INFINITY;
+        target->approx.discarded = 0.;
+    }
+    range_clear(RANGE_TO_ANY(target->counts));
+    range_clear(RANGE_TO_ANY(target->values));
+}
+
+/**
+ * @brief Empties a distribution so it can receive a result in the same numeric mode as another one. Its storage is kept and goes
+ * back to the dense form, unless it is shared : it is then released and replaced.
+ *
+ * @param target
+ * @param model
+ * @param alloc
+ */
+static void dicelang_distrib_reset_like(struct dicelang_distrib *target, struct dicelang_distrib model, struct allocator alloc)
+{
+    if (target->references || !dicelang_distrib_is_valid(*target)) {
+        dicelang_distrib_destroy(target, alloc);
+        *target = dicelang_distrib_create_like(model, alloc);
+        return;
+    }
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(target->values));
+
+    target->approx = (struct dicelang_distrib_approx) { .enabled = model.approx.enabled, .epsilon = model.approx.epsilon };
+    dicelang_distrib_clear(target);
+}
+
+/**
+ * @brief Exchanges the contents of two distributions.
+ *
+ * @param lhs
+ * @param rhs
+ */
+static void dicelang_distrib_swap(struct dicelang_distrib *lhs, struct dicelang_distrib *rhs)
+{
+    struct dicelang_distrib tmp = *lhs;
+
+    *lhs = *rhs;
+    *rhs = tmp;
+}
+
+/**
+ * @brief
+ *
+ * @param lhs
+ * @param rhs
+ * @return i32
+ */
+static i32 dicelang_value_compare(const void *lhs, const void *rhs)
+{
+    i32 lhs_val = *(i32 *) lhs;
+    i32 rhs_val = *(i32 *) rhs;
+
+    return (lhs_val > rhs_val) - (lhs_val < rhs_val);
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Fetches the smallest and highest values a distribution can hold.
+ * For a dense distribution, this is its whole window even if its edges are zeroed.
+ *
+ * @param[in] d
+ * @param[out] out_min
+ * @param[out] out_max
+ * @return false if the distribution holds nothing.
+ */
+static bool dicelang_distrib_bounds(struct dicelang_distrib d, i32 *out_min, i32 *out_max)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(d);
+
+    if (nb_slots == 0) {
+        return false;
+    }
+
+    if (d.values) {
+        *out_min = d.values->data[0];
+        *out_max = RANGE_LAST(d.values);
+    } else {
+        *out_min = d.offset;
+        *out_max = d.offset + (i32) (nb_slots - 1);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Number of storage slots used by a distribution. Zeroed counts in a dense window are included.
+ *
+ * @param d
+ * @return
+ */
+static size_t dicelang_distrib_nb_slots(struct dicelang_distrib d)
+{
+    if (!d.counts || (d.width == 0)) {
+        return 0;
+    }
+
+    return d.counts->length / d.width;
+}
+
+/**
+ * @brief Limbs of the count stored in some slot of a distribution.
+ *
+ * @param d
+ * @param index
+ * @return
+ */
+static u32 *dicelang_distrib_slot(struct dicelang_distrib d, size_t index)
+{
+    return d.counts->data + (index * d.width);
+}
+
+/**
+ * @brief Decides if some number of values spread over some span is better stored densely.
+ *
+ * @param span
+ * @param nb_values
+ * @return
+ */
+static bool dicelang_distrib_fits_dense(i64 span, size_t nb_values)
+{
+    return (span <= DICELANG_DISTRIB_DENSE_MIN_SPAN) || ((u64) span <= (u64) nb_values * DICELANG_DISTRIB_DENSE_MAX_GAP_RATIO);
+}
+
+/**
+ * @brief Prepares a distribution to receive some values between two bounds.
+ * A dense distribution has its window widened (once) to contain the bounds, unless the result would be mostly gaps, in which case the distribution is moved to the sparse form.
+ * A sparse distribution that is empty, or would be compact enough, is moved to the dense form.
+ *
+ * @param[inout] target Distribution to prepare.
+ * @param[in] min Smallest value that will be pushed.
+ * @param[in] max Highest value that will be pushed.
+ * @param[in] nb_values Estimation of the number of values that will be pushed.
+ * @param[in] alloc
+ */
+static void dicelang_distrib_reserve(struct dicelang_distrib *target, i32 min, i32 max, size_t nb_values, struct allocator alloc)
+{
+    i32 current_min = min;
+    i32 current_max = max;
+    size_t nb_slots = dicelang_distrib_nb_slots(*target);
+    size_t width = target->width;
+    size_t shift = 0;
+    i64 span = 0;
+
+    if (!dicelang_distrib_is_valid(*target)) {
+        return;
+    }
+
+    dicelang_distrib_unshare(target, alloc);
+
+    if (dicelang_distrib_bounds(*target, &current_min, &current_max)) {
+        min = (current_min < min) ? current_min : min;
+        max = (current_max > max) ? current_max : max;
+    }
+    span = (i64) max - (i64) min + 1;
+
+    if (!dicelang_distrib_fits_dense(span, nb_slots + nb_values)) {
+        dicelang_distrib_to_sparse(target, alloc);
+        target->values = range_ensure_capacity(alloc, RANGE_TO_ANY(target->values), nb_values);
+        target->counts = range_ensure_capacity(alloc, RANGE_TO_ANY(target->counts), nb_values * width);
+        return;
+    }
+
+    if (target->values) {
+        dicelang_distrib_to_dense(target, alloc);
+        nb_slots = dicelang_distrib_nb_slots(*target);
+    }
+
+    if (nb_slots == 0) {
+        current_min = min;
+    }
+
+    target->counts = range_ensure_capacity(alloc, RANGE_TO_ANY(target->counts), ((size_t) span - nb_slots) * width);
+    if (!target->counts) {
+        return;
+    }
+
+    // moving the current counts up if the window grows downwards, and zeroing the new slots
+    shift = (size_t) ((i64) current_min - (i64) min);
+    if (shift > 0) {
+        memmove(target->counts->data + (shift * width), target->counts->data, nb_slots * width * sizeof(*target->counts->data));
+        memset(target->counts->data, 0, shift * width * sizeof(*target->counts->data));
+    }
+    memset(target->counts->data + ((shift + nb_slots) * width), 0, ((size_t) span - shift - nb_slots) * width * sizeof(*target->counts->data));
+
+    target->counts->length = (size_t) span * width;
+    target->offset = min;
+}
+
+/**
+ * @brief Shrinks a distribution to its non-zero values, narrows its counts to what they need, and picks the storage form best suited to its shape.
+ * Approximate distributions have their unlikely values dropped first.
+ *
+ * @param target
+ * @param alloc
+ */
+static void dicelang_distrib_pack(struct dicelang_distrib *target, struct allocator alloc)
+{
+    size_t first = 0;
+    size_t last = 0;
+    size_t nb_slots = 0;
+    size_t nb_values = 0;
+
+    if (!dicelang_distrib_is_valid(*target)) {
+        return;
+    }
+
+    dicelang_distrib_unshare(target, alloc);
+    dicelang_distrib_prune(target);
+    dicelang_distrib_narrow(target);
+    nb_slots = dicelang_distrib_nb_slots(*target);
+
+    if (target->values) {
+        if ((nb_slots > 0) && dicelang_distrib_fits_dense((i64) RANGE_LAST(target->values) - (i64) target->values->data[0] + 1, nb_slots)) {
+            dicelang_distrib_to_dense(target, alloc);
+        }
+        return;
+    }
+
+    // trimming zeroes from both ends of the window
+    while ((first < nb_slots) && dicelang_count_is_zero(dicelang_distrib_slot(*target, first), target->width)) {
+        first += 1;
+    }
+    if (first == nb_slots) {
+        dicelang_distrib_clear(target);
+        return;
+    }
+    last = nb_slots - 1;
+    while (dicelang_count_is_zero(dicelang_distrib_slot(*target, last), target->width)) {
+        last -= 1;
+    }
+
+    if (first > 0) {
+        memmove(target->counts->data, dicelang_distrib_slot(*target, first), (last - first + 1) * target->width * sizeof(*target->counts->data));
+    }
+    target->counts->length = (last - first + 1) * target->width;
+    target->offset += (i32) first;
+    nb_slots = last - first + 1;
+
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        nb_values += !dicelang_count_is_zero(dicelang_distrib_slot(*target, i), target->width);
+    }
+
+    if (!dicelang_distrib_fits_dense((i64) nb_slots, nb_values)) {
+        dicelang_distrib_to_sparse(target, alloc);
+    }
+}
+
+/**
+ * @brief Moves a distribution to the sparse form, where the values are stored next to their counts.
+ * The counts are compacted in place.
+ *
+ * @param target
+ * @param alloc
+ */
+static void dicelang_distrib_to_sparse(struct dicelang_distrib *target, struct allocator alloc)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(*target);
+    size_t nb_values = 0;
+    i32 val = 0;
+
+    if (target->values || !target->counts) {
+        return;
+    }
+
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        nb_values += !dicelang_count_is_zero(dicelang_distrib_slot(*target, i), target->width);
+    }
+
+    target->values = range_create_dynamic(alloc, sizeof(*target->values->data), (nb_values > 8) ? nb_values : 8);
+    if (!target->values) {
+        return;
+    }
+
+    // the dense window is already sorted
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        if (dicelang_count_is_zero(dicelang_distrib_slot(*target, i), target->width)) {
+            continue;
+        }
+
+        val = target->offset + (i32) i;
+        memmove(dicelang_distrib_slot(*target, target->values->length), dicelang_distrib_slot(*target, i), target->width * sizeof(*target->counts->data));
+        range_push(RANGE_TO_ANY(target->values), &val);
+    }
+
+    target->counts->length = target->values->length * target->width;
+    target->offset = 0;
+}
+
+/**
+ * @brief Moves a distribution to the dense form, where counts are stored contiguously from the smallest value.
+ *
+ * @param target
+ * @param alloc
+ */
+static void dicelang_distrib_to_dense(struct dicelang_distrib *target, struct allocator alloc)
+{
+    RANGE(u32) *counts = nullptr;
+    size_t span = 0;
+    i32 min = 0;
+    i32 max = 0;
+
+    if (!target->values) {
+        return;
+    }
+
+    if (!dicelang_distrib_bounds(*target, &min, &max)) {
+        min = 0;
+        max = -1;
+    }
+    span = (size_t) ((i64) max - (i64) min + 1);
+
+    counts = range_create_dynamic(alloc, sizeof(*counts->data), (span + 8) * target->width);
+    if (!counts) {
+        return;
+    }
+    counts->length = span * target->width;
+    memset(counts->data, 0, counts->length * sizeof(*counts->data));
+
+    for (size_t i = 0 ; i < target->values->length ; i++) {
+        memcpy(counts->data + ((size_t) ((i64) target->values->data[i] - (i64) min) * target->width), dicelang_distrib_slot(*target, i),
+               target->width * sizeof(*counts->data));
+    }
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(target->values));
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(target->counts));
+    target->counts = (void *) counts;
+    target->offset = min;
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Number of bits of the highest count of a distribution.
+ *
+ * @param d
+ * @return
+ */
+static size_t dicelang_distrib_max_bits(struct dicelang_distrib d)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(d);
+    size_t nb_bits = 0;
+    size_t max = 0;
+
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        nb_bits = dicelang_count_bit_length(dicelang_distrib_slot(d, i), d.width);
+        max = (nb_bits > max) ? nb_bits : max;
+    }
+
+    return max;
+}
+
+/**
+ * @brief Upper bound of the number of bits of the counts of a sum of two distributions.
+ * A count of the result gathers at most one product of counts per value of the smallest operand.
+ *
+ * @param lhs
+ * @param rhs
+ * @return
+ */
+static size_t dicelang_distrib_product_bits(struct dicelang_distrib lhs, struct dicelang_distrib rhs)
+{
+    size_t lhs_slots = dicelang_distrib_nb_slots(lhs);
+    size_t rhs_slots = dicelang_distrib_nb_slots(rhs);
+
+    return dicelang_distrib_max_bits(lhs) + dicelang_distrib_max_bits(rhs) + dicelang_ceil_log2((lhs_slots < rhs_slots) ? lhs_slots : rhs_slots);
+}
+
+/**
+ * @brief Moves the counts of a distribution to a larger number of limbs. Distributions already wide enough are untouched.
+ *
+ * @param target
+ * @param width
+ * @param alloc
+ */
+static void dicelang_distrib_widen(struct dicelang_distrib *target, u32 width, struct allocator alloc)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(*target);
+
+    if (!dicelang_distrib_is_valid(*target) || target->approx.enabled || (width <= target->width)) {
+        return;
+    }
+
+    dicelang_distrib_unshare(target, alloc);
+
+    target->counts = range_ensure_capacity(alloc, RANGE_TO_ANY(target->counts), nb_slots * (width - target->width));
+    if (!target->counts) {
+        return;
+    }
+
+    // from the last slot, so that no count is overwritten before being moved
+    for (size_t i = nb_slots ; i > 0 ; i--) {
+        memmove(target->counts->data + ((i - 1) * width), dicelang_distrib_slot(*target, i - 1), target->width * sizeof(*target->counts->data));
+        memset(target->counts->data + ((i - 1) * width) + target->width, 0, (width - target->width) * sizeof(*target->counts->data));
+    }
+
+    target->counts->length = nb_slots * width;
+    target->width = width;
+}
+
+/**
+ * @brief Moves the counts of a distribution to the smallest number of limbs that holds its highest count.
+ *
+ * @param target
+ */
+static void dicelang_distrib_narrow(struct dicelang_distrib *target)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(*target);
+    u32 width = 0;
+
+    if (!dicelang_distrib_is_valid(*target) || target->approx.enabled) {
+        return;
+    }
+
+    width = dicelang_count_width_for_bits(dicelang_distrib_max_bits(*target));
+    if (width >= target->width) {
+        return;
+    }
+
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        memmove(target->counts->data + (i * width), dicelang_distrib_slot(*target, i), width * sizeof(*target->counts->data));
+    }
+
+    target->counts->length = nb_slots * width;
+    target->width = width;
+}
+
+/**
+ * @brief Number of bits needed to count up to n, minus one : the smallest k such that 2^k >= n.
+ *
+ * @param n
+ * @return
+ */
+static size_t dicelang_ceil_log2(size_t n)
+{
+    if (n <= 1) {
+        return 0;
+    }
+
+    return 64 - (size_t) __builtin_clzll((u64) (n - 1));
+}
+
+/**
+ * @brief Adds a count to a slot of a distribution, as integers or as probabilities depending on its numeric mode.
+ *
+ * @param d
+ * @param slot
+ * @param value
+ * @param value_width
+ */
+static void dicelang_distrib_slot_add(struct dicelang_distrib d, u32 *slot, const u32 *value, u32 value_width)
+{
+    if (d.approx.enabled) {
+        dicelang_weight_set(slot, dicelang_weight_get(slot) + dicelang_weight_get(value));
+        return;
+    }
+
+    dicelang_count_add(slot, d.width, value, value_width);
+}
+
+/**
+ * @brief Substracts a count from a slot of a distribution, as integers or as probabilities depending on its numeric mode.
+ *
+ * @param d
+ * @param slot
+ * @param value
+ * @param value_width
+ */
+static void dicelang_distrib_slot_sub(struct dicelang_distrib d, u32 *slot, const u32 *value, u32 value_width)
+{
+    if (d.approx.enabled) {
+        dicelang_weight_set(slot, dicelang_weight_get(slot) - dicelang_weight_get(value));
+        return;
+    }
+
+    dicelang_count_sub(slot, d.width, value, value_width);
+}
+
+/**
+ * @brief Adds the product of two counts to a slot of a distribution, as integers or as probabilities depending on its numeric mode.
+ *
+ * @param d
+ * @param slot
+ * @param lhs
+ * @param lhs_width
+ * @param rhs
+ * @param rhs_width
+ */
+static void dicelang_distrib_slot_mul_add(struct dicelang_distrib d, u32 *slot, const u32 *lhs, u32 lhs_width, const u32 *rhs, u32 rhs_width)
+{
+    if (d.approx.enabled) {
+        dicelang_weight_set(slot, dicelang_weight_get(slot) + (dicelang_weight_get(lhs) * dicelang_weight_get(rhs)));
+        return;
+    }
+
+    dicelang_count_mul_add(slot, d.width, lhs, lhs_width, rhs, rhs_width);
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Drops the values of an approximate distribution whose probability is below its epsilon, and adds their mass to the discarded one.
+ * Exact distributions are untouched.
+ *
+ * @param target
+ */
+static void dicelang_distrib_prune(struct dicelang_distrib *target)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(*target);
+    size_t nb_kept = 0;
+    f64 probability = 0.;
+
+    if (!target->approx.enabled) {
+        return;
+    }
+
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        probability = dicelang_weight_get(dicelang_distrib_slot(*target, i));
+
+        // rounding errors can leave tiny negative probabilities behind
+        if ((probability != 0.) && (probability < target->approx.epsilon)) {
+            target->approx.discarded += (probability > 0.) ? probability : 0.;
+            dicelang_weight_set(dicelang_distrib_slot(*target, i), 0.);
+        }
+    }
+
+    if (!target->values) {
+        return;
+    }
+
+    // sparse distributions only store non-zero values
+    for (size_t i = 0 ; i < nb_slots ; i++) {
+        if (dicelang_count_is_zero(dicelang_distrib_slot(*target, i), target->width)) {
+            continue;
+        }
+        target->values->data[nb_kept] = target->values->data[i];
+        memmove(dicelang_distrib_slot(*target, nb_kept), dicelang_distrib_slot(*target, i), target->width * sizeof(*target->counts->data));
+        nb_kept += 1;
+    }
+    target->values->length = nb_kept;
+    target->counts->length = nb_kept * target->width;
+}
+
+/**
+ * @brief Sets the weight and discarded mass of an approximate distribution receiving the sum of two others.
+ * The weights multiply like the total counts would, and the mass missing from either operand is missing from the result.
+ *
+ * @param out_into
+ * @param lhs
+ * @param rhs
+ */
+static void dicelang_distrib_weigh_product(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs)
+{
+    if (!out_into->approx.enabled) {
+        return;
+    }
+
+    out_into->approx.log_weight = lhs.approx.log_weight + rhs.approx.log_weight;
+    out_into->approx.discarded = 1. - ((1. - lhs.approx.discarded) * (1. - rhs.approx.discarded));
+}
+
+/**
+ * @brief Reads the probability stored in a slot of an approximate distribution.
+ *
+ * @param limbs
+ * @return
+ */
+static f64 dicelang_weight_get(const u32 *limbs)
+{
+    f64 weight = 0.;
+
+    memcpy(&weight, limbs, sizeof(weight));
+
+    return weight;
+}
+
+/**
+ * @brief Writes a probability to a slot of an approximate distribution.
+ *
+ * @param limbs
+ * @param weight
+ */
+static void dicelang_weight_set(u32 *limbs, f64 weight)
+{
+    memcpy(limbs, &weight, sizeof(weight));
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Defines the kernel combining each pair of values of two distributions into a third one, multiplying their counts.
+ * The operator f is called directly so it is inlined in the loop over all pairs, and a dense result has its slots addressed
+ * without looking them up.
+ * A sparse result is built in a batch : all pairs are computed, sorted by value and reduced in a single pass, instead of being inserted
+ * one by one in the sorted values.
+ * The bounds of the result are computed from the extreme values of the operands, so a dense result is sized once, and its counts
+ * are widened from the bound of dicelang_distrib_product_bits() : f must map the values of one operand to distinct values for each
+ * value of the other one.
+ */
+#define DICELANG_DISTRIB_COMBINE_KERNEL(name, f) \
+static void dicelang_distrib_combine_##name(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc) \
+{ \
+    struct dicelang_entry lhs_entry = { }; \
+    struct dicelang_entry rhs_entry = { }; \
+    i32 corners[4] = { }; \
+    size_t lhs_cursor = 0; \
+    size_t rhs_cursor = 0; \
+    i32 lhs_bounds[2] = { }; \
+    i32 rhs_bounds[2] = { }; \
+    i32 min = 0; \
+    i32 max = 0; \
+    u32 *slot = nullptr; \
+    struct dicelang_distrib_batch batch = { }; \
+ \
+    if (!dicelang_distrib_bounds(lhs, lhs_bounds, lhs_bounds + 1) || !dicelang_distrib_bounds(rhs, rhs_bounds, rhs_bounds + 1)) { \
+        return; \
+    } \
+ \
+    /* extreme values of the result are reached on the extreme values of the operands */ \
+    for (size_t i = 0 ; i < 4 ; i++) { \
+        corners[i] = f(lhs_bounds[i / 2], rhs_bounds[i % 2]); \
+    } \
+    min = corners[0]; \
+    max = corners[0]; \
+    for (size_t i = 1 ; i < 4 ; i++) { \
+        min = (corners[i] < min) ? corners[i] : min; \
+        max = (corners[i] > max) ? corners[i] : max; \
+    } \
+ \
+    dicelang_distrib_widen(out_into, dicelang_count_width_for_bits(dicelang_distrib_product_bits(lhs, rhs)), alloc); \
+    dicelang_distrib_reserve(out_into, min, max, dicelang_distrib_nb_slots(lhs) * dicelang_distrib_nb_slots(rhs), alloc); \
+ \
+    if (out_into->values && dicelang_distrib_is_empty(*out_into) && dicelang_distrib_batch_create(lhs, rhs, &batch, alloc)) { \
+        for (size_t i = 0 ; i < batch.nb_lhs ; i++) { \
+            for (size_t j = 0 ; j < batch.nb_rhs ; j++) { \
+                batch.pairs[(i * batch.nb_rhs) + j] = (struct dicelang_distrib_pair) { \
+                        .key = (u32) f(batch.lhs_entries[i].val, batch.rhs_entries[j].val) ^ 0x80000000u, \
+                        .lhs_index = (u32) i, \
+                        .rhs_index = (u32) j, \
+                }; \
+            } \
+        } \
+        dicelang_distrib_batch_reduce(out_into, batch, alloc); \
+        return; \
+    } \
+ \
+    while (dicelang_distrib_next_entry(lhs, &lhs_cursor, &lhs_entry)) { \
+        rhs_cursor = 0; \
+        while (dicelang_distrib_next_entry(rhs, &rhs_cursor, &rhs_entry)) { \
+            if (out_into->values) { \
+                slot = dicelang_distrib_slot_of(out_into, f(lhs_entry.val, rhs_entry.val), alloc); \
+            } else { \
+                slot = dicelang_distrib_slot(*out_into, (size_t) (f(lhs_entry.val, rhs_entry.val) - out_into->offset)); \
+            } \
+            if (slot) { \
+                dicelang_distrib_slot_mul_add(*out_into, slot, lhs_entry.count.limbs, lhs_entry.count.width, rhs_entry.count.limbs, rhs_entry.count.width); \
+            } \
+        } \
+    } \
+}
+
+DICELANG_DISTRIB_COMBINE_KERNEL(add, dicelang_distrib_add_values)
+DICELANG_DISTRIB_COMBINE_KERNEL(substract, dicelang_distrib_sub_values)
+
+/**
+ * @brief Maps each operator to its pairwise kernel.
+ */
+static const dicelang_distrib_combine_kernel dicelang_distrib_combine_kernels[DOP_NUMBER] = {
+        [DOP_add]       = &dicelang_distrib_combine_add,
+        [DOP_substract] = &dicelang_distrib_combine_substract,
+};
+
+/**
+ * @brief Combines each pair of values of two distributions into a third one with the kernel of an operator.
+ * The kernel is picked once for the whole operation.
+ *
+ * @param out_into
+ * @param op
+ * @param lhs
+ * @param rhs
+ * @param alloc
+ */
+static void dicelang_distrib_combine(struct dicelang_distrib *out_into, enum dicelang_distrib_operator op, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc)
+{
+    if (!out_into || (op >= DOP_NUMBER)) {
+        return;
+    }
+
+    dicelang_distrib_combine_kernels[op](out_into, lhs, rhs, alloc);
+}
+
+/**
+ * @brief Sums or substracts two distributions. Large dense operands are convolved with a number-theoretic transform,
+ * smaller dense ones (and approximate ones, which are pruned to a bounded support) with a direct vectorized kernel,
+ * and other ones go through the pairwise combination.
+ *
+ * @param out_into Empty distribution receiving the result.
+ * @param lhs
+ * @param rhs
+ * @param substract Computes lhs - rhs instead of lhs + rhs.
+ * @param alloc
+ */
+static void dicelang_distrib_convolve(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, bool substract, struct allocator alloc)
+{
+    size_t lhs_slots = dicelang_distrib_nb_slots(lhs);
+    size_t rhs_slots = dicelang_distrib_nb_slots(rhs);
+    size_t length = 0;
+    i32 min = 0;
+
+    dicelang_distrib_weigh_product(out_into, lhs, rhs);
+
+    if (lhs.values || rhs.values || (lhs_slots == 0) || (rhs_slots == 0)) {
+        dicelang_distrib_combine(out_into, substract ? DOP_substract : DOP_add, lhs, rhs, alloc);
+        return;
+    }
+
+    length = lhs_slots + rhs_slots - 1;
+    if (substract) {
+        min = lhs.offset - (rhs.offset + (i32) rhs_slots - 1);
+    } else {
+        min = lhs.offset + rhs.offset;
+    }
+
+    dicelang_distrib_widen(out_into, dicelang_count_width_for_bits(dicelang_distrib_product_bits(lhs, rhs)), alloc);
+    dicelang_distrib_reserve(out_into, min, min + (i32) (length - 1), length, alloc);
+
+    if (out_into->values || !out_into->counts) {
+        dicelang_distrib_combine(out_into, substract ? DOP_substract : DOP_add, lhs, rhs, alloc);
+        return;
+    }
+
+    if (out_into->approx.enabled || (lhs_slots < DICELANG_DISTRIB_NTT_MIN_LENGTH) || (rhs_slots < DICELANG_DISTRIB_NTT_MIN_LENGTH)) {
+        if (!dicelang_distrib_convolve_direct(out_into, lhs, rhs, substract, min, alloc)) {
+            dicelang_distrib_combine(out_into, substract ? DOP_substract : DOP_add, lhs, rhs, alloc);
+        }
+        return;
+    }
+
+    if (!dicelang_convolution_ntt(lhs.counts->data, lhs_slots, lhs.width, rhs.counts->data, rhs_slots, rhs.width, substract,
+                                  dicelang_distrib_slot(*out_into, (size_t) (min - out_into->offset)), out_into->width, alloc)) {
+        dicelang_distrib_combine(out_into, substract ? DOP_substract : DOP_add, lhs, rhs, alloc);
+    }
+}
+
+/**
+ * @brief Sums or substracts two dense distributions with a direct convolution kernel. Exact counts must fit on 32 bits for the
+ * operands and on 64 bits for the result, as the kernels accumulate on 64 bits lanes.
+ *
+ * @param out_into Dense distribution receiving the result, already reserved from min.
+ * @param lhs
+ * @param rhs
+ * @param substract Computes lhs - rhs instead of lhs + rhs.
+ * @param min Smallest value of the result.
+ * @param alloc
+ * @return false if the kernels cannot compute this convolution, in which case out_into is untouched.
+ */
+static bool dicelang_distrib_convolve_direct(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, bool substract, i32 min, struct allocator alloc)
+{
+    size_t lhs_slots = dicelang_distrib_nb_slots(lhs);
+    size_t rhs_slots = dicelang_distrib_nb_slots(rhs);
+    size_t length = lhs_slots + rhs_slots - 1;
+    size_t rhs_index = 0;
+    u32 *first = dicelang_distrib_slot(*out_into, (size_t) (min - out_into->offset));
+    u32 *rhs_counts = nullptr;
+    u64 *sums = nullptr;
+    f64 *lhs_weights = nullptr;
+    f64 *rhs_weights = nullptr;
+    f64 *weights = nullptr;
+
+    if (out_into->approx.enabled) {
+        lhs_weights = alloc.malloc(alloc, (lhs_slots + rhs_slots + length) * sizeof(*lhs_weights));
+        if (!lhs_weights) {
+            return false;
+        }
+        rhs_weights = lhs_weights + lhs_slots;
+        weights = rhs_weights + rhs_slots;
+
+        // a difference is the sum with the reversed right hand side
+        for (size_t i = 0 ; i < lhs_slots ; i++) {
+            lhs_weights[i] = dicelang_weight_get(dicelang_distrib_slot(lhs, i));
+        }
+        for (size_t i = 0 ; i < rhs_slots ; i++) {
+            rhs_index = substract ? (rhs_slots - 1 - i) : i;
+            rhs_weights[i] = dicelang_weight_get(dicelang_distrib_slot(rhs, rhs_index));
+        }
+        for (size_t i = 0 ; i < length ; i++) {
+            weights[i] = dicelang_weight_get(first + (i * out_into->width));
+        }
+
+        dicelang_kernel_convolve_f64(lhs_weights, lhs_slots, rhs_weights, rhs_slots, weights);
+
+        for (size_t i = 0 ; i < length ; i++) {
+            dicelang_weight_set(first + (i * out_into->width), weights[i]);
+        }
+
+        alloc.free(alloc, lhs_weights);
+        return true;
+    }
+
+    if ((lhs.width != 1) || (rhs.width != 1) || (out_into->width > 2)) {
+        return false;
+    }
+
+    sums = alloc.malloc(alloc, (length * sizeof(*sums)) + (rhs_slots * sizeof(*rhs_counts)));
+    if (!sums) {
+        return false;
+    }
+    rhs_counts = (u32 *) (sums + length);
+
+    for (size_t i = 0 ; i < rhs_slots ; i++) {
+        rhs_counts[i] = rhs.counts->data[substract ? (rhs_slots - 1 - i) : i];
+    }
+    memset(sums, 0, length * sizeof(*sums));
+
+    dicelang_kernel_convolve_u64(lhs.counts->data, lhs_slots, rhs_counts, rhs_slots, sums);
+
+    for (size_t i = 0 ; i < length ; i++) {
+        dicelang_count_add(first + (i * out_into->width), out_into->width, (u32[2]) { (u32) sums[i], (u32) (sums[i] >> 32) }, 2);
+    }
+
+    alloc.free(alloc, sums);
+    return true;
+}
+
+/**
+ * @brief Adds a uniform distribution (a die) to another one, without multiplying each pair of counts.
+ * Each count of the result is the count of the die times the sum of the source counts in a window as wide as the die,
+ * and that window slides along the source in a single pass.
+ *
+ * @param out_into Empty distribution receiving the result.
+ * @param from Dense distribution the die is added to.
+ * @param die Uniform distribution.
+ * @param alloc
+ */
+static void dicelang_distrib_roll_uniform(struct dicelang_distrib *out_into, struct dicelang_distrib from, struct dicelang_distrib die, struct allocator alloc)
+{
+    size_t from_slots = dicelang_distrib_nb_slots(from);
+    size_t faces = 0;
+    size_t length = 0;
+    u32 *window = nullptr;
+    i32 min = 0;
+
+    if (from.values || (from_slots == 0) || !dicelang_distrib_is_uniform(die)) {
+        dicelang_distrib_convolve(out_into, from, die, false, alloc);
+        return;
+    }
+
+    faces = dicelang_distrib_nb_slots(die);
+    length = from_slots + faces - 1;
+    min = from.offset + die.offset;
+
+    dicelang_distrib_weigh_product(out_into, from, die);
+
+    // the window sums at most as many counts as there are faces
+    dicelang_distrib_widen(out_into, dicelang_count_width_for_bits(dicelang_distrib_max_bits(from) + dicelang_ceil_log2(faces)
+                                                                   + dicelang_count_bit_length(die.counts->data, die.width)), alloc);
+    dicelang_distrib_reserve(out_into, min, min + (i32) (length - 1), length, alloc);
+
+    if (out_into->counts && !out_into->values) {
+        window = alloc.malloc(alloc, out_into->width * sizeof(*window));
+    }
+
+    if (!window) {
+        dicelang_distrib_convolve(out_into, from, die, false, alloc);
+        return;
+    }
+
+    memset(window, 0, out_into->width * sizeof(*window));
+
+    for (size_t i = 0 ; i < length ; i++) {
+        if (i < from_slots) {
+            dicelang_distrib_slot_add(*out_into, window, dicelang_distrib_slot(from, i), from.width);
+        }
+        if ((i >= faces) && (i - faces < from_slots)) {
+            dicelang_distrib_slot_sub(*out_into, window, dicelang_distrib_slot(from, i - faces), from.width);
+        }
+
+        dicelang_distrib_slot_mul_add(*out_into, dicelang_distrib_slot(*out_into, (size_t) (min - out_into->offset) + i), window, out_into->width,
+                                      die.counts->data, die.width);
+    }
+
+    alloc.free(alloc, window);
+}
+
+/**
+ * @brief Checks if a distribution is dense and gives the same count to all its values, like a die.
+ *
+ * @param d
+ * @return
+ */
+static bool dicelang_distrib_is_uniform(struct dicelang_distrib d)
+{
+    size_t nb_slots = dicelang_distrib_nb_slots(d);
+
+    if (d.values || (nb_slots == 0) || dicelang_count_is_zero(d.counts->data, d.width)) {
+        return false;
+    }
+
+    for (size_t i = 1 ; i < nb_slots ; i++) {
+        if (memcmp(dicelang_distrib_slot(d, i), d.counts->data, d.width * sizeof(*d.counts->data)) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Gathers the entries of two distributions and allocates room for all of their pairs, in a single allocation.
+ *
+ * @param[in] lhs
+ * @param[in] rhs
+ * @param[out] out_batch
+ * @param[in] alloc
+ * @return false if there are too many pairs to sort at once, or if memory is missing.
+ */
+static bool dicelang_distrib_batch_create(struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct dicelang_distrib_batch *out_batch, struct allocator alloc)
+{
+    size_t lhs_slots = dicelang_distrib_nb_slots(lhs);
+    size_t rhs_slots = dicelang_distrib_nb_slots(rhs);
+    size_t cursor = 0;
+    void *memory = nullptr;
+
+    if ((lhs_slots == 0) || (rhs_slots == 0) || (lhs_slots > DICELANG_DISTRIB_BATCH_MAX_PAIRS / rhs_slots)) {
+        return false;
+    }
+
+    memory = alloc.malloc(alloc, ((lhs_slots + rhs_slots) * sizeof(*out_batch->lhs_entries)) + (2 * lhs_slots * rhs_slots * sizeof(*out_batch->pairs)));
+    if (!memory) {
+        return false;
+    }
+
+    *out_batch = (struct dicelang_distrib_batch) { };
+    out_batch->lhs_entries = memory;
+    out_batch->rhs_entries = out_batch->lhs_entries + lhs_slots;
+    out_batch->pairs = (struct dicelang_distrib_pair *) (out_batch->rhs_entries + rhs_slots);
+    out_batch->buffer = out_batch->pairs + (lhs_slots * rhs_slots);
+
+    while (dicelang_distrib_next_entry(lhs, &cursor, out_batch->lhs_entries + out_batch->nb_lhs)) {
+        out_batch->nb_lhs += 1;
+    }
+    cursor = 0;
+    while (dicelang_distrib_next_entry(rhs, &cursor, out_batch->rhs_entries + out_batch->nb_rhs)) {
+        out_batch->nb_rhs += 1;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sorts the pairs of a batch by value and adds each run of equal values to the distribution, whose values are then pushed in order.
+ * Releases the batch.
+ *
+ * @param out_into Empty sparse distribution.
+ * @param batch Batch whose pairs are filled.
+ * @param alloc
+ */
+static void dicelang_distrib_batch_reduce(struct dicelang_distrib *out_into, struct dicelang_distrib_batch batch, struct allocator alloc)
+{
+    size_t nb_pairs = batch.nb_lhs * batch.nb_rhs;
+    struct dicelang_entry *lhs_entry = nullptr;
+    struct dicelang_entry *rhs_entry = nullptr;
+    u32 *slot = nullptr;
+
+    dicelang_distrib_batch_sort(batch.pairs, batch.buffer, nb_pairs);
+
+    for (size_t i = 0 ; i < nb_pairs ; i++) {
+        if ((i == 0) || (batch.pairs[i].key != batch.pairs[i - 1].key)) {
+            slot = dicelang_distrib_slot_of(out_into, (i32) (batch.pairs[i].key ^ 0x80000000u), alloc);
+        }
+        if (slot) {
+            lhs_entry = batch.lhs_entries + batch.pairs[i].lhs_index;
+            rhs_entry = batch.rhs_entries + batch.pairs[i].rhs_index;
+            dicelang_distrib_slot_mul_add(*out_into, slot, lhs_entry->count.limbs, lhs_entry->count.width, rhs_entry->count.limbs, rhs_entry->count.width);
+        }
+    }
+
+    alloc.free(alloc, batch.lhs_entries);
+}
+
+/**
+ * @brief Sorts pairs by key with a least significant digit radix sort, one byte at a time. Bytes shared by all keys are skipped.
+ *
+ * @param[inout] pairs Sorted pairs.
+ * @param[in] buffer Scratch memory of the same length.
+ * @param[in] length
+ */
+static void dicelang_distrib_batch_sort(struct dicelang_distrib_pair *pairs, struct dicelang_distrib_pair *buffer, size_t length)
+{
+    size_t histogram[256] = { };
+    size_t position = 0;
+    size_t bucket_size = 0;
+    struct dicelang_distrib_pair *from = pairs;
+    struct dicelang_distrib_pair *to = buffer;
+    struct dicelang_distrib_pair *swap = nullptr;
+
+    for (size_t shift = 0 ; shift < 32 ; shift += 8) {
+        memset(histogram, 0, sizeof(histogram));
+        for (size_t i = 0 ; i < length ; i++) {
+            histogram[(from[i].key >> shift) & 0xffu] += 1;
+        }
+
+        if ((length == 0) || (histogram[(from[0].key >> shift) & 0xffu] == length)) {
+            continue;
+        }
+
+        position = 0;
+        for (size_t b = 0 ; b < 256 ; b++) {
+            bucket_size = histogram[b];
+            histogram[b] = position;
+            position += bucket_size;
+        }
+        for (size_t i = 0 ; i < length ; i++) {
+            to[histogram[(from[i].key >> shift) & 0xffu]++] = from[i];
+        }
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != pairs) {
+        memcpy(pairs, from, length * sizeof(*pairs));
+    }
 }
 
 /**
  * @brief
  *
  */
-static struct dicelang_entry dicelang_distrib_sub_entries(struct dicelang_entry lhs, struct dicelang_entry rhs)
+static inline i32 dicelang_distrib_add_values(i32 lhs, i32 rhs)
 {
-    return (struct dicelang_entry) { .val = lhs.val - rhs.val, .count = lhs.count * rhs.count };
+    return lhs + rhs;
 }
 
 /**
  * @brief
  *
  */
-static struct dicelang_entry dicelang_distrib_mult_entries(struct dicelang_entry lhs, struct dicelang_entry rhs)
+static inline i32 dicelang_distrib_sub_values(i32 lhs, i32 rhs)
 {
-    return (struct dicelang_entry) { .val = lhs.val * rhs.val, .count = lhs.count * rhs.count };
+    return lhs - rhs;
 }
 
 // -------------------------------------------------------------------------------------------------
@@ -500,112 +2099,761 @@ tst_CREATE_TEST_CASE(bytes_to_f32_dot, bytes_to_f32,
         .expected = 0.f
 )
 
+/**
+ * @brief Value and count pair describing a distribution in the tests.
+ */
+struct dicelang_test_entry { i32 val; u64 count; };
+
+/**
+ * @brief Builds a distribution from some test entries.
+ *
+ * @param entries
+ * @param length
+ * @param alloc
+ * @return
+ */
+static struct dicelang_distrib dicelang_distrib_from_test_entries(const struct dicelang_test_entry *entries, size_t length, struct allocator alloc)
+{
+    struct dicelang_distrib new_distrib = dicelang_distrib_create_empty(alloc);
+
+    dicelang_distrib_widen(&new_distrib, 2, alloc);
+    for (size_t i = 0 ; i < length ; i++) {
+        dicelang_distrib_push_value(&new_distrib, entries[i].val, (struct dicelang_count) { .limbs = (u32[2]) { (u32) entries[i].count, (u32) (entries[i].count >> 32) }, .width = 2 }, alloc);
+    }
+    dicelang_distrib_pack(&new_distrib, alloc);
+
+    return new_distrib;
+}
+
 tst_CREATE_TEST_SCENARIO(distr_add,
         {
-            RANGE(struct dicelang_entry, 6) lhs;
-            RANGE(struct dicelang_entry, 6) rhs;
+            RANGE(struct dicelang_test_entry, 6) lhs;
+            RANGE(struct dicelang_test_entry, 6) rhs;
 
-            RANGE(struct dicelang_entry, 36) expected;
+            RANGE(struct dicelang_test_entry, 36) expected;
         },
         {
-            struct dicelang_distrib mock_distrib_lhs = { .values = (void *) &data->lhs };
-            struct dicelang_distrib mock_distrib_rhs = { .values = (void *) &data->rhs };
+            struct dicelang_distrib mock_distrib_lhs = dicelang_distrib_from_test_entries(data->lhs.data, data->lhs.length, make_system_allocator());
+            struct dicelang_distrib mock_distrib_rhs = dicelang_distrib_from_test_entries(data->rhs.data, data->rhs.length, make_system_allocator());
 
             struct dicelang_distrib added = dicelang_distrib_add(mock_distrib_lhs, mock_distrib_rhs, make_system_allocator());
 
-            if (!added.values) {
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            size_t length = 0;
+            u64 count = 0;
+
+            if (!dicelang_distrib_is_valid(added)) {
                 tst_assert(false, "addition result has not been allocated");
+                dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+                dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
                 return;
             }
 
-            if (added.values->length != data->expected.length) {
-                tst_assert_equal(data->expected.length, added.values->length, "length of %d");
+            while (dicelang_distrib_next_entry(added, &cursor, &entry)) {
+                length += 1;
+            }
+
+            if (length != data->expected.length) {
+                tst_assert_equal(data->expected.length, length, "length of %d");
+                dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+                dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
+                dicelang_distrib_destroy(&added, make_system_allocator());
                 return;
             }
 
+            cursor = 0;
             for (size_t i = 0 ; i < data->expected.length ; i++) {
-                tst_assert(float_equal(data->expected.data[i].val, added.values->data[i].val, 1), "values mismatch : expected %f, got %f", data->expected.data[i].val, added.values->data[i].val);
-                tst_assert_equal_ext(data->expected.data[i].count, added.values->data[i].count, "count of %d", "at index %d", i);
+                dicelang_distrib_next_entry(added, &cursor, &entry);
+                dicelang_count_to_u64(entry.count, &count);
+                tst_assert(float_equal(data->expected.data[i].val, entry.val, 1), "values mismatch : expected %f, got %f", data->expected.data[i].val, entry.val);
+                tst_assert_equal_ext(data->expected.data[i].count, count, "count of %lu", "at index %d", i);
             }
 
+            dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+            dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
             dicelang_distrib_destroy(&added, make_system_allocator());
         }
 )
 
 tst_CREATE_TEST_CASE(distr_add_nominal, distr_add,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { { .val = 2, .count = 1 }, { .val = 3, .count = 2 }, { .val = 4, .count = 1 }, }),
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 2, .count = 1 }, { .val = 3, .count = 2 }, { .val = 4, .count = 1 }, }),
 )
 tst_CREATE_TEST_CASE(distr_add_empty_left, distr_add,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
 )
 tst_CREATE_TEST_CASE(distr_add_empty_right, distr_add,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { }),
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
 )
 tst_CREATE_TEST_CASE(distr_add_empty_empty, distr_add,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { }),
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { }),
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { }),
 )
 tst_CREATE_TEST_CASE(distr_add_nominal_counted, distr_add,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 2, .count = 1 }, { .val = 3, .count = 2 }, { .val = 4, .count = 1 } }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 2, .count = 1 }, { .val = 3, .count = 2 }, { .val = 4, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 3, .count = 1 }, { .val = 4, .count = 3 }, { .val = 5, .count = 3 }, { .val = 6, .count = 1 }, }),
+)
+tst_CREATE_TEST_CASE(distr_add_sparse, distr_add,
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 1000, .count = 2 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 3 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 2, .count = 1 }, { .val = 3, .count = 3 }, { .val = 1001, .count = 2 }, { .val = 1002, .count = 6 }, }),
+)
+tst_CREATE_TEST_CASE(distr_add_sparse_collisions, distr_add,
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 100, .count = 2 }, { .val = 10000, .count = 3 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 3, .count = 1 }, { .val = 300, .count = 1 }, { .val = 9903, .count = 1 }, { .val = 30000, .count = 2 } }),
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { { .val = 3, .count = 1 }, { .val = 4, .count = 3 }, { .val = 5, .count = 3 }, { .val = 6, .count = 1 }, }),
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 4, .count = 1 }, { .val = 103, .count = 2 }, { .val = 301, .count = 1 },
+                { .val = 400, .count = 2 }, { .val = 9904, .count = 1 }, { .val = 10003, .count = 5 }, { .val = 10300, .count = 3 },
+                { .val = 19903, .count = 3 }, { .val = 30001, .count = 2 }, { .val = 30100, .count = 4 }, { .val = 40000, .count = 6 }, }),
 )
 tst_CREATE_TEST_CASE(distr_add_with_zero, distr_add,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 0, .count = 1 }, }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 0, .count = 1 }, }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 }, }),
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 }, }),
 )
 
 tst_CREATE_TEST_SCENARIO(distr_sub,
         {
-            RANGE(struct dicelang_entry, 6) lhs;
-            RANGE(struct dicelang_entry, 6) rhs;
+            RANGE(struct dicelang_test_entry, 6) lhs;
+            RANGE(struct dicelang_test_entry, 6) rhs;
 
-            RANGE(struct dicelang_entry, 36) expected;
+            RANGE(struct dicelang_test_entry, 36) expected;
         },
         {
-            struct dicelang_distrib mock_distrib_lhs = { .values = (void *) &data->lhs };
-            struct dicelang_distrib mock_distrib_rhs = { .values = (void *) &data->rhs };
+            struct dicelang_distrib mock_distrib_lhs = dicelang_distrib_from_test_entries(data->lhs.data, data->lhs.length, make_system_allocator());
+            struct dicelang_distrib mock_distrib_rhs = dicelang_distrib_from_test_entries(data->rhs.data, data->rhs.length, make_system_allocator());
 
             struct dicelang_distrib diff = dicelang_distrib_substract(mock_distrib_lhs, mock_distrib_rhs, make_system_allocator());
 
-            if (!diff.values) {
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            size_t length = 0;
+            u64 count = 0;
+
+            if (!dicelang_distrib_is_valid(diff)) {
                 tst_assert(false, "addition result has not been allocated");
+                dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+                dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
                 return;
             }
 
-            if (diff.values->length != data->expected.length) {
-                tst_assert_equal(data->expected.length, diff.values->length, "length of %d");
+            while (dicelang_distrib_next_entry(diff, &cursor, &entry)) {
+                length += 1;
+            }
+
+            if (length != data->expected.length) {
+                tst_assert_equal(data->expected.length, length, "length of %d");
+                dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+                dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
+                dicelang_distrib_destroy(&diff, make_system_allocator());
                 return;
             }
 
+            cursor = 0;
             for (size_t i = 0 ; i < data->expected.length ; i++) {
-                tst_assert(float_equal(data->expected.data[i].val, diff.values->data[i].val, 1), "values mismatch : expected %f, got %f", data->expected.data[i].val, diff.values->data[i].val);
-                tst_assert_equal_ext(data->expected.data[i].count, diff.values->data[i].count, "count of %d", "at index %d", i);
+                dicelang_distrib_next_entry(diff, &cursor, &entry);
+                dicelang_count_to_u64(entry.count, &count);
+                tst_assert(float_equal(data->expected.data[i].val, entry.val, 1), "values mismatch : expected %f, got %f", data->expected.data[i].val, entry.val);
+                tst_assert_equal_ext(data->expected.data[i].count, count, "count of %lu", "at index %d", i);
             }
 
+            dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+            dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
             dicelang_distrib_destroy(&diff, make_system_allocator());
         }
 )
 
 tst_CREATE_TEST_CASE(distr_sub_nominal, distr_sub,
-        .lhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
-        .rhs = RANGE_CREATE_STATIC(struct dicelang_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = -1, .count = 1 }, { .val = 0, .count = 2 }, { .val = 1, .count = 1 }, }),
+)
+tst_CREATE_TEST_CASE(distr_sub_sparse, distr_sub,
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 1000, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 5, .count = 2 }, { .val = 2000, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = -1999, .count = 1 }, { .val = -1000, .count = 1 }, { .val = -4, .count = 2 }, { .val = 995, .count = 2 }, }),
+)
+
+tst_CREATE_TEST_SCENARIO(distr_add_into,
+        {
+            RANGE(struct dicelang_test_entry, 6) previous;
+            RANGE(struct dicelang_test_entry, 6) lhs;
+            RANGE(struct dicelang_test_entry, 6) rhs;
+
+            RANGE(struct dicelang_test_entry, 36) expected;
+        },
+        {
+            struct dicelang_distrib destination = dicelang_distrib_from_test_entries(data->previous.data, data->previous.length, make_system_allocator());
+            struct dicelang_distrib mock_distrib_lhs = dicelang_distrib_from_test_entries(data->lhs.data, data->lhs.length, make_system_allocator());
+            struct dicelang_distrib mock_distrib_rhs = dicelang_distrib_from_test_entries(data->rhs.data, data->rhs.length, make_system_allocator());
+
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            u64 count = 0;
 
-        .expected = RANGE_CREATE_STATIC(struct dicelang_entry, 36, { { .val = -1, .count = 1 }, { .val = 0, .count = 2 }, { .val = 1, .count = 1 }, }),
+            dicelang_distrib_add_into(&destination, mock_distrib_lhs, mock_distrib_rhs, make_system_allocator());
+
+            for (size_t i = 0 ; i < data->expected.length ; i++) {
+                if (!dicelang_distrib_next_entry(destination, &cursor, &entry)) {
+                    tst_assert(false, "missing value %d", data->expected.data[i].val);
+                    break;
+                }
+                dicelang_count_to_u64(entry.count, &count);
+                tst_assert_equal_ext(data->expected.data[i].val, entry.val, "value of %d", "at index %d", i);
+                tst_assert_equal_ext(data->expected.data[i].count, count, "count of %lu", "at index %d", i);
+            }
+            tst_assert(!dicelang_distrib_next_entry(destination, &cursor, &entry), "unexpected value %d", entry.val);
+
+            dicelang_distrib_destroy(&destination, make_system_allocator());
+            dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+            dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_add_into_reused, distr_add_into,
+        .previous = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = -70000, .count = 4 }, { .val = 3, .count = 9 }, { .val = 90000, .count = 1 } }),
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 2, .count = 1 }, { .val = 3, .count = 2 }, { .val = 4, .count = 1 }, }),
+)
+
+tst_CREATE_TEST_SCENARIO(distr_mult,
+        {
+            RANGE(struct dicelang_test_entry, 6) lhs;
+            RANGE(struct dicelang_test_entry, 6) rhs;
+
+            RANGE(struct dicelang_test_entry, 36) expected;
+        },
+        {
+            struct dicelang_distrib mock_distrib_lhs = dicelang_distrib_from_test_entries(data->lhs.data, data->lhs.length, make_system_allocator());
+            struct dicelang_distrib mock_distrib_rhs = dicelang_distrib_from_test_entries(data->rhs.data, data->rhs.length, make_system_allocator());
+
+            struct dicelang_distrib mult = dicelang_distrib_multiply(mock_distrib_lhs, mock_distrib_rhs, make_system_allocator());
+
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            u64 count = 0;
+
+            for (size_t i = 0 ; i < data->expected.length ; i++) {
+                if (!dicelang_distrib_next_entry(mult, &cursor, &entry)) {
+                    tst_assert(false, "missing value %d", data->expected.data[i].val);
+                    break;
+                }
+                dicelang_count_to_u64(entry.count, &count);
+                tst_assert_equal_ext(data->expected.data[i].val, entry.val, "value of %d", "at index %d", i);
+                tst_assert_equal_ext(data->expected.data[i].count, count, "count of %lu", "at index %d", i);
+            }
+            tst_assert(!dicelang_distrib_next_entry(mult, &cursor, &entry), "unexpected value %d", entry.val);
+
+            dicelang_distrib_destroy(&mock_distrib_lhs, make_system_allocator());
+            dicelang_distrib_destroy(&mock_distrib_rhs, make_system_allocator());
+            dicelang_distrib_destroy(&mult, make_system_allocator());
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_mult_nominal, distr_mult,
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 3, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 }, { .val = 3, .count = 1 }, { .val = 4, .count = 3 }, { .val = 5, .count = 3 }, { .val = 6, .count = 1 }, }),
+)
+tst_CREATE_TEST_CASE(distr_mult_powers, distr_mult,
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 5, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 0, .count = 1 }, { .val = 1, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 0, .count = 1 }, { .val = 1, .count = 5 }, { .val = 2, .count = 10 }, { .val = 3, .count = 10 }, { .val = 4, .count = 5 }, { .val = 5, .count = 1 }, }),
+)
+tst_CREATE_TEST_CASE(distr_mult_by_zero, distr_mult,
+        .lhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 0, .count = 1 } }),
+        .rhs = RANGE_CREATE_STATIC(struct dicelang_test_entry, 6, { { .val = 1, .count = 1 }, { .val = 2, .count = 1 } }),
+
+        .expected = RANGE_CREATE_STATIC(struct dicelang_test_entry, 36, { { .val = 0, .count = 1 }, }),
+)
+
+tst_CREATE_TEST_SCENARIO(distr_dice_pool,
+        {
+            const char *nb_dice;
+            const char *faces;
+
+            i32 first_value;
+            RANGE(u32, 32) expected_counts;
+        },
+        {
+            struct allocator alloc = make_system_allocator();
+            struct dicelang_distrib nb_dice = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->nb_dice, .source_length = strlen(data->nb_dice) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib faces = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->faces, .source_length = strlen(data->faces) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib die = dicelang_distrib_dice(faces, alloc);
+            struct dicelang_distrib pool = dicelang_distrib_multiply(nb_dice, die, alloc);
+
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            u64 count = 0;
+
+            for (size_t i = 0 ; i < data->expected_counts.length ; i++) {
+                if (!dicelang_distrib_next_entry(pool, &cursor, &entry)) {
+                    tst_assert(false, "missing count at index %d", i);
+                    break;
+                }
+                dicelang_count_to_u64(entry.count, &count);
+                tst_assert_equal_ext(data->first_value + (i32) i, entry.val, "value of %d", "at index %d", i);
+                tst_assert_equal_ext(data->expected_counts.data[i], count, "count of %lu", "at index %d", i);
+            }
+            tst_assert(!dicelang_distrib_next_entry(pool, &cursor, &entry), "unexpected value %d", entry.val);
+
+            dicelang_distrib_destroy(&nb_dice, alloc);
+            dicelang_distrib_destroy(&faces, alloc);
+            dicelang_distrib_destroy(&die, alloc);
+            dicelang_distrib_destroy(&pool, alloc);
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_dice_pool_3d6, distr_dice_pool,
+        .nb_dice = "3",
+        .faces = "6",
+
+        .first_value = 3,
+        .expected_counts = RANGE_CREATE_STATIC(u32, 32, { 1, 3, 6, 10, 15, 21, 25, 27, 27, 25, 21, 15, 10, 6, 3, 1 }),
+)
+tst_CREATE_TEST_CASE(distr_dice_pool_1d1, distr_dice_pool,
+        .nb_dice = "1",
+        .faces = "1",
+
+        .first_value = 1,
+        .expected_counts = RANGE_CREATE_STATIC(u32, 32, { 1 }),
+)
+
+tst_CREATE_TEST_SCENARIO(distr_large_convolution,
+        {
+            const char *lhs_faces;
+            const char *rhs_faces;
+            bool substract;
+        },
+        {
+            struct allocator alloc = make_system_allocator();
+            struct dicelang_distrib lhs_faces = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->lhs_faces, .source_length = strlen(data->lhs_faces) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib rhs_faces = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->rhs_faces, .source_length = strlen(data->rhs_faces) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib lhs_die = dicelang_distrib_dice(lhs_faces, alloc);
+            struct dicelang_distrib lhs = dicelang_distrib_dice(lhs_die, alloc);
+            struct dicelang_distrib rhs = dicelang_distrib_dice(rhs_faces, alloc);
+            struct dicelang_distrib result = data->substract ? dicelang_distrib_substract(lhs, rhs, alloc) : dicelang_distrib_add(lhs, rhs, alloc);
+
+            static u64 expected[2048] = { };
+            struct dicelang_entry lhs_entry = { };
+            struct dicelang_entry rhs_entry = { };
+            struct dicelang_entry entry = { };
+            size_t lhs_cursor = 0;
+            size_t rhs_cursor = 0;
+            size_t cursor = 0;
+            u64 lhs_count = 0;
+            u64 rhs_count = 0;
+            u64 count = 0;
+
+            memset(expected, 0, sizeof(expected));
+
+            // pairwise reference, shifted by 1024 to hold differences
+            while (dicelang_distrib_next_entry(lhs, &lhs_cursor, &lhs_entry)) {
+                dicelang_count_to_u64(lhs_entry.count, &lhs_count);
+                rhs_cursor = 0;
+                while (dicelang_distrib_next_entry(rhs, &rhs_cursor, &rhs_entry)) {
+                    dicelang_count_to_u64(rhs_entry.count, &rhs_count);
+                    expected[1024 + (data->substract ? (lhs_entry.val - rhs_entry.val) : (lhs_entry.val + rhs_entry.val))] += lhs_count * rhs_count;
+                }
+            }
+
+            while (dicelang_distrib_next_entry(result, &cursor, &entry)) {
+                dicelang_count_to_u64(entry.count, &count);
+                tst_assert_equal_ext(expected[1024 + entry.val], count, "count of %lu", "for value %d", entry.val);
+                expected[1024 + entry.val] = 0;
+            }
+            for (size_t i = 0 ; i < 2048 ; i++) {
+                tst_assert_equal_ext(0, expected[i], "count of %lu", "for missing value %d", (i32) i - 1024);
+            }
+
+            dicelang_distrib_destroy(&lhs_faces, alloc);
+            dicelang_distrib_destroy(&rhs_faces, alloc);
+            dicelang_distrib_destroy(&lhs_die, alloc);
+            dicelang_distrib_destroy(&lhs, alloc);
+            dicelang_distrib_destroy(&rhs, alloc);
+            dicelang_distrib_destroy(&result, alloc);
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_large_convolution_add, distr_large_convolution,
+        .lhs_faces = "300",
+        .rhs_faces = "200",
+        .substract = false,
+)
+tst_CREATE_TEST_CASE(distr_large_convolution_sub, distr_large_convolution,
+        .lhs_faces = "300",
+        .rhs_faces = "200",
+        .substract = true,
+)
+tst_CREATE_TEST_CASE(distr_direct_convolution_add, distr_large_convolution,
+        .lhs_faces = "90",
+        .rhs_faces = "61",
+        .substract = false,
+)
+tst_CREATE_TEST_CASE(distr_direct_convolution_sub, distr_large_convolution,
+        .lhs_faces = "90",
+        .rhs_faces = "61",
+        .substract = true,
+)
+
+tst_CREATE_TEST_SCENARIO(distr_kernel_variants,
+        {
+            size_t lhs_length;
+            size_t rhs_length;
+        },
+        {
+            u32 lhs[64] = { };
+            u32 rhs[64] = { };
+            f64 lhs_probabilities[64] = { };
+            f64 rhs_probabilities[64] = { };
+            u64 expected[128] = { };
+            u64 counts[128] = { };
+            f64 expected_probabilities[128] = { };
+            f64 probabilities[128] = { };
+            dicelang_kernel_u64_func convolve_u64 = nullptr;
+            dicelang_kernel_f64_func convolve_f64 = nullptr;
+            size_t out_length = data->lhs_length + data->rhs_length - 1;
+            u32 seed = 2024;
+
+            // full width counts, whose sums wrap around 64 bits, and some zeroes to go through the skipped rows
+            for (size_t i = 0 ; i < data->lhs_length ; i++) {
+                seed = (seed * 1664525u) + 1013904223u;
+                lhs[i] = ((i % 5) == 3) ? 0 : seed;
+                lhs_probabilities[i] = (f64) lhs[i] / 4294967296.;
+            }
+            for (size_t i = 0 ; i < data->rhs_length ; i++) {
+                seed = (seed * 1664525u) + 1013904223u;
+                rhs[i] = ((i % 7) == 2) ? 0 : seed;
+                rhs_probabilities[i] = (f64) rhs[i] / 4294967296.;
+            }
+
+            dicelang_kernel_variant(DKERNEL_scalar, &convolve_u64, &convolve_f64);
+            convolve_u64(lhs, data->lhs_length, rhs, data->rhs_length, expected);
+            convolve_f64(lhs_probabilities, data->lhs_length, rhs_probabilities, data->rhs_length, expected_probabilities);
+
+            for (enum dicelang_kernel_variant variant = DKERNEL_scalar + 1 ; variant < DKERNEL_NUMBER ; variant++) {
+                if (!dicelang_kernel_variant(variant, &convolve_u64, &convolve_f64)) {
+                    continue;
+                }
+
+                memset(counts, 0, sizeof(counts));
+                memset(probabilities, 0, sizeof(probabilities));
+                convolve_u64(lhs, data->lhs_length, rhs, data->rhs_length, counts);
+                convolve_f64(lhs_probabilities, data->lhs_length, rhs_probabilities, data->rhs_length, probabilities);
+
+                // one past the result, to catch kernels writing out of their accumulator
+                for (size_t i = 0 ; i <= out_length ; i++) {
+                    tst_assert_equal_ext(expected[i], counts[i], "count of %lu", "at index %d", i);
+                    tst_assert(expected_probabilities[i] == probabilities[i], "variant %d gives %e at index %d instead of %e",
+                            variant, probabilities[i], i, expected_probabilities[i]);
+                }
+            }
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_kernel_variants_nominal, distr_kernel_variants,
+        .lhs_length = 37,
+        .rhs_length = 11,
+)
+tst_CREATE_TEST_CASE(distr_kernel_variants_tails_only, distr_kernel_variants,
+        .lhs_length = 3,
+        .rhs_length = 1,
+)
+tst_CREATE_TEST_CASE(distr_kernel_variants_full, distr_kernel_variants,
+        .lhs_length = 64,
+        .rhs_length = 64,
+)
+
+tst_CREATE_TEST_SCENARIO(distr_wide_counts,
+        {
+            const char *nb_rolls;
+            const char *faces;
+            bool nested;
+
+            u32 first_count;
+            u32 total_count;
+        },
+        {
+            struct allocator alloc = make_system_allocator();
+            struct dicelang_distrib nb_rolls = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->nb_rolls, .source_length = strlen(data->nb_rolls) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib faces = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->faces, .source_length = strlen(data->faces) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib die = dicelang_distrib_dice(faces, alloc);
+            struct dicelang_distrib nested_die = data->nested ? dicelang_distrib_dice(die, alloc) : dicelang_distrib_copy(die, alloc);
+            struct dicelang_distrib rolls = dicelang_distrib_multiply(nb_rolls, nested_die, alloc);
+
+            static u32 expected_first[64] = { };
+            static u32 expected_total[64] = { };
+            static u32 buffer[64] = { };
+            static u32 total[64] = { };
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            u32 limbs = (u32) (sizeof(total) / sizeof(*total));
+
+            memset(expected_first, 0, sizeof(expected_first));
+            memset(expected_total, 0, sizeof(expected_total));
+            memset(total, 0, sizeof(total));
+            expected_first[0] = 1;
+            expected_total[0] = 1;
+
+            // the smallest value can only be reached one way, and all counts sum to the number of ways to roll
+            for (size_t i = 0 ; i < (size_t) dicelang_token_value(data->nb_rolls, strlen(data->nb_rolls)) ; i++) {
+                memset(buffer, 0, sizeof(buffer));
+                dicelang_count_mul_add(buffer, limbs, expected_first, limbs, &data->first_count, 1);
+                memcpy(expected_first, buffer, sizeof(buffer));
+
+                memset(buffer, 0, sizeof(buffer));
+                dicelang_count_mul_add(buffer, limbs, expected_total, limbs, &data->total_count, 1);
+                memcpy(expected_total, buffer, sizeof(buffer));
+            }
+
+            if (!dicelang_distrib_next_entry(rolls, &cursor, &entry)) {
+                tst_assert(false, "result is empty");
+            } else {
+                memset(buffer, 0, sizeof(buffer));
+                dicelang_count_copy(buffer, limbs, entry.count.limbs, entry.count.width);
+                tst_assert(memcmp(buffer, expected_first, sizeof(buffer)) == 0, "wrong count for the smallest value %d", entry.val);
+
+                cursor = 0;
+                while (dicelang_distrib_next_entry(rolls, &cursor, &entry)) {
+                    dicelang_count_add(total, limbs, entry.count.limbs, entry.count.width);
+                }
+                tst_assert(memcmp(total, expected_total, sizeof(total)) == 0, "wrong total count on %d limbs", rolls.width);
+            }
+
+            tst_assert(rolls.width == dicelang_count_width_for_bits(dicelang_distrib_max_bits(rolls)), "counts of %d limbs are not packed", rolls.width);
+
+            dicelang_distrib_destroy(&nb_rolls, alloc);
+            dicelang_distrib_destroy(&faces, alloc);
+            dicelang_distrib_destroy(&die, alloc);
+            dicelang_distrib_destroy(&nested_die, alloc);
+            dicelang_distrib_destroy(&rolls, alloc);
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_wide_counts_small, distr_wide_counts,
+        .nb_rolls = "3",
+        .faces = "6",
+        .nested = false,
+
+        .first_count = 1,
+        .total_count = 6,
+)
+tst_CREATE_TEST_CASE(distr_wide_counts_pool, distr_wide_counts,
+        .nb_rolls = "40",
+        .faces = "20",
+        .nested = false,
+
+        .first_count = 1,
+        .total_count = 20,
+)
+tst_CREATE_TEST_CASE(distr_wide_counts_nested, distr_wide_counts,
+        .nb_rolls = "40",
+        .faces = "200",
+        .nested = true,
+
+        .first_count = 200,
+        .total_count = 20100,
+)
+
+tst_CREATE_TEST_SCENARIO(distr_approx,
+        {
+            const char *nb_rolls;
+            const char *faces;
+            bool nested;
+            bool compare;
+
+            f64 tolerance;
+        },
+        {
+            struct allocator alloc = make_system_allocator();
+            struct dicelang_options options = { .approximate = true, .epsilon = DICELANG_DEFAULT_EPSILON };
+            struct dicelang_token nb_rolls_token = { .flavour = DTOK_value, .source = data->nb_rolls, .source_length = strlen(data->nb_rolls) };
+            struct dicelang_token faces_token = { .flavour = DTOK_value, .source = data->faces, .source_length = strlen(data->faces) };
+            struct dicelang_distrib nb_rolls = dicelang_distrib_create(nb_rolls_token, options, alloc);
+            struct dicelang_distrib faces = dicelang_distrib_create(faces_token, options, alloc);
+            struct dicelang_distrib die = dicelang_distrib_dice(faces, alloc);
+            struct dicelang_distrib nested_die = data->nested ? dicelang_distrib_dice(die, alloc) : dicelang_distrib_copy(die, alloc);
+            struct dicelang_distrib rolls = dicelang_distrib_multiply(nb_rolls, nested_die, alloc);
+            struct dicelang_distrib exact_nb_rolls = { };
+            struct dicelang_distrib exact_faces = { };
+            struct dicelang_distrib exact_die = { };
+            struct dicelang_distrib exact_nested_die = { };
+            struct dicelang_distrib exact_rolls = { };
+
+            struct dicelang_entry entry = { };
+            struct dicelang_entry approx_entry = { };
+            size_t cursor = 0;
+            size_t approx_cursor = 0;
+            bool approx_found = false;
+            size_t nb_values = 0;
+            f64 mass = 0.;
+            f64 exact_total = 0.;
+            f64 error = 0.;
+            i32 exponent = 0;
+            i32 min = 0;
+            i32 max = 0;
+
+            // the kept and discarded probabilities account for all rolls
+            while (dicelang_distrib_next_entry(rolls, &cursor, &entry)) {
+                mass += dicelang_count_to_f64(entry.count, 0);
+                nb_values += 1;
+            }
+            tst_assert((mass + rolls.approx.discarded > 1. - 1e-9) && (mass + rolls.approx.discarded < 1. + 1e-9),
+                       "probabilities sum to %f, with %e discarded", mass, rolls.approx.discarded);
+            tst_assert(rolls.approx.discarded < 1e-6, "%e of the mass was discarded", rolls.approx.discarded);
+
+            if (data->compare) {
+                exact_nb_rolls = dicelang_distrib_create(nb_rolls_token, (struct dicelang_options) { }, alloc);
+                exact_faces = dicelang_distrib_create(faces_token, (struct dicelang_options) { }, alloc);
+                exact_die = dicelang_distrib_dice(exact_faces, alloc);
+                exact_nested_die = data->nested ? dicelang_distrib_dice(exact_die, alloc) : dicelang_distrib_copy(exact_die, alloc);
+                exact_rolls = dicelang_distrib_multiply(exact_nb_rolls, exact_nested_die, alloc);
+
+                exponent = (exact_rolls.width > 2) ? -32 * (i32) (exact_rolls.width - 2) : 0;
+                cursor = 0;
+                while (dicelang_distrib_next_entry(exact_rolls, &cursor, &entry)) {
+                    exact_total += dicelang_count_to_f64(entry.count, exponent);
+                }
+
+                // values missing from the approximation were pruned, and were unlikely
+                cursor = 0;
+                approx_cursor = 0;
+                approx_found = dicelang_distrib_next_entry(rolls, &approx_cursor, &approx_entry);
+                while (dicelang_distrib_next_entry(exact_rolls, &cursor, &entry)) {
+                    error = dicelang_count_to_f64(entry.count, exponent) / exact_total;
+                    if (approx_found && (approx_entry.val == entry.val)) {
+                        error -= dicelang_count_to_f64(approx_entry.count, 0);
+                        approx_found = dicelang_distrib_next_entry(rolls, &approx_cursor, &approx_entry);
+                    }
+                    tst_assert((error < data->tolerance) && (error > -data->tolerance), "probability of %d is off by %e", entry.val, error);
+                }
+                tst_assert(!approx_found, "value %d is not a possible roll", approx_entry.val);
+            } else {
+                dicelang_distrib_bounds(rolls, &min, &max);
+                tst_assert((size_t) (max - min) + 1 < dicelang_token_value(data->nb_rolls, strlen(data->nb_rolls)) * dicelang_token_value(data->faces, strlen(data->faces)),
+                           "support of %lu values was not pruned", nb_values);
+            }
+
+            dicelang_distrib_destroy(&nb_rolls, alloc);
+            dicelang_distrib_destroy(&faces, alloc);
+            dicelang_distrib_destroy(&die, alloc);
+            dicelang_distrib_destroy(&nested_die, alloc);
+            dicelang_distrib_destroy(&rolls, alloc);
+            dicelang_distrib_destroy(&exact_nb_rolls, alloc);
+            dicelang_distrib_destroy(&exact_faces, alloc);
+            dicelang_distrib_destroy(&exact_die, alloc);
+            dicelang_distrib_destroy(&exact_nested_die, alloc);
+            dicelang_distrib_destroy(&exact_rolls, alloc);
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_approx_pool, distr_approx,
+        .nb_rolls = "10",
+        .faces = "6",
+        .nested = false,
+        .compare = true,
+
+        .tolerance = 1e-12,
+)
+tst_CREATE_TEST_CASE(distr_approx_nested, distr_approx,
+        .nb_rolls = "40",
+        .faces = "200",
+        .nested = true,
+        .compare = true,
+
+        .tolerance = 1e-11,
+)
+tst_CREATE_TEST_CASE(distr_approx_pruned, distr_approx,
+        .nb_rolls = "1000",
+        .faces = "20",
+        .nested = false,
+        .compare = false,
+
+        .tolerance = 0.,
+)
+
+tst_CREATE_TEST_SCENARIO(distr_share,
+        {
+            const char *nb_rolls;
+            const char *faces;
+
+            u64 total_count;
+        },
+        {
+            struct allocator alloc = make_system_allocator();
+            struct dicelang_distrib nb_rolls = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->nb_rolls, .source_length = strlen(data->nb_rolls) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib faces = dicelang_distrib_create((struct dicelang_token) { .flavour = DTOK_value, .source = data->faces, .source_length = strlen(data->faces) }, (struct dicelang_options) { }, alloc);
+            struct dicelang_distrib die = dicelang_distrib_dice(faces, alloc);
+            struct dicelang_distrib original = dicelang_distrib_multiply(nb_rolls, die, alloc);
+            struct dicelang_distrib shared = dicelang_distrib_share(&original, alloc);
+            struct dicelang_distrib other = dicelang_distrib_share(&original, alloc);
+            struct dicelang_distrib sum = dicelang_distrib_add(shared, other, alloc);
+
+            struct dicelang_entry entry = { };
+            size_t cursor = 0;
+            u64 count = 0;
+            u64 total = 0;
+
+            tst_assert((shared.counts == original.counts) && (other.counts == original.counts), "reading a shared distribution copied it");
+            tst_assert((original.references != nullptr) && (*original.references == 3), "distribution is not referenced 3 times");
+
+            // modifying one reference leaves the other ones untouched
+            dicelang_distrib_unshare(&other, alloc);
+            tst_assert(other.counts != original.counts, "unshared distribution still uses the shared storage");
+            tst_assert(*original.references == 2, "unsharing did not release a reference");
+
+            dicelang_distrib_destroy(&original, alloc);
+            tst_assert((shared.references != nullptr) && (*shared.references == 1), "destroying a reference did not release it");
+
+            while (dicelang_distrib_next_entry(shared, &cursor, &entry)) {
+                dicelang_count_to_u64(entry.count, &count);
+                total += count;
+            }
+            tst_assert(total == data->total_count, "total of %lu after the original was destroyed", total);
+
+            cursor = 0;
+            total = 0;
+            while (dicelang_distrib_next_entry(sum, &cursor, &entry)) {
+                dicelang_count_to_u64(entry.count, &count);
+                total += count;
+            }
+            tst_assert(total == data->total_count * data->total_count, "total of %lu for the sum of two references", total);
+
+            dicelang_distrib_destroy(&nb_rolls, alloc);
+            dicelang_distrib_destroy(&faces, alloc);
+            dicelang_distrib_destroy(&die, alloc);
+            dicelang_distrib_destroy(&shared, alloc);
+            dicelang_distrib_destroy(&other, alloc);
+            dicelang_distrib_destroy(&sum, alloc);
+        }
+)
+
+tst_CREATE_TEST_CASE(distr_share_pool, distr_share,
+        .nb_rolls = "3",
+        .faces = "6",
+
+        .total_count = 216,
 )
 
 void dicelang_distrib_test(void)
@@ -626,6 +2874,36 @@ void dicelang_distrib_test(void)
     tst_run_test_case(distr_add_empty_empty);
     tst_run_test_case(distr_add_nominal_counted);
     tst_run_test_case(distr_add_with_zero);
+    tst_run_test_case(distr_add_sparse);
+    tst_run_test_case(distr_add_sparse_collisions);
+
+    tst_run_test_case(distr_add_into_reused);
 
     tst_run_test_case(distr_sub_nominal);
+    tst_run_test_case(distr_sub_sparse);
+
+    tst_run_test_case(distr_mult_nominal);
+    tst_run_test_case(distr_mult_powers);
+    tst_run_test_case(distr_mult_by_zero);
+
+    tst_run_test_case(distr_dice_pool_3d6);
+    tst_run_test_case(distr_dice_pool_1d1);
+
+    tst_run_test_case(distr_large_convolution_add);
+    tst_run_test_case(distr_large_convolution_sub);
+    tst_run_test_case(distr_direct_convolution_add);
+    tst_run_test_case(distr_direct_convolution_sub);
+    tst_run_test_case(distr_kernel_variants_nominal);
+    tst_run_test_case(distr_kernel_variants_tails_only);
+    tst_run_test_case(distr_kernel_variants_full);
+
+    tst_run_test_case(distr_wide_counts_small);
+    tst_run_test_case(distr_wide_counts_pool);
+    tst_run_test_case(distr_wide_counts_nested);
+
+    tst_run_test_case(distr_approx_pool);
+    tst_run_test_case(distr_approx_nested);
+    tst_run_test_case(distr_approx_pruned);
+
+    tst_run_test_case(distr_share_pool);
 }
\ No newline at end of file
@@ -6,15 +6,38 @@
 
 #include <dicelang.h>
 
-struct dicelang_entry { i32 val; u32 count; };
-struct dicelang_distrib { RANGE(struct dicelang_entry) *values; RANGE(const char *) *formula; };
-
-struct dicelang_distrib dicelang_distrib_create(struct dicelang_token token, struct allocator alloc);
+#include "count.h"
+
+struct dicelang_entry { i32 val; struct dicelang_count count; };
+
+/**
+ * @brief State of a distribution in the approximate mode, where each slot holds the f64 probability of its value instead of a count.
+ * The weight keeps the total count the distribution would have in the exact mode (as its log2), so distributions are gathered in the
+ * same proportions. Probabilities below epsilon are dropped, and their sum is kept as the discarded mass.
+ */
+struct dicelang_distrib_approx { bool enabled; f64 epsilon; f64 log_weight; f64 discarded; };
+
+/**
+ * @brief Counts of the values of a distribution.
+ * Each count is stored on width limbs of 32 bits. The width is picked for each distribution from an upper bound of its counts, so counts never overflow.
+ * Dense distributions store their counts contiguously from their smallest value (the count of offset + i starts at counts->data[i * width]).
+ * Distributions with large gaps between their values fall back to the sparse form, where values holds the sorted values and counts their counts in the same order.
+ * values is NULL for dense distributions.
+ * The storage can be shared between distributions, references then points to the number of distributions sharing it (and is NULL while
+ * it is not shared). Shared storage is copied before being modified.
+ */
+struct dicelang_distrib { i32 offset; u32 width; RANGE(u32) *counts; RANGE(i32) *values; RANGE(const char *) *formula; struct dicelang_distrib_approx approx; u32 *references; };
+
+struct dicelang_distrib dicelang_distrib_create(struct dicelang_token token, struct dicelang_options options, struct allocator alloc);
 struct dicelang_distrib dicelang_distrib_create_empty(struct allocator alloc);
 struct dicelang_distrib dicelang_distrib_copy(struct dicelang_distrib from, struct allocator alloc);
+struct dicelang_distrib dicelang_distrib_share(struct dicelang_distrib *from, struct allocator alloc);
+void dicelang_distrib_unshare(struct dicelang_distrib *target, struct allocator alloc);
 void dicelang_distrib_destroy(struct dicelang_distrib *distrib, struct allocator alloc);
 
+bool dicelang_distrib_is_valid(struct dicelang_distrib d);
 bool dicelang_distrib_is_empty(struct dicelang_distrib d);
+bool dicelang_distrib_next_entry(struct dicelang_distrib d, size_t *cursor, struct dicelang_entry *out_entry);
 
 struct dicelang_distrib dicelang_distrib_add      (struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
 struct dicelang_distrib dicelang_distrib_substract(struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
@@ -23,6 +46,10 @@ struct dicelang_distrib dicelang_distrib_divide   (struct dicelang_distrib lhs,
 struct dicelang_distrib dicelang_distrib_union    (struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
 struct dicelang_distrib dicelang_distrib_dice     (struct dicelang_distrib from, struct allocator alloc);
 
+void dicelang_distrib_add_into      (struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
+void dicelang_distrib_substract_into(struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
+void dicelang_distrib_multiply_into (struct dicelang_distrib *out_into, struct dicelang_distrib lhs, struct dicelang_distrib rhs, struct allocator alloc);
+
 void dicelang_distrib_test(void);
 
 #endif
@@ -1,10 +1,29 @@
 
+#include <string.h>
+
 #include <ustd/sorting.h>
 
 #include "func_hashmap.h"
 
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Smallest number of buckets of a map.
+#define DICELANG_FUNCTION_MAP_MIN_BUCKETS (8u)
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static bool dicelang_function_map_find(struct dicelang_function_map map, u32 hash, const char *name, size_t len_name, size_t *out_pos);
+static void dicelang_function_map_place(struct dicelang_function_map *map, struct dicelang_function func);
+static bool dicelang_function_map_grow(struct dicelang_function_map *map, struct allocator alloc);
+static size_t dicelang_function_map_distance(struct dicelang_function_map map, size_t pos);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
 /**
- * @brief
+ * @brief Creates an empty map, with enough buckets for some number of functions.
  *
  * @param size
  * @param alloc
@@ -13,14 +32,24 @@
 struct dicelang_function_map dicelang_function_map_create(size_t size, struct allocator alloc)
 {
     struct dicelang_function_map new_map = { };
+    size_t nb_buckets = DICELANG_FUNCTION_MAP_MIN_BUCKETS;
 
     if (size == 0) {
         return (struct dicelang_function_map) { };
     }
 
-    new_map = (struct dicelang_function_map) {
-            .funcs = range_create_dynamic(alloc, sizeof(*new_map.funcs->data), size),
-    };
+    // buckets are kept at most three quarters full
+    while ((nb_buckets * 3) < (size * 4)) {
+        nb_buckets *= 2;
+    }
+
+    new_map.funcs = range_create_dynamic(alloc, sizeof(*new_map.funcs->data), nb_buckets);
+    if (!new_map.funcs) {
+        return (struct dicelang_function_map) { };
+    }
+
+    memset(new_map.funcs->data, 0, nb_buckets * sizeof(*new_map.funcs->data));
+    new_map.funcs->length = nb_buckets;
 
     return new_map;
 }
@@ -52,16 +81,13 @@ void dicelang_function_map_destroy(struct dicelang_function_map *map, struct all
  */
 bool dicelang_function_map_get(struct dicelang_function_map map, const char *name, size_t len_name, struct dicelang_function *func)
 {
-    u32 hash = 0;
     size_t pos = 0;
 
-    if (!name || (len_name == 0)) {
+    if (!name || (len_name == 0) || !map.funcs) {
         return false;
     }
 
-    hash = hash_jenkins_one_at_a_time((const byte *) name, len_name, 0);
-
-    if (sorted_range_find_in(RANGE_TO_ANY(map.funcs), &hash_compare, &hash, &pos)) {
+    if (dicelang_function_map_find(map, hash_jenkins_one_at_a_time((const byte *) name, len_name, 0), name, len_name, &pos)) {
         *func = map.funcs->data[pos];
         return true;
     }
@@ -85,18 +111,139 @@ bool dicelang_function_map_set(struct dicelang_function_map *map, const char *na
     u32 hash = 0;
     size_t pos = 0;
 
-    if (!name || (len_name == 0) || !func) {
+    if (!name || (len_name == 0) || !func || !map->funcs) {
         return false;
     }
 
     hash = hash_jenkins_one_at_a_time((const byte *) name, len_name, 0);
 
-    if (sorted_range_find_in(RANGE_TO_ANY(map->funcs), &hash_compare, &hash, &pos)) {
+    if (dicelang_function_map_find(*map, hash, name, len_name, &pos)) {
+        return false;
+    }
+
+    if (((map->count + 1) * 4 > map->funcs->length * 3) && !dicelang_function_map_grow(map, alloc)) {
+        return false;
+    }
+
+    dicelang_function_map_place(map, (struct dicelang_function) {
+            .hash = hash,
+            .name = name,
+            .len_name = len_name,
+            .func_impl = func,
+            .nb_args = nb_args,
+            .returns_value = returns_something
+    });
+    map->count += 1;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Probes the buckets of a function, comparing whole names so names with the same hash are told apart.
+ * The probe stops early on an entry closer to its own bucket than the searched one would be, as it would have been displaced.
+ *
+ * @param map
+ * @param hash
+ * @param name
+ * @param len_name
+ * @param[out] out_pos Position of the function.
+ * @return true if the function was found.
+ */
+static bool dicelang_function_map_find(struct dicelang_function_map map, u32 hash, const char *name, size_t len_name, size_t *out_pos)
+{
+    size_t mask = map.funcs->length - 1;
+    size_t pos = hash & mask;
+    const struct dicelang_function *func = nullptr;
+
+    for (size_t distance = 0 ; distance < map.funcs->length ; distance++) {
+        func = map.funcs->data + pos;
+
+        if (!func->name || (dicelang_function_map_distance(map, pos) < distance)) {
+            return false;
+        }
+
+        if ((func->hash == hash) && (func->len_name == len_name) && (memcmp(func->name, name, len_name) == 0)) {
+            *out_pos = pos;
+            return true;
+        }
+
+        pos = (pos + 1) & mask;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Inserts a function that is not in the map yet. Entries further from their bucket take the place of closer ones,
+ * which move on, so probe lengths stay even.
+ *
+ * @param map
+ * @param func
+ */
+static void dicelang_function_map_place(struct dicelang_function_map *map, struct dicelang_function func)
+{
+    size_t mask = map->funcs->length - 1;
+    size_t pos = func.hash & mask;
+    size_t distance = 0;
+    size_t existing_distance = 0;
+    struct dicelang_function displaced = { };
+
+    while (map->funcs->data[pos].name) {
+        existing_distance = dicelang_function_map_distance(*map, pos);
+
+        if (existing_distance < distance) {
+            displaced = map->funcs->data[pos];
+            map->funcs->data[pos] = func;
+            func = displaced;
+            distance = existing_distance;
+        }
+
+        pos = (pos + 1) & mask;
+        distance += 1;
+    }
+
+    map->funcs->data[pos] = func;
+}
+
+/**
+ * @brief Doubles the number of buckets of a map, placing all its functions again.
+ *
+ * @param map
+ * @param alloc
+ * @return false if the new buckets could not be allocated.
+ */
+static bool dicelang_function_map_grow(struct dicelang_function_map *map, struct allocator alloc)
+{
+    struct dicelang_function_map grown = dicelang_function_map_create(map->funcs->length, alloc);
+
+    if (!grown.funcs) {
         return false;
     }
 
-    range_ensure_capacity(alloc, RANGE_TO_ANY(map->funcs), 1);
-    range_insert_value(RANGE_TO_ANY(map->funcs), pos, &(struct dicelang_function) { .hash = hash, .func_impl = func, .nb_args = nb_args, .returns_value = returns_something });
+    for (size_t i = 0 ; i < map->funcs->length ; i++) {
+        if (map->funcs->data[i].name) {
+            dicelang_function_map_place(&grown, map->funcs->data[i]);
+        }
+    }
+
+    grown.count = map->count;
+    dicelang_function_map_destroy(map, alloc);
+    *map = grown;
 
     return true;
 }
+
+/**
+ * @brief Distance of the entry in some bucket from the bucket its hash points to.
+ *
+ * @param map
+ * @param pos
+ * @return size_t
+ */
+static size_t dicelang_function_map_distance(struct dicelang_function_map map, size_t pos)
+{
+    return (pos - (map.funcs->data[pos].hash & (map.funcs->length - 1))) & (map.funcs->length - 1);
+}
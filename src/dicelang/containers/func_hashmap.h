@@ -9,14 +9,14 @@
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-typedef void (*dicelang_script_func)(struct dicelang_distrib *input, struct dicelang_distrib *output, struct allocator alloc);
-
 /**
- * @brief
- *
+ * @brief Builtin function, and how it is called.
+ * The name is not copied and should outlive the map. Empty buckets of the map have no name.
  */
 struct dicelang_function {
     u32 hash;
+    const char *name;
+    size_t len_name;
 
     bool returns_value;
     size_t nb_args;
@@ -24,11 +24,13 @@ struct dicelang_function {
 };
 
 /**
- * @brief
+ * @brief Open addressing hash table of the builtin functions, with Robin Hood probing : all buckets are in the range,
+ * whose length is a power of two.
  *
  */
 struct dicelang_function_map {
     RANGE(struct dicelang_function) *funcs;
+    size_t count;
 };
 
 // -------------------------------------------------------------------------------------------------
@@ -0,0 +1,314 @@
+
+#include <threads.h>
+
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DICELANG_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Kernels picked for the running processor.
+ */
+struct dicelang_kernels {
+    dicelang_kernel_u64_func convolve_u64;
+    dicelang_kernel_f64_func convolve_f64;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static void dicelang_kernels_select(void);
+
+static void dicelang_kernel_convolve_u64_scalar(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out);
+static void dicelang_kernel_convolve_f64_scalar(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out);
+
+#ifdef DICELANG_KERNEL_X86
+static void dicelang_kernel_convolve_u64_sse4(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out);
+static void dicelang_kernel_convolve_f64_sse4(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out);
+static void dicelang_kernel_convolve_u64_avx2(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out);
+static void dicelang_kernel_convolve_f64_avx2(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out);
+#endif
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Kernels in use, picked on the first convolution.
+static struct dicelang_kernels dicelang_kernels_in_use = { };
+/// Guards the pick of the kernels, so contexts on different threads can do their first convolution at the same time.
+static once_flag dicelang_kernels_selected = ONCE_FLAG_INIT;
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Convolves two arrays of 32 bits counts, pair by pair : out[i + j] += lhs[i] * rhs[j].
+ * The sums wrap around 64 bits, so the result is exact as long as it fits on 64 bits.
+ *
+ * @param[in] lhs
+ * @param[in] lhs_length
+ * @param[in] rhs
+ * @param[in] rhs_length
+ * @param[inout] out Accumulator of lhs_length + rhs_length - 1 counts.
+ */
+void dicelang_kernel_convolve_u64(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out)
+{
+    call_once(&dicelang_kernels_selected, &dicelang_kernels_select);
+
+    dicelang_kernels_in_use.convolve_u64(lhs, lhs_length, rhs, rhs_length, out);
+}
+
+/**
+ * @brief Convolves two arrays of probabilities, pair by pair : out[i + j] += lhs[i] * rhs[j].
+ * All kernels multiply then add, so they round the same way whatever the processor.
+ *
+ * @param[in] lhs
+ * @param[in] lhs_length
+ * @param[in] rhs
+ * @param[in] rhs_length
+ * @param[inout] out Accumulator of lhs_length + rhs_length - 1 probabilities.
+ */
+void dicelang_kernel_convolve_f64(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out)
+{
+    call_once(&dicelang_kernels_selected, &dicelang_kernels_select);
+
+    dicelang_kernels_in_use.convolve_f64(lhs, lhs_length, rhs, rhs_length, out);
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Gives a kernel variant, so the tests can check it whatever the processor would pick.
+ *
+ * @param[in] variant
+ * @param[out] out_u64
+ * @param[out] out_f64
+ * @return false if the variant is not built for, or not supported by, the processor.
+ */
+bool dicelang_kernel_variant(enum dicelang_kernel_variant variant, dicelang_kernel_u64_func *out_u64, dicelang_kernel_f64_func *out_f64)
+{
+    switch (variant) {
+        case DKERNEL_scalar:
+            *out_u64 = &dicelang_kernel_convolve_u64_scalar;
+            *out_f64 = &dicelang_kernel_convolve_f64_scalar;
+            return true;
+#ifdef DICELANG_KERNEL_X86
+        case DKERNEL_sse4:
+            *out_u64 = &dicelang_kernel_convolve_u64_sse4;
+            *out_f64 = &dicelang_kernel_convolve_f64_sse4;
+            return __builtin_cpu_supports("sse4.1");
+        case DKERNEL_avx2:
+            *out_u64 = &dicelang_kernel_convolve_u64_avx2;
+            *out_f64 = &dicelang_kernel_convolve_f64_avx2;
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Picks the widest kernels the processor supports. Only ever called once.
+ *
+ */
+static void dicelang_kernels_select(void)
+{
+#ifdef DICELANG_KERNEL_X86
+    if (__builtin_cpu_supports("avx2")) {
+        dicelang_kernels_in_use = (struct dicelang_kernels) { .convolve_u64 = &dicelang_kernel_convolve_u64_avx2, .convolve_f64 = &dicelang_kernel_convolve_f64_avx2 };
+        return;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        dicelang_kernels_in_use = (struct dicelang_kernels) { .convolve_u64 = &dicelang_kernel_convolve_u64_sse4, .convolve_f64 = &dicelang_kernel_convolve_f64_sse4 };
+        return;
+    }
+#endif
+
+    dicelang_kernels_in_use = (struct dicelang_kernels) { .convolve_u64 = &dicelang_kernel_convolve_u64_scalar, .convolve_f64 = &dicelang_kernel_convolve_f64_scalar };
+}
+
+/**
+ * @brief Portable kernel for exact counts.
+ *
+ * @param lhs
+ * @param lhs_length
+ * @param rhs
+ * @param rhs_length
+ * @param out
+ */
+static void dicelang_kernel_convolve_u64_scalar(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out)
+{
+    for (size_t i = 0 ; i < lhs_length ; i++) {
+        for (size_t j = 0 ; (lhs[i] != 0) && (j < rhs_length) ; j++) {
+            out[i + j] += (u64) lhs[i] * rhs[j];
+        }
+    }
+}
+
+/**
+ * @brief Portable kernel for probabilities.
+ *
+ * @param lhs
+ * @param lhs_length
+ * @param rhs
+ * @param rhs_length
+ * @param out
+ */
+static void dicelang_kernel_convolve_f64_scalar(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out)
+{
+    for (size_t i = 0 ; i < lhs_length ; i++) {
+        for (size_t j = 0 ; (lhs[i] != 0.) && (j < rhs_length) ; j++) {
+            out[i + j] += lhs[i] * rhs[j];
+        }
+    }
+}
+
+#ifdef DICELANG_KERNEL_X86
+
+/**
+ * @brief SSE4.1 kernel for exact counts, two counts at a time.
+ *
+ * @param lhs
+ * @param lhs_length
+ * @param rhs
+ * @param rhs_length
+ * @param out
+ */
+__attribute__((target("sse4.1")))
+static void dicelang_kernel_convolve_u64_sse4(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out)
+{
+    __m128i factor = { };
+    __m128i values = { };
+    __m128i sums = { };
+    size_t j = 0;
+
+    for (size_t i = 0 ; i < lhs_length ; i++) {
+        if (lhs[i] == 0) {
+            continue;
+        }
+
+        // the products are taken on the lower 32 bits of each 64 bits lane
+        factor = _mm_set1_epi64x(lhs[i]);
+        for (j = 0 ; j + 2 <= rhs_length ; j += 2) {
+            values = _mm_cvtepu32_epi64(_mm_loadl_epi64((const __m128i *) (rhs + j)));
+            sums = _mm_loadu_si128((const __m128i *) (out + i + j));
+            sums = _mm_add_epi64(sums, _mm_mul_epu32(factor, values));
+            _mm_storeu_si128((__m128i *) (out + i + j), sums);
+        }
+        for ( ; j < rhs_length ; j++) {
+            out[i + j] += (u64) lhs[i] * rhs[j];
+        }
+    }
+}
+
+/**
+ * @brief SSE4.1 kernel for probabilities, two probabilities at a time.
+ *
+ * @param lhs
+ * @param lhs_length
+ * @param rhs
+ * @param rhs_length
+ * @param out
+ */
+__attribute__((target("sse4.1")))
+static void dicelang_kernel_convolve_f64_sse4(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out)
+{
+    __m128d factor = { };
+    __m128d sums = { };
+    size_t j = 0;
+
+    for (size_t i = 0 ; i < lhs_length ; i++) {
+        if (lhs[i] == 0.) {
+            continue;
+        }
+
+        factor = _mm_set1_pd(lhs[i]);
+        for (j = 0 ; j + 2 <= rhs_length ; j += 2) {
+            sums = _mm_loadu_pd(out + i + j);
+            sums = _mm_add_pd(sums, _mm_mul_pd(factor, _mm_loadu_pd(rhs + j)));
+            _mm_storeu_pd(out + i + j, sums);
+        }
+        for ( ; j < rhs_length ; j++) {
+            out[i + j] += lhs[i] * rhs[j];
+        }
+    }
+}
+
+/**
+ * @brief AVX2 kernel for exact counts, four counts at a time.
+ *
+ * @param lhs
+ * @param lhs_length
+ * @param rhs
+ * @param rhs_length
+ * @param out
+ */
+__attribute__((target("avx2")))
+static void dicelang_kernel_convolve_u64_avx2(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out)
+{
+    __m256i factor = { };
+    __m256i values = { };
+    __m256i sums = { };
+    size_t j = 0;
+
+    for (size_t i = 0 ; i < lhs_length ; i++) {
+        if (lhs[i] == 0) {
+            continue;
+        }
+
+        // the products are taken on the lower 32 bits of each 64 bits lane
+        factor = _mm256_set1_epi64x(lhs[i]);
+        for (j = 0 ; j + 4 <= rhs_length ; j += 4) {
+            values = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *) (rhs + j)));
+            sums = _mm256_loadu_si256((const __m256i *) (out + i + j));
+            sums = _mm256_add_epi64(sums, _mm256_mul_epu32(factor, values));
+            _mm256_storeu_si256((__m256i *) (out + i + j), sums);
+        }
+        for ( ; j < rhs_length ; j++) {
+            out[i + j] += (u64) lhs[i] * rhs[j];
+        }
+    }
+}
+
+/**
+ * @brief AVX2 kernel for probabilities, four probabilities at a time.
+ *
+ * @param lhs
+ * @param lhs_length
+ * @param rhs
+ * @param rhs_length
+ * @param out
+ */
+__attribute__((target("avx2")))
+static void dicelang_kernel_convolve_f64_avx2(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out)
+{
+    __m256d factor = { };
+    __m256d sums = { };
+    size_t j = 0;
+
+    for (size_t i = 0 ; i < lhs_length ; i++) {
+        if (lhs[i] == 0.) {
+            continue;
+        }
+
+        factor = _mm256_set1_pd(lhs[i]);
+        for (j = 0 ; j + 4 <= rhs_length ; j += 4) {
+            sums = _mm256_loadu_pd(out + i + j);
+            sums = _mm256_add_pd(sums, _mm256_mul_pd(factor, _mm256_loadu_pd(rhs + j)));
+            _mm256_storeu_pd(out + i + j, sums);
+        }
+        for ( ; j < rhs_length ; j++) {
+            out[i + j] += lhs[i] * rhs[j];
+        }
+    }
+}
+
+#endif
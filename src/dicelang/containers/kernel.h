@@ -0,0 +1,37 @@
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include <ustd/range.h>
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Direct convolution of exact counts of 32 bits, accumulated on 64 bits.
+ */
+typedef void (*dicelang_kernel_u64_func)(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out);
+
+/**
+ * @brief Direct convolution of probabilities.
+ */
+typedef void (*dicelang_kernel_f64_func)(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+void dicelang_kernel_convolve_u64(const u32 *lhs, size_t lhs_length, const u32 *rhs, size_t rhs_length, u64 *out);
+void dicelang_kernel_convolve_f64(const f64 *lhs, size_t lhs_length, const f64 *rhs, size_t rhs_length, f64 *out);
+
+/**
+ * @brief Kernels built in the library, from the portable one to the widest.
+ */
+enum dicelang_kernel_variant {
+    DKERNEL_scalar,
+    DKERNEL_sse4,
+    DKERNEL_avx2,
+    DKERNEL_NUMBER,
+};
+
+bool dicelang_kernel_variant(enum dicelang_kernel_variant variant, dicelang_kernel_u64_func *out_u64, dicelang_kernel_f64_func *out_f64);
+
+#endif
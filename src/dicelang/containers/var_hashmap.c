@@ -1,10 +1,29 @@
 
+#include <string.h>
+
 #include <ustd/sorting.h>
 
 #include "var_hashmap.h"
 
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Smallest number of buckets of a map.
+#define DICELANG_VARIABLE_MAP_MIN_BUCKETS (8u)
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static bool dicelang_variable_map_find(struct dicelang_variable_map map, u32 hash, const char *name, size_t len_name, size_t *out_pos);
+static void dicelang_variable_map_place(struct dicelang_variable_map *map, struct dicelang_variable var);
+static bool dicelang_variable_map_grow(struct dicelang_variable_map *map, struct allocator alloc);
+static size_t dicelang_variable_map_distance(struct dicelang_variable_map map, size_t pos);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
 /**
- * @brief
+ * @brief Creates an empty map, with enough buckets for some number of variables.
  *
  * @param size
  * @param alloc
@@ -13,20 +32,30 @@
 struct dicelang_variable_map dicelang_variable_map_create(size_t size, struct allocator alloc)
 {
     struct dicelang_variable_map new_map = { };
+    size_t nb_buckets = DICELANG_VARIABLE_MAP_MIN_BUCKETS;
 
     if (size == 0) {
         return (struct dicelang_variable_map) { };
     }
 
-    new_map = (struct dicelang_variable_map) {
-            .vars = range_create_dynamic(alloc, sizeof(*new_map.vars->data), size),
-    };
+    // buckets are kept at most three quarters full
+    while ((nb_buckets * 3) < (size * 4)) {
+        nb_buckets *= 2;
+    }
+
+    new_map.vars = range_create_dynamic(alloc, sizeof(*new_map.vars->data), nb_buckets);
+    if (!new_map.vars) {
+        return (struct dicelang_variable_map) { };
+    }
+
+    memset(new_map.vars->data, 0, nb_buckets * sizeof(*new_map.vars->data));
+    new_map.vars->length = nb_buckets;
 
     return new_map;
 }
 
 /**
- * @brief
+ * @brief Releases a map and the names it holds.
  *
  * @param map
  * @param alloc
@@ -37,8 +66,10 @@ void dicelang_variable_map_destroy(struct dicelang_variable_map *map, struct all
         return;
     }
 
-    for (size_t i = 0 ; i < map->vars->length ; i++) {
-        dicelang_distrib_destroy(&map->vars->data[i].val, alloc);
+    for (size_t i = 0 ; map->vars && (i < map->vars->length) ; i++) {
+        if (map->vars->data[i].name) {
+            alloc.free(alloc, (char *) map->vars->data[i].name);
+        }
     }
 
     range_destroy_dynamic(alloc, &RANGE_TO_ANY(map->vars));
@@ -46,27 +77,46 @@ void dicelang_variable_map_destroy(struct dicelang_variable_map *map, struct all
 }
 
 /**
- * @brief
+ * @brief Releases the names a map holds, keeping its buckets for the next variables.
+ *
+ * @param map
+ * @param alloc
+ */
+void dicelang_variable_map_clear(struct dicelang_variable_map *map, struct allocator alloc)
+{
+    if (!map || !map->vars) {
+        return;
+    }
+
+    for (size_t i = 0 ; i < map->vars->length ; i++) {
+        if (map->vars->data[i].name) {
+            alloc.free(alloc, (char *) map->vars->data[i].name);
+        }
+    }
+
+    memset(map->vars->data, 0, map->vars->length * sizeof(*map->vars->data));
+    map->count = 0;
+}
+
+/**
+ * @brief Finds the slot of a variable.
  *
  * @param map
  * @param name
  * @param len_name
- * @return struct dicelang_distrib
+ * @param[out] out_slot
+ * @return true if the variable is known.
  */
-
-bool dicelang_variable_map_get(struct dicelang_variable_map map, const char *name, size_t len_name, struct dicelang_distrib *out_val, struct allocator alloc)
+bool dicelang_variable_map_get(struct dicelang_variable_map map, const char *name, size_t len_name, u32 *out_slot)
 {
-    u32 hash = 0;
     size_t pos = 0;
 
-    if (!name || (len_name == 0)) {
+    if (!name || (len_name == 0) || !map.vars) {
         return false;
     }
 
-    hash = hash_jenkins_one_at_a_time((const byte *) name, len_name, 0);
-
-    if (sorted_range_find_in(RANGE_TO_ANY(map.vars), &hash_compare, &hash, &pos)) {
-        *out_val = dicelang_distrib_copy(map.vars->data[pos].val, alloc);
+    if (dicelang_variable_map_find(map, hash_jenkins_one_at_a_time((const byte *) name, len_name, 0), name, len_name, &pos)) {
+        *out_slot = map.vars->data[pos].slot;
         return true;
     }
 
@@ -74,34 +124,155 @@ bool dicelang_variable_map_get(struct dicelang_variable_map map, const char *nam
 }
 
 /**
- * @brief
+ * @brief Gives a slot to a variable, replacing the previous one if the variable is known. Names seen for the first time are copied.
  *
  * @param map
  * @param name
  * @param len_name
- * @param new_val
+ * @param slot
+ * @param alloc
+ * @return
  */
-bool dicelang_variable_map_set(struct dicelang_variable_map *map, const char *name, size_t len_name, struct dicelang_distrib *new_val, struct allocator alloc)
+bool dicelang_variable_map_set(struct dicelang_variable_map *map, const char *name, size_t len_name, u32 slot, struct allocator alloc)
 {
     u32 hash = 0;
     size_t pos = 0;
+    char *name_copy = nullptr;
 
-    if (!name || (len_name == 0)) {
+    if (!name || (len_name == 0) || !map->vars) {
         return false;
     }
 
     hash = hash_jenkins_one_at_a_time((const byte *) name, len_name, 0);
 
-    if (sorted_range_find_in(RANGE_TO_ANY(map->vars), &hash_compare, &hash, &pos)) {
-        dicelang_distrib_destroy(&map->vars->data[pos].val, alloc);
-        goto lbl_dicelang_variable_map_set_assume_ownership;
+    if (dicelang_variable_map_find(*map, hash, name, len_name, &pos)) {
+        map->vars->data[pos].slot = slot;
+        return true;
+    }
+
+    if (((map->count + 1) * 4 > map->vars->length * 3) && !dicelang_variable_map_grow(map, alloc)) {
+        return false;
+    }
+
+    name_copy = alloc.malloc(alloc, len_name);
+    if (!name_copy) {
+        return false;
+    }
+    memcpy(name_copy, name, len_name);
+
+    dicelang_variable_map_place(map, (struct dicelang_variable) { .hash = hash, .name = name_copy, .len_name = len_name, .slot = slot });
+    map->count += 1;
+
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Probes the buckets of a variable, comparing whole names so names with the same hash are told apart.
+ * The probe stops early on an entry closer to its own bucket than the searched one would be, as it would have been displaced.
+ *
+ * @param map
+ * @param hash
+ * @param name
+ * @param len_name
+ * @param[out] out_pos Position of the variable.
+ * @return true if the variable was found.
+ */
+static bool dicelang_variable_map_find(struct dicelang_variable_map map, u32 hash, const char *name, size_t len_name, size_t *out_pos)
+{
+    size_t mask = map.vars->length - 1;
+    size_t pos = hash & mask;
+    const struct dicelang_variable *var = nullptr;
+
+    for (size_t distance = 0 ; distance < map.vars->length ; distance++) {
+        var = map.vars->data + pos;
+
+        if (!var->name || (dicelang_variable_map_distance(map, pos) < distance)) {
+            return false;
+        }
+
+        if ((var->hash == hash) && (var->len_name == len_name) && (memcmp(var->name, name, len_name) == 0)) {
+            *out_pos = pos;
+            return true;
+        }
+
+        pos = (pos + 1) & mask;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Inserts a variable that is not in the map yet. Entries further from their bucket take the place of closer ones,
+ * which move on, so probe lengths stay even.
+ *
+ * @param map
+ * @param var
+ */
+static void dicelang_variable_map_place(struct dicelang_variable_map *map, struct dicelang_variable var)
+{
+    size_t mask = map->vars->length - 1;
+    size_t pos = var.hash & mask;
+    size_t distance = 0;
+    size_t existing_distance = 0;
+    struct dicelang_variable displaced = { };
+
+    while (map->vars->data[pos].name) {
+        existing_distance = dicelang_variable_map_distance(*map, pos);
+
+        if (existing_distance < distance) {
+            displaced = map->vars->data[pos];
+            map->vars->data[pos] = var;
+            var = displaced;
+            distance = existing_distance;
+        }
+
+        pos = (pos + 1) & mask;
+        distance += 1;
     }
 
-    range_ensure_capacity(alloc, RANGE_TO_ANY(map->vars), 1);
-    range_insert_value(RANGE_TO_ANY(map->vars), pos, &(struct dicelang_variable) { .hash = hash, .val = { } });
+    map->vars->data[pos] = var;
+}
+
+/**
+ * @brief Doubles the number of buckets of a map, placing all its variables again.
+ *
+ * @param map
+ * @param alloc
+ * @return false if the new buckets could not be allocated.
+ */
+static bool dicelang_variable_map_grow(struct dicelang_variable_map *map, struct allocator alloc)
+{
+    struct dicelang_variable_map grown = dicelang_variable_map_create(map->vars->length, alloc);
+
+    if (!grown.vars) {
+        return false;
+    }
+
+    for (size_t i = 0 ; i < map->vars->length ; i++) {
+        if (map->vars->data[i].name) {
+            dicelang_variable_map_place(&grown, map->vars->data[i]);
+        }
+    }
+
+    // the names moved to the new buckets
+    grown.count = map->count;
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(map->vars));
+    *map = grown;
 
-lbl_dicelang_variable_map_set_assume_ownership:
-    map->vars->data[pos].val = *new_val;
-    *new_val = (struct dicelang_distrib) { };
     return true;
 }
+
+/**
+ * @brief Distance of the entry in some bucket from the bucket its hash points to.
+ *
+ * @param map
+ * @param pos
+ * @return size_t
+ */
+static size_t dicelang_variable_map_distance(struct dicelang_variable_map map, size_t pos)
+{
+    return (pos - (map.vars->data[pos].hash & (map.vars->length - 1))) & (map.vars->length - 1);
+}
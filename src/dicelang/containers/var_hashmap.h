@@ -1,29 +1,31 @@
-
 #ifndef __VAR_HASHMAP_H__
 #define __VAR_HASHMAP_H__
 
 #include <ustd/range.h>
 
-#include "distribution.h"
-
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief
- *
+ * @brief Name of a variable, and the slot its value is stored in.
+ * The name is a copy owned by the map, so the map can outlive the source code it was read from. Empty buckets of the map have no name.
  */
 struct dicelang_variable {
     u32 hash;
-    struct dicelang_distrib val;
+    const char *name;
+    size_t len_name;
+
+    u32 slot;
 };
 
 /**
- * @brief
+ * @brief Interning table of the variables names. Open addressing hash table with Robin Hood probing : all buckets are in the range,
+ * whose length is a power of two.
  *
  */
 struct dicelang_variable_map {
     RANGE(struct dicelang_variable) *vars;
+    size_t count;
 };
 
 // -------------------------------------------------------------------------------------------------
@@ -31,8 +33,9 @@ struct dicelang_variable_map {
 
 struct dicelang_variable_map dicelang_variable_map_create(size_t size, struct allocator alloc);
 void dicelang_variable_map_destroy(struct dicelang_variable_map *map, struct allocator alloc);
+void dicelang_variable_map_clear(struct dicelang_variable_map *map, struct allocator alloc);
 
-bool dicelang_variable_map_get(struct dicelang_variable_map map, const char *name, size_t len_name, struct dicelang_distrib *out_val, struct allocator alloc);
-bool dicelang_variable_map_set(struct dicelang_variable_map *map, const char *name, size_t len_name, struct dicelang_distrib *new_val, struct allocator alloc);
+bool dicelang_variable_map_get(struct dicelang_variable_map map, const char *name, size_t len_name, u32 *out_slot);
+bool dicelang_variable_map_set(struct dicelang_variable_map *map, const char *name, size_t len_name, u32 slot, struct allocator alloc);
 
-#endif
\ No newline at end of file
+#endif
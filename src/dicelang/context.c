@@ -0,0 +1,225 @@
+/**
+ * @file context.c
+ * @author gabriel
+ * @brief Embedding interface. A context evaluates sources one after the other, keeping the variables they set, so a host program
+ * can run many small formulas without reading a script file for each of them.
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <string.h>
+
+#include <dicelang.h>
+
+#include "containers/distribution.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief State of a context : the compiler knowing the variable names, and the interpreter holding their values.
+ * Both are kept from one evaluated source to the next.
+ */
+struct dicelang_context {
+    struct allocator alloc;
+    struct dicelang_options options;
+
+    struct dicelang_compiler *compiler;
+    struct dicelang_interpreter *interpreter;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Creates a context with no variable set.
+ * Sources evaluated by the context are all computed with the same options : their "#pragma" lines are not read.
+ *
+ * @param[in] options Numeric mode of the computed distributions.
+ * @param[in] alloc Allocator used for the context, and everything it computes.
+ * @return struct dicelang_context *
+ */
+struct dicelang_context *dicelang_context_create(struct dicelang_options options, struct allocator alloc)
+{
+    struct dicelang_context *context = alloc.malloc(alloc, sizeof(*context));
+
+    if (!context) {
+        return nullptr;
+    }
+
+    *context = (struct dicelang_context) {
+            .alloc = alloc,
+            .options = options,
+
+            .compiler = dicelang_compiler_create(alloc),
+            .interpreter = dicelang_interpreter_create(options, alloc),
+    };
+
+    if (!context->compiler || !context->interpreter) {
+        dicelang_context_destroy(&context);
+        return nullptr;
+    }
+
+    return context;
+}
+
+/**
+ * @brief Releases a context, and the values of its variables.
+ *
+ * @param[inout] context
+ */
+void dicelang_context_destroy(struct dicelang_context **context)
+{
+    struct allocator alloc = { };
+
+    if (!context || !*context) {
+        return;
+    }
+
+    alloc = (*context)->alloc;
+
+    dicelang_compiler_destroy(&(*context)->compiler);
+    dicelang_interpreter_destroy(&(*context)->interpreter);
+
+    alloc.free(alloc, *context);
+    *context = nullptr;
+}
+
+/**
+ * @brief Forgets all the variables of a context, as if it was just created. The builtin functions stay registered and the working
+ * memory of the interpreter is kept, so a context can be reused for many unrelated sources at little cost.
+ * Views on the variables of the context are invalidated.
+ *
+ * @param[inout] context
+ */
+void dicelang_context_reset(struct dicelang_context *context)
+{
+    if (!context) {
+        return;
+    }
+
+    dicelang_compiler_forget(context->compiler);
+    dicelang_interpreter_forget(context->interpreter);
+}
+
+/**
+ * @brief Sets the stream the builtins of the next evaluated sources write to, and how print writes distributions.
+ *
+ * @param[inout] context
+ * @param[in] output Target stream, or NULL for the standard output.
+ * @param[in] format
+ */
+void dicelang_context_redirect(struct dicelang_context *context, FILE *output, enum dicelang_print_format format)
+{
+    if (!context) {
+        return;
+    }
+
+    context->options.output = output;
+    context->options.format = format;
+    dicelang_interpreter_redirect(context->interpreter, output, format);
+}
+
+/**
+ * @brief Evaluates some source code, which can use the variables set by the sources the context evaluated before.
+ * Nothing is run if the source has a syntax error. Statements interpreted before a failing one keep their effects.
+ * Views on the variables of the context are invalidated.
+ *
+ * @param[inout] context
+ * @param[in] source_code Null-terminated text of the source. Tokens of the reported error point into it.
+ * @param[inout] error_sink Error reporting structure.
+ */
+void dicelang_context_evaluate(struct dicelang_context *context, const char *source_code, struct dicelang_error *error_sink)
+{
+    RANGE_TOKEN *tokens = nullptr;
+    RANGE_PARSE_NODE *tree = nullptr;
+    RANGE_INSTRUCTION *code = nullptr;
+
+    if (!context || !context->compiler || !context->interpreter) {
+        error_sink->flavour = DERR_INTERNAL;
+        error_sink->what = "context could not allocate its working memory.";
+        return;
+    }
+
+    tokens = dicelang_tokenize(source_code, error_sink, context->alloc);
+
+    if (error_sink->flavour == DERR_NONE) {
+        tree = dicelang_parse(tokens, error_sink, context->alloc);
+    }
+
+    if (error_sink->flavour == DERR_NONE) {
+        code = dicelang_compiler_compile(context->compiler, tree, error_sink);
+        dicelang_interpreter_run(context->interpreter, code, error_sink);
+    }
+
+    range_destroy_dynamic(context->alloc, &RANGE_TO_ANY(code));
+    dicelang_parse_node_destroy(&tree, context->alloc);
+    range_destroy_dynamic(context->alloc, &RANGE_TO_ANY(tokens));
+}
+
+/**
+ * @brief Views the value of a variable set by a source the context evaluated.
+ *
+ * @param[in] context
+ * @param[in] name Null-terminated name of the variable.
+ * @param[out] out_view View on the value of the variable, if it was found.
+ * @return false if no evaluated source set this variable.
+ */
+bool dicelang_context_variable(const struct dicelang_context *context, const char *name, struct dicelang_distrib_view *out_view)
+{
+    u32 slot = 0;
+    const struct dicelang_distrib *distrib = nullptr;
+    size_t cursor = 0;
+    struct dicelang_entry entry = { };
+
+    if (!context || !name || !out_view || !dicelang_compiler_find_variable(context->compiler, name, strlen(name), &slot)) {
+        return false;
+    }
+
+    distrib = dicelang_interpreter_variable(context->interpreter, slot);
+    if (!distrib) {
+        return false;
+    }
+
+    // counts wider than 64 bits are scaled down so their sum stays in the range of a double
+    *out_view = (struct dicelang_distrib_view) {
+            .distrib = distrib,
+            .exponent = (distrib->width > 2) ? -32 * (i32) (distrib->width - 2) : 0,
+    };
+
+    while (dicelang_distrib_next_entry(*distrib, &cursor, &entry)) {
+        out_view->total += dicelang_count_to_f64(entry.count, out_view->exponent);
+        out_view->length += 1;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the next value of a viewed distribution, and its probability.
+ *
+ * @param[in] view
+ * @param[inout] cursor Position of the reading in the distribution, starting at 0.
+ * @param[out] out_value
+ * @param[out] out_probability
+ * @return false once all values were read.
+ */
+bool dicelang_distrib_view_next(const struct dicelang_distrib_view *view, size_t *cursor, i32 *out_value, f64 *out_probability)
+{
+    struct dicelang_entry entry = { };
+
+    if (!view || !view->distrib || !cursor || !dicelang_distrib_next_entry(*view->distrib, cursor, &entry)) {
+        return false;
+    }
+
+    if (out_value) {
+        *out_value = entry.val;
+    }
+    if (out_probability) {
+        *out_probability = (view->total > 0.) ? (dicelang_count_to_f64(entry.count, view->exponent) / view->total) : 0.;
+    }
+
+    return true;
+}
@@ -8,9 +8,21 @@
  * @copyright Copyright (c) 2024
  *
  */
+// fileno() and fstat() are POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <dicelang.h>
 
+/// Number of characters read at once from files whose size is not known beforehand, like pipes.
+#define DICELANG_READ_CHUNK_SIZE (1u << 16)
+/// Number of characters a streamed program starts with to hold the line it reads.
+#define DICELANG_STREAM_LINE_SIZE (256u)
+
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
@@ -53,10 +65,19 @@ const char *DTOK_DSTX_names[DSTX_NUMBER] = {
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
+static void dicelang_program_read_file(struct dicelang_program *program, FILE *from_file, allocator alloc);
+static void dicelang_program_build(struct dicelang_program *program, allocator alloc);
+static bool dicelang_program_read_line(struct dicelang_program *program, FILE *from_file, allocator alloc);
+static void dicelang_program_stream_line(struct dicelang_program *program, struct dicelang_compiler *compiler, struct dicelang_interpreter **interpreter, allocator alloc);
+static struct dicelang_options dicelang_read_pragmas(const char *text);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
 /**
  * @brief Creates a tangible program (hopefuly) that can be interpreted directly with dicelang_interpret().
- * The returned structure contains the raw text from the file and an intermediate representations of the program as a parse tree.
- * The parse tree is the one being interpreted, and references the raw text.
+ * The returned structure contains the raw text from the file and intermediate representations of the program : a parse tree,
+ * and the instructions compiled from it. The instructions are the ones being interpreted, and reference the raw text.
  * A dicelang_program structure, even malformed because some error occured, should be destroyed with dicelang_program_destroy().
  *
  * @param[in] from_file File from which is read the program. The file is read entirely before it is parsed and interpreted.
@@ -66,29 +87,95 @@ const char *DTOK_DSTX_names[DSTX_NUMBER] = {
 struct dicelang_program dicelang_program_create_from_file(FILE *from_file, allocator alloc)
 {
     struct dicelang_program new_program = { 0u };
-    char read_char = 0;
-    RANGE_TOKEN *tokens = nullptr;
 
     if (!from_file) {
         return (struct dicelang_program) { 0u };
     }
 
-    // reading from file
-    new_program.text = range_create_dynamic(alloc, sizeof(*new_program.text->data), 512);
-    while ((read_char = fgetc(from_file)) != EOF) {
-        new_program.text = range_ensure_capacity(alloc, RANGE_TO_ANY(new_program.text), 1);
-        range_push(RANGE_TO_ANY(new_program.text), &read_char);
+    dicelang_program_read_file(&new_program, from_file, alloc);
+
+    if (!new_program.text) {
+        new_program.error.flavour = DERR_INTERNAL;
+        new_program.error.what = "could not read the file.";
+        return new_program;
     }
 
-    // adding terminator
-    new_program.text = range_ensure_capacity(alloc, RANGE_TO_ANY(new_program.text), 1);
-    range_push(RANGE_TO_ANY(new_program.text), &(char) { '\0' });
+    new_program.source_code = new_program.text->data;
+    dicelang_program_build(&new_program, alloc);
 
-    // tokenizing & creating parse tree
-    tokens = dicelang_tokenize(new_program.text->data, &new_program.error, alloc);
-    new_program.parse_tree = dicelang_parse(tokens, &new_program.error, alloc);
+    return new_program;
+}
 
-    range_destroy_dynamic(alloc, &RANGE_TO_ANY(tokens));
+/**
+ * @brief Creates a program from some text that is not copied : the program references it, and it should outlive the program.
+ * Besides that, the program is the same as one read from a file.
+ *
+ * @param[in] source_code Null-terminated text of the program.
+ * @param[in] alloc Allocator used to get memory for the program.
+ * @return struct dicelang_program
+ */
+struct dicelang_program dicelang_program_create_from_buffer(const char *source_code, allocator alloc)
+{
+    struct dicelang_program new_program = { 0u };
+
+    if (!source_code) {
+        return (struct dicelang_program) { 0u };
+    }
+
+    new_program.source_code = source_code;
+    dicelang_program_build(&new_program, alloc);
+
+    return new_program;
+}
+
+/**
+ * @brief Interprets a program from a file one line at a time : each line is read, tokenized, parsed, compiled and interpreted before the next one is read.
+ * Statements taking one line each, the memory used only depends on the longest line, and the values of the variables.
+ * The first error stops the program. The returned structure then holds the line the error is in, so it can be reported ;
+ * it should be destroyed with dicelang_program_destroy().
+ * "#pragma" lines are only read until the first statement is interpreted.
+ *
+ * @param[in] from_file File from which is read the program. It can be a pipe.
+ * @param[in] options Numeric settings, taking precedence over the pragmas of the program. Can be NULL.
+ * @param[in] alloc Allocator used to get memory for the program.
+ * @return struct dicelang_program
+ */
+struct dicelang_program dicelang_program_stream_from_file(FILE *from_file, const struct dicelang_options *options, allocator alloc)
+{
+    struct dicelang_program new_program = { 0u };
+    struct dicelang_compiler *compiler = nullptr;
+    struct dicelang_interpreter *interpreter = nullptr;
+    struct dicelang_options line_options = { };
+
+    if (!from_file) {
+        return (struct dicelang_program) { 0u };
+    }
+
+    new_program.options = options ? *options : (struct dicelang_options) { .approximate = false, .epsilon = DICELANG_DEFAULT_EPSILON };
+    new_program.text = range_create_dynamic(alloc, sizeof(*new_program.text->data), DICELANG_STREAM_LINE_SIZE);
+    compiler = dicelang_compiler_create(alloc);
+
+    if (!new_program.text || !compiler) {
+        new_program.error.flavour = DERR_INTERNAL;
+        new_program.error.what = "could not allocate the memory to stream the program.";
+        dicelang_compiler_destroy(&compiler);
+        return new_program;
+    }
+
+    while ((new_program.error.flavour == DERR_NONE) && dicelang_program_read_line(&new_program, from_file, alloc)) {
+        new_program.source_code = new_program.text->data;
+        new_program.first_line += 1;
+
+        line_options = dicelang_read_pragmas(new_program.source_code);
+        if (!options && !interpreter && line_options.approximate) {
+            new_program.options = line_options;
+        }
+
+        dicelang_program_stream_line(&new_program, compiler, &interpreter, alloc);
+    }
+
+    dicelang_interpreter_destroy(&interpreter);
+    dicelang_compiler_destroy(&compiler);
 
     return new_program;
 }
@@ -107,6 +194,7 @@ void dicelang_program_destroy(struct dicelang_program *program, allocator alloc)
 
     range_destroy_dynamic(alloc, &RANGE_TO_ANY(program->text));
     dicelang_parse_node_destroy(&program->parse_tree, alloc);
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(program->code));
 
     *program = (struct dicelang_program) { 0u };
 }
@@ -115,9 +203,10 @@ void dicelang_program_destroy(struct dicelang_program *program, allocator alloc)
  * @brief Prints one token to a file. The token may have a flavour that is non-terminal.
  *
  * @param[in] token Token to print information about.
+ * @param[in] where Position of the token, from dicelang_token_position().
  * @param[in] to_file Target stream.
  */
-void dicelang_token_print(struct dicelang_token token, FILE *to_file)
+void dicelang_token_print(struct dicelang_token token, struct dicelang_position where, FILE *to_file)
 {
     if (!to_file || (token.flavour >= DSTX_NUMBER)) {
         return;
@@ -125,29 +214,72 @@ void dicelang_token_print(struct dicelang_token token, FILE *to_file)
 
     // printing token info
     fprintf(to_file, "(%d:%d)\t%c%-20s`",
-            token.where.line,
-            token.where.col,
+            where.line,
+            where.col,
             (token.flavour < DTOK_NUMBER)? '*' : ' ',
             DTOK_DSTX_names[token.flavour]);
 
     // printing token text
-    for (size_t i = 0u ; i < token.value.source_length ; i++) {
-        if (token.value.source[i] != '\n') {
-            fprintf(to_file, "%c", token.value.source[i]);
+    for (size_t i = 0u ; i < token.source_length ; i++) {
+        if (token.source[i] != '\n') {
+            fprintf(to_file, "%c", token.source[i]);
         }
     }
 
     fprintf(to_file, "`\n");
 }
 
+/**
+ * @brief Finds the line and column of a token. Positions are not stored in tokens, so the source code is read up to the token.
+ * This is only meant for the few tokens that are reported.
+ *
+ * @param[in] token Token to locate.
+ * @param[in] source_code Text the token was read from.
+ * @return struct dicelang_position
+ */
+struct dicelang_position dicelang_token_position(struct dicelang_token token, const char *source_code)
+{
+    if (!source_code || !token.source || (token.source < source_code)) {
+        return (struct dicelang_position) { 0u };
+    }
+
+    return dicelang_position_advance((struct dicelang_position) { .line = 1u, .col = 1u }, source_code, token.source);
+}
+
+/**
+ * @brief Moves a position forward over the characters between two points of the same text.
+ *
+ * @param[in] from Position of the first character.
+ * @param[in] from_text First character.
+ * @param[in] to_text Character to find the position of.
+ * @return struct dicelang_position
+ */
+struct dicelang_position dicelang_position_advance(struct dicelang_position from, const char *from_text, const char *to_text)
+{
+    for (const char *c = from_text ; c < to_text ; c++) {
+        if (*c == '\n') {
+            from.line += 1u;
+            from.col = 1u;
+        } else {
+            from.col += 1u;
+        }
+    }
+
+    return from;
+}
+
 /**
  * @brief Prints the error held in an error data structure.
  *
  * @param[in] err Error description and information.
+ * @param[in] source_code Text the error was found in, to locate it.
+ * @param[in] first_line Line of the script the text starts at.
  * @param[in] to_file Target stream.
  */
-void dicelang_error_print(struct dicelang_error err, FILE *to_file)
+void dicelang_error_print(struct dicelang_error err, const char *source_code, u32 first_line, FILE *to_file)
 {
+    struct dicelang_position where = { };
+
     switch (err.flavour) {
         case DERR_NONE:
             fprintf(to_file, "dicelang: no error\n");
@@ -167,14 +299,18 @@ void dicelang_error_print(struct dicelang_error err, FILE *to_file)
             break;
     }
 
+    where = dicelang_token_position(err.token, source_code);
+    if ((where.line > 0) && (first_line > 1)) {
+        where.line += first_line - 1;
+    }
     fprintf(to_file, "at (%d:%d) near token '%s'",
-            err.token.where.line, err.token.where.col,
+            where.line, where.col,
             DTOK_DSTX_names[err.token.flavour]);
 
-    if (err.token.value.source) {
+    if (err.token.source_length > 0) {
         fprintf(to_file, " (\"");
-        for (size_t i = 0 ; i < err.token.value.source_length ; i++) {
-            fprintf(to_file, "%c", err.token.value.source[i]);
+        for (size_t i = 0 ; i < err.token.source_length ; i++) {
+            fprintf(to_file, "%c", err.token.source[i]);
         }
         fprintf(to_file, "\")");
     }
@@ -183,3 +319,183 @@ void dicelang_error_print(struct dicelang_error err, FILE *to_file)
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Reads a whole file into the text of a program, with a terminator.
+ * Regular files are read at once, as their size is known. Other files (pipes, terminals) are read by chunks until their end.
+ *
+ * @param[inout] program Program receiving the text. Its text is left NULL if the file could not be read.
+ * @param[in] from_file
+ * @param[in] alloc
+ */
+static void dicelang_program_read_file(struct dicelang_program *program, FILE *from_file, allocator alloc)
+{
+    struct stat file_stat = { };
+    size_t capacity = DICELANG_READ_CHUNK_SIZE;
+    size_t nb_read = 0;
+
+    // room for the whole file, the terminator, and one more character so the end of the file is met on the first read
+    if ((fstat(fileno(from_file), &file_stat) == 0) && S_ISREG(file_stat.st_mode)) {
+        capacity = (size_t) file_stat.st_size + 2;
+    }
+
+    program->text = range_create_dynamic(alloc, sizeof(*program->text->data), capacity);
+    if (!program->text) {
+        return;
+    }
+
+    do {
+        if (program->text->capacity - program->text->length < 2) {
+            program->text = range_ensure_capacity(alloc, RANGE_TO_ANY(program->text), DICELANG_READ_CHUNK_SIZE);
+        }
+        if (!program->text || (program->text->capacity - program->text->length < 2)) {
+            range_destroy_dynamic(alloc, &RANGE_TO_ANY(program->text));
+            return;
+        }
+
+        nb_read = fread((char *) program->text->data + program->text->length, 1, program->text->capacity - program->text->length - 1, from_file);
+        program->text->length += nb_read;
+    } while ((nb_read > 0) && !feof(from_file) && !ferror(from_file));
+
+    // adding terminator, there is always room left for it
+    range_push(RANGE_TO_ANY(program->text), &(char) { '\0' });
+}
+
+/**
+ * @brief Reads the settings of a program, then tokenizes its text, parses it and compiles it.
+ *
+ * @param[inout] program Program with its source code set.
+ * @param[in] alloc
+ */
+static void dicelang_program_build(struct dicelang_program *program, allocator alloc)
+{
+    RANGE_TOKEN *tokens = nullptr;
+
+    program->first_line = 1;
+    program->options = dicelang_read_pragmas(program->source_code);
+    tokens = dicelang_tokenize(program->source_code, &program->error, alloc);
+    program->parse_tree = dicelang_parse(tokens, &program->error, alloc);
+    program->code = dicelang_compile(program->parse_tree, &program->error, alloc);
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(tokens));
+}
+
+/**
+ * @brief Replaces the text of a program by the next line of a file, with its line end and a terminator.
+ *
+ * @param[inout] program Program receiving the line.
+ * @param[in] from_file
+ * @param[in] alloc
+ * @return false if the end of the file was reached before any character was read, or the line could not fit in memory.
+ */
+static bool dicelang_program_read_line(struct dicelang_program *program, FILE *from_file, allocator alloc)
+{
+    size_t room = 0;
+
+    range_clear(RANGE_TO_ANY(program->text));
+
+    do {
+        // lines too long for the text are read in several parts, doubling its size each time
+        if (program->text->capacity - program->text->length < 2) {
+            program->text = range_ensure_capacity(alloc, RANGE_TO_ANY(program->text), program->text->capacity);
+        }
+        if (program->text->capacity - program->text->length < 2) {
+            program->error.flavour = DERR_INTERNAL;
+            program->error.what = "could not allocate the memory to read a line.";
+            return false;
+        }
+
+        room = program->text->capacity - program->text->length;
+        if (!fgets((char *) program->text->data + program->text->length, (room > INT_MAX) ? INT_MAX : (int) room, from_file)) {
+            break;
+        }
+        program->text->length += strlen(program->text->data + program->text->length);
+    } while ((program->text->length > 0) && (RANGE_LAST(program->text) != '\n'));
+
+    if (program->text->length == 0) {
+        return false;
+    }
+
+    // adding terminator, fgets() always leaves room for it
+    range_push(RANGE_TO_ANY(program->text), &(char) { '\0' });
+
+    return true;
+}
+
+/**
+ * @brief Tokenizes, parses, compiles and interprets the line a streamed program just read, then releases all of it.
+ * Lines holding no statement are skipped. The interpreter is created for the first statement, once the pragmas before it are read.
+ *
+ * @param[inout] program Streamed program, with the line to interpret as its source code.
+ * @param[inout] compiler Compiler used for all the lines of the program.
+ * @param[inout] interpreter Interpreter used for all the lines of the program, or NULL before the first statement.
+ * @param[in] alloc
+ */
+static void dicelang_program_stream_line(struct dicelang_program *program, struct dicelang_compiler *compiler, struct dicelang_interpreter **interpreter, allocator alloc)
+{
+    RANGE_TOKEN *tokens = nullptr;
+    RANGE_PARSE_NODE *tree = nullptr;
+    RANGE_INSTRUCTION *code = nullptr;
+
+    tokens = dicelang_tokenize(program->source_code, &program->error, alloc);
+
+    // blank or comment line, made of the end of the text only
+    if (!tokens || (program->error.flavour != DERR_NONE) || (tokens->length < 2)) {
+        range_destroy_dynamic(alloc, &RANGE_TO_ANY(tokens));
+        return;
+    }
+
+    if (!*interpreter) {
+        *interpreter = dicelang_interpreter_create(program->options, alloc);
+    }
+
+    tree = dicelang_parse(tokens, &program->error, alloc);
+    code = dicelang_compiler_compile(compiler, tree, &program->error);
+
+    if (!*interpreter) {
+        program->error.flavour = DERR_INTERNAL;
+        program->error.what = "interpreter could not allocate its working memory.";
+    } else {
+        dicelang_interpreter_run(*interpreter, code, &program->error);
+    }
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(code));
+    dicelang_parse_node_destroy(&tree, alloc);
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(tokens));
+}
+
+/**
+ * @brief Reads the numeric settings of a program from its "#pragma" lines. Those lines are comments to the lexer.
+ * "#pragma approximate" switches to the approximate mode, and can be followed by the epsilon to use.
+ *
+ * @param[in] text Program text, null-terminated.
+ * @return struct dicelang_options
+ */
+static struct dicelang_options dicelang_read_pragmas(const char *text)
+{
+    static const char pragma[] = "#pragma approximate";
+    struct dicelang_options options = { .approximate = false, .epsilon = DICELANG_DEFAULT_EPSILON };
+    const char *line = text;
+    const char *argument = nullptr;
+    f64 epsilon = 0.;
+
+    while (line && (*line != '\0')) {
+        if (strncmp(line, pragma, sizeof(pragma) - 1) == 0) {
+            options.approximate = true;
+
+            argument = line + sizeof(pragma) - 1;
+            while ((*argument == ' ') || (*argument == '\t')) {
+                argument += 1;
+            }
+            epsilon = ((*argument >= '0') && (*argument <= '9')) || (*argument == '.') ? strtod(argument, nullptr) : 0.;
+            if (epsilon > 0.) {
+                options.epsilon = epsilon;
+            }
+        }
+
+        line = strchr(line, '\n');
+        line = line ? (line + 1) : nullptr;
+    }
+
+    return options;
+}
@@ -8,460 +8,554 @@
  * @copyright Copyright (c) 2024
  *
  */
+#include "containers/arena.h"
 #include "containers/distribution.h"
-#include "containers/var_hashmap.h"
-#include "containers/func_hashmap.h"
 
 #include <dicelang.h>
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-/**
- * @brief
- *
- */
-struct dicelang_exec_context {
-    struct dicelang_parse_node *node;
-
-    size_t children_index;
-    size_t values_stack_index;
-};
+/// Number of value buffers an interpreter keeps around for the next results.
+#define DICELANG_INTERPRETER_RECYCLED_MAX (4)
 
 /**
- * @brief
- *
+ * @brief State of an interpreter : values of the variables, kept from one run to the next, and the values stack of the statement in progress.
  */
 struct dicelang_interpreter {
     struct allocator alloc;
+    struct dicelang_options options;
 
-    struct dicelang_variable_map variables;
-    struct dicelang_function_map functions;
+    struct dicelang_arena *arena;
+    struct allocator temporaries;
+
+    /** Values of the variables, indexed by the slots the compiler gave them. Unset variables hold an invalid distribution. */
+    RANGE(struct dicelang_distrib) *variables;
 
     RANGE(struct dicelang_distrib) *values_stack;
-    RANGE(struct dicelang_exec_context) *exec_stack;
-};
 
-/**
- * @brief
- *
- */
-typedef void (*dicelang_exec_routine)(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
+    /** Storage of consumed operands, reused by the next results computed in the same statement. */
+    RANGE(struct dicelang_distrib) *recycled;
+};
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-static struct dicelang_interpreter dicelang_interpreter_create(size_t start_stack_size, size_t start_hashmap_size, struct allocator alloc);
-static void dicelang_interpreter_destroy(struct dicelang_interpreter *interp, struct allocator alloc);
-static struct dicelang_exec_context *dicelang_interpreter_push_context(struct dicelang_interpreter *interp, struct dicelang_parse_node *node, struct allocator alloc);
-static struct dicelang_exec_context *dicelang_interpreter_pop_context(struct dicelang_interpreter interp);
-static bool dicelang_exec_context_has_child(struct dicelang_exec_context *context, enum dicelang_token_flavour what);
+static void dicelang_interpreter_push(struct dicelang_interpreter *interp, struct dicelang_distrib *value);
+static struct dicelang_distrib dicelang_interpreter_take_buffer(struct dicelang_interpreter *interp);
+static void dicelang_interpreter_give_buffer(struct dicelang_interpreter *interp, struct dicelang_distrib *value);
+static void dicelang_interpreter_drop_buffers(struct dicelang_interpreter *interp);
 
 // -------------------------------------------------------------------------------------------------
 
-static void dicelang_exec_routine_value(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-static void dicelang_exec_routine_assignment(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-static void dicelang_exec_routine_addition(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-static void dicelang_exec_routine_dice(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-static void dicelang_exec_routine_multiplication(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-static void dicelang_exec_routine_function_call(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-static void dicelang_exec_routine_variable_access(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context);
-
-// -------------------------------------------------------------------------------------------------
-
-static void dicelang_builtin_print(struct dicelang_distrib *input, struct dicelang_distrib *output, struct allocator alloc);
-static void dicelang_builtin_count(struct dicelang_distrib *input, struct dicelang_distrib *output, struct allocator alloc);
+static const char *dicelang_exec_push_const(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
+static const char *dicelang_exec_load_var(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
+static const char *dicelang_exec_binary(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
+static const char *dicelang_exec_dice(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
+static const char *dicelang_exec_call(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
+static const char *dicelang_exec_store(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
+static const char *dicelang_exec_end_statement(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief
+ * @brief Interprets compiled instructions with an interpreter that is thrown away afterwards.
  *
- */
-static const dicelang_exec_routine dicelang_exec_routine_map[DSTX_NUMBER] = {
-        [DTOK_value]      = &dicelang_exec_routine_value,
-
-        [DSTX_assignment]       = &dicelang_exec_routine_assignment,
-        [DSTX_addition]         = &dicelang_exec_routine_addition,
-        [DSTX_dice]             = &dicelang_exec_routine_dice,
-        [DSTX_multiplication]   = &dicelang_exec_routine_multiplication,
-        [DSTX_function_call]    = &dicelang_exec_routine_function_call,
-        [DSTX_variable_access]  = &dicelang_exec_routine_variable_access,
-};
-
-// -------------------------------------------------------------------------------------------------
-// -------------------------------------------------------------------------------------------------
-
-/**
- * @brief Interprets the instructions encoded in a parse tree.
- * Most symbols in the tree are associated to a routine that will impact the interpreter's state.
- *
- * @param[in] tree Interpreted tree.
+ * @param[in] code Interpreted instructions.
+ * @param[in] options Numeric mode of the computed distributions.
  * @param[inout] error_sink Error reporting structure.
  * @param[in] alloc Allocator used for temporary allocations.
  */
-void dicelang_interpret(struct dicelang_parse_node *tree, struct dicelang_error *error_sink, struct allocator alloc)
+void dicelang_interpret(const RANGE_INSTRUCTION *code, struct dicelang_options options, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_interpreter interpreter = { };
-    struct dicelang_exec_context *current_context = nullptr;
-    struct dicelang_exec_context *next_context = nullptr;
-    bool executing = false;
-
-    // interpreter and context
-    interpreter = dicelang_interpreter_create(16, 8, alloc);
-    current_context = dicelang_interpreter_push_context(&interpreter, tree, alloc);
+    struct dicelang_interpreter *interpreter = nullptr;
 
-    // builtin functions addition
-    dicelang_function_map_set(&interpreter.functions, "print", 5, &dicelang_builtin_print, 1, false, alloc);
-    dicelang_function_map_set(&interpreter.functions, "count", 5, &dicelang_builtin_count, 2, true, alloc);
-
-    if (!current_context) {
+    if (!code) {
         error_sink->flavour = DERR_INTERNAL;
-        error_sink->what = "interpreter could not init a context to interpret from.";
+        error_sink->what = "interpreter was given no instructions to interpret.";
         return;
     }
 
-    // reading the tree depth wise using the context stack
-    executing = true;
-    do {
-        if (current_context->children_index < current_context->node->children->length) {
-            // nonterminal
-            next_context = dicelang_interpreter_push_context(&interpreter, current_context->node->children->data[current_context->children_index], alloc);
-            current_context->children_index += 1;
-            current_context = next_context;
-        } else {
-            // terminal
-            if (dicelang_exec_routine_map[current_context->node->token.flavour]) {
-                dicelang_exec_routine_map[current_context->node->token.flavour](&interpreter, current_context);
-            }
-
-            current_context = dicelang_interpreter_pop_context(interpreter);
-        }
-
-        executing = current_context != nullptr;
-    } while (executing);
+    interpreter = dicelang_interpreter_create(options, alloc);
+    if (!interpreter) {
+        error_sink->flavour = DERR_INTERNAL;
+        error_sink->what = "interpreter could not allocate its working memory.";
+        return;
+    }
 
-    dicelang_interpreter_destroy(&interpreter, alloc);
+    dicelang_interpreter_run(interpreter, code, error_sink);
+    dicelang_interpreter_destroy(&interpreter);
 }
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief
+ * @brief Creates an interpreter with no variable set.
  *
- * @param start_stack_size
- * @param start_hashmap_size
- * @param alloc
- * @return struct dicelang_interpreter
+ * @param[in] options Numeric mode of the computed distributions.
+ * @param[in] alloc Allocator used for the interpreter and the variables.
+ * @return struct dicelang_interpreter *
  */
-static struct dicelang_interpreter dicelang_interpreter_create(size_t start_stack_size, size_t start_hashmap_size, struct allocator alloc)
+struct dicelang_interpreter *dicelang_interpreter_create(struct dicelang_options options, struct allocator alloc)
 {
-    struct dicelang_interpreter interp = {
+    struct dicelang_interpreter *interp = alloc.malloc(alloc, sizeof(*interp));
+
+    if (!interp) {
+        return nullptr;
+    }
+
+    *interp = (struct dicelang_interpreter) {
             .alloc = alloc,
+            .options = options,
+
+            .arena = dicelang_arena_create(alloc),
 
-            .variables = dicelang_variable_map_create(start_hashmap_size, alloc),
-            .functions = dicelang_function_map_create(start_hashmap_size, alloc),
+            .variables = range_create_dynamic(alloc, sizeof(*interp->variables->data), 8),
 
-            .values_stack = range_create_dynamic(alloc, sizeof(*interp.values_stack->data), start_stack_size),
-            .exec_stack = range_create_dynamic(alloc, sizeof(*interp.exec_stack->data), start_stack_size),
+            .values_stack = range_create_dynamic(alloc, sizeof(*interp->values_stack->data), 16),
+            .recycled = range_create_dynamic(alloc, sizeof(*interp->recycled->data), DICELANG_INTERPRETER_RECYCLED_MAX),
     };
 
+    if (!interp->arena || !interp->variables || !interp->values_stack || !interp->recycled) {
+        dicelang_interpreter_destroy(&interp);
+        return nullptr;
+    }
+
+    interp->temporaries = dicelang_arena_allocator(interp->arena);
+
     return interp;
 }
 
 /**
- * @brief
+ * @brief Releases an interpreter, and the values of its variables.
  *
- * @param interp
- * @param alloc
- * @param alloc
+ * @param[inout] interp
  */
-static void dicelang_interpreter_destroy(struct dicelang_interpreter *interp, struct allocator alloc)
+void dicelang_interpreter_destroy(struct dicelang_interpreter **interp)
 {
-    if (!interp) {
+    struct allocator alloc = { };
+
+    if (!interp || !*interp) {
         return;
     }
 
-    dicelang_variable_map_destroy(&interp->variables, alloc);
-    dicelang_function_map_destroy(&interp->functions, alloc);
+    alloc = (*interp)->alloc;
+
+    for (size_t i = 0 ; (*interp)->variables && (i < (*interp)->variables->length) ; i++) {
+        dicelang_distrib_destroy((*interp)->variables->data + i, alloc);
+    }
 
-    for (size_t i = 0 ; i < interp->values_stack->length ; i++) {
-        dicelang_distrib_destroy(interp->values_stack->data + i, alloc);
+    for (size_t i = 0 ; (*interp)->values_stack && (i < (*interp)->values_stack->length) ; i++) {
+        dicelang_distrib_destroy((*interp)->values_stack->data + i, (*interp)->temporaries);
     }
 
-    range_destroy_dynamic(alloc, &RANGE_TO_ANY(interp->values_stack));
-    range_destroy_dynamic(alloc, &RANGE_TO_ANY(interp->exec_stack));
+    dicelang_interpreter_drop_buffers(*interp);
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY((*interp)->variables));
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY((*interp)->values_stack));
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY((*interp)->recycled));
+
+    dicelang_arena_destroy(&(*interp)->arena);
 
-    *interp = (struct dicelang_interpreter) { 0 };
+    alloc.free(alloc, *interp);
+    *interp = nullptr;
 }
 
 /**
- * @brief
+ * @brief Interprets compiled instructions, one after the other. The same instructions can be interpreted any number of times.
+ * Each instruction works on the values stack of the interpreter ; the first one failing stops the run and reports why.
+ * Variables keep their values from one run to the next, so a program can be interpreted in parts compiled by the same compiler.
  *
- * @param interp
- * @param node
- * @param alloc
+ * @param[inout] interp Interpreter, with the values of the variables set so far.
+ * @param[in] code Interpreted instructions.
+ * @param[inout] error_sink Error reporting structure.
  */
-static struct dicelang_exec_context *dicelang_interpreter_push_context(struct dicelang_interpreter *interp, struct dicelang_parse_node *node, struct allocator alloc)
+void dicelang_interpreter_run(struct dicelang_interpreter *interp, const RANGE_INSTRUCTION *code, struct dicelang_error *error_sink)
 {
-    if (!node || !interp) {
-        return nullptr;
+    const struct dicelang_instruction *instruction = nullptr;
+    const char *failure = nullptr;
+
+    if (!interp || !code) {
+        return;
     }
 
-    interp->exec_stack = range_ensure_capacity(alloc, RANGE_TO_ANY(interp->exec_stack), 1);
-    range_push(RANGE_TO_ANY(interp->exec_stack), &(struct dicelang_exec_context) { .node = node, .children_index = 0, .values_stack_index = interp->values_stack->length });
+    for (size_t i = 0 ; !failure && (i < code->length) ; i++) {
+        instruction = code->data + i;
+
+        switch (instruction->opcode) {
+            case DBC_push_const:
+                failure = dicelang_exec_push_const(interp, instruction);
+                break;
+            case DBC_load_var:
+                failure = dicelang_exec_load_var(interp, instruction);
+                break;
+            case DBC_add:
+            case DBC_substract:
+            case DBC_multiply:
+                failure = dicelang_exec_binary(interp, instruction);
+                break;
+            case DBC_dice:
+                failure = dicelang_exec_dice(interp, instruction);
+                break;
+            case DBC_call:
+                failure = dicelang_exec_call(interp, instruction);
+                break;
+            case DBC_store:
+                failure = dicelang_exec_store(interp, instruction);
+                break;
+            case DBC_end_statement:
+                failure = dicelang_exec_end_statement(interp, instruction);
+                break;
+            default:
+                failure = "unknown instruction.";
+                break;
+        }
+    }
+
+    if (failure) {
+        // the failed statement is dropped, the interpreter can still run other instructions
+        (void) dicelang_exec_end_statement(interp, instruction);
 
-    return interp->exec_stack->data + (interp->exec_stack->length - 1);
+        // an earlier error (from the parser) is the one reported
+        if (error_sink->flavour == DERR_NONE) {
+            error_sink->flavour = DERR_INTERPRET;
+            error_sink->token = instruction->token;
+            error_sink->what = failure;
+        }
+    }
 }
 
 /**
- * @brief
+ * @brief Gives read access to the value of a variable. The value stays valid until the interpreter runs some other instructions.
  *
- * @param interp
- * @return struct dicelang_exec_context*
+ * @param[in] interp
+ * @param[in] slot Slot the compiler gave to the variable.
+ * @return const struct dicelang_distrib * NULL if the variable was not set by any run.
  */
-static struct dicelang_exec_context *dicelang_interpreter_pop_context(struct dicelang_interpreter interp)
+const struct dicelang_distrib *dicelang_interpreter_variable(const struct dicelang_interpreter *interp, u32 slot)
 {
-    range_pop(RANGE_TO_ANY(interp.exec_stack));
-
-    if (interp.exec_stack->length == 0) {
+    if (!interp || (slot >= interp->variables->length) || !dicelang_distrib_is_valid(interp->variables->data[slot])) {
         return nullptr;
     }
-    return interp.exec_stack->data + interp.exec_stack->length - 1;
+
+    return interp->variables->data + slot;
 }
 
 /**
- * @brief
+ * @brief Releases the values of all variables. The arena and the buffers of the interpreter are kept, to be reused by the next runs.
  *
- * @param context
- * @param
- * @return
+ * @param[inout] interp
  */
-static bool dicelang_exec_context_has_child(struct dicelang_exec_context *context, enum dicelang_token_flavour what)
+void dicelang_interpreter_forget(struct dicelang_interpreter *interp)
 {
-    bool found = false;
-    size_t child_index = 0;
+    if (!interp) {
+        return;
+    }
 
-    if (!context || !context->node || !context->node->children) {
-        return false;
+    for (size_t i = 0 ; i < interp->variables->length ; i++) {
+        dicelang_distrib_destroy(interp->variables->data + i, interp->alloc);
     }
 
-    while (!found && (child_index < context->node->children->length)) {
-        found = context->node->children->data[child_index]->token.flavour == what;
-        child_index += 1;
+    interp->variables->length = 0;
+}
+
+/**
+ * @brief Sets the stream the builtins write to, and how print writes distributions.
+ *
+ * @param[inout] interp
+ * @param[in] output Target stream, or NULL for the standard output.
+ * @param[in] format
+ */
+void dicelang_interpreter_redirect(struct dicelang_interpreter *interp, FILE *output, enum dicelang_print_format format)
+{
+    if (!interp) {
+        return;
     }
 
-    return found;
+    interp->options.output = output;
+    interp->options.format = format;
 }
 
-// -------------------------------------------------------------------------------------------------
-// -------------------------------------------------------------------------------------------------
+/**
+ * @brief Pushes a value on the stack, which takes ownership of it.
+ *
+ * @param interp
+ * @param value
+ */
+static void dicelang_interpreter_push(struct dicelang_interpreter *interp, struct dicelang_distrib *value)
+{
+    interp->values_stack = range_ensure_capacity(interp->alloc, RANGE_TO_ANY(interp->values_stack), 1);
+    range_push(RANGE_TO_ANY(interp->values_stack), value);
+    *value = (struct dicelang_distrib) { };
+}
 
 /**
- * @brief
+ * @brief Gets some storage to compute a result into, from a previously consumed operand if there is one.
  *
- * @param interpreter
- * @param context
+ * @param interp
+ * @return struct dicelang_distrib
  */
-static void dicelang_exec_routine_value(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static struct dicelang_distrib dicelang_interpreter_take_buffer(struct dicelang_interpreter *interp)
 {
-    struct dicelang_distrib new_distrib = dicelang_distrib_create(context->node->token, interpreter->alloc);
+    struct dicelang_distrib buffer = { };
 
-    if (!new_distrib.values) {
-        return;
+    if (interp->recycled && (interp->recycled->length > 0)) {
+        buffer = RANGE_LAST(interp->recycled);
+        range_pop(RANGE_TO_ANY(interp->recycled));
+        return buffer;
     }
 
-    interpreter->values_stack = range_ensure_capacity(interpreter->alloc, RANGE_TO_ANY(interpreter->values_stack), 1);
-    range_push(RANGE_TO_ANY(interpreter->values_stack), &new_distrib);
+    return dicelang_distrib_create_empty(interp->temporaries);
 }
 
 /**
- * @brief
+ * @brief Hands a consumed operand back to the interpreter. Its storage is kept for the next results, unless it is shared or
+ * enough buffers are already kept.
  *
- * @param interpreter
- * @param context
+ * @param interp
+ * @param value
  */
-static void dicelang_exec_routine_assignment(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static void dicelang_interpreter_give_buffer(struct dicelang_interpreter *interp, struct dicelang_distrib *value)
 {
-    struct dicelang_token indentifier = { };
-    struct dicelang_distrib val = { };
-
-    if ((context->node->children->length == 0) || ((context->values_stack_index + 1) != interpreter->values_stack->length)) {
+    if (!value->references && dicelang_distrib_is_valid(*value) && interp->recycled && range_push(RANGE_TO_ANY(interp->recycled), value)) {
+        *value = (struct dicelang_distrib) { };
         return;
     }
 
-    indentifier = context->node->children->data[0]->token;
-    val = RANGE_LAST(interpreter->values_stack);
+    dicelang_distrib_destroy(value, interp->temporaries);
+}
 
-    if (dicelang_variable_map_set(&interpreter->variables, indentifier.value.source, indentifier.value.source_length, &val, interpreter->alloc)) {
-        range_pop(RANGE_TO_ANY(interpreter->values_stack));
+/**
+ * @brief Releases all buffers kept for the next results.
+ *
+ * @param interp
+ */
+static void dicelang_interpreter_drop_buffers(struct dicelang_interpreter *interp)
+{
+    if (!interp->recycled) {
         return;
     }
 
-    dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-    range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    for (size_t i = 0 ; i < interp->recycled->length ; i++) {
+        dicelang_distrib_destroy(interp->recycled->data + i, interp->temporaries);
+    }
+    range_clear(RANGE_TO_ANY(interp->recycled));
 }
 
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
 /**
- * @brief
+ * @brief Pushes the value written in the instruction's token.
  *
  * @param interpreter
- * @param context
+ * @param instruction
+ * @return Reason of the failure, or NULL.
  */
-static void dicelang_exec_routine_addition(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static const char *dicelang_exec_push_const(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
 {
-    struct dicelang_distrib tmp_distrib = { };
+    struct dicelang_distrib new_distrib = dicelang_distrib_create(instruction->token, interpreter->options, interpreter->temporaries);
 
-    while (context->values_stack_index + 1 < interpreter->values_stack->length) {
-        if (dicelang_exec_context_has_child(context, DTOK_op_addition)) {
-            tmp_distrib = dicelang_distrib_add(RANGE_LAST(interpreter->values_stack, -1), RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        } else {
-            tmp_distrib = dicelang_distrib_substract(RANGE_LAST(interpreter->values_stack, -1), RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        }
+    if (!dicelang_distrib_is_valid(new_distrib)) {
+        return "could not create a value.";
+    }
 
-        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        range_pop(RANGE_TO_ANY(interpreter->values_stack));
-        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    dicelang_interpreter_push(interpreter, &new_distrib);
 
-        range_push(RANGE_TO_ANY(interpreter->values_stack), &tmp_distrib);
-    }
+    return nullptr;
 }
 
 /**
- * @brief
+ * @brief Pushes the value of a variable. The value shares the storage of the variable.
  *
+ * @param interpreter
+ * @param instruction
+ * @return Reason of the failure, or NULL.
  */
-static void dicelang_exec_routine_dice(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static const char *dicelang_exec_load_var(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
 {
-    struct dicelang_distrib tmp_distrib = { };
+    struct dicelang_distrib var_value = { };
 
-    if (context->values_stack_index + 1 == interpreter->values_stack->length) {
-        tmp_distrib = dicelang_distrib_dice(RANGE_LAST(interpreter->values_stack), interpreter->alloc);
+    if ((instruction->slot >= interpreter->variables->length) || !dicelang_distrib_is_valid(interpreter->variables->data[instruction->slot])) {
+        return "unknown variable.";
+    }
 
-        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    var_value = dicelang_distrib_share(interpreter->variables->data + instruction->slot, interpreter->alloc);
+    dicelang_interpreter_push(interpreter, &var_value);
 
-        range_push(RANGE_TO_ANY(interpreter->values_stack), &tmp_distrib);
-    }
+    return nullptr;
 }
 
 /**
- * @brief
+ * @brief Replaces the two values on top of the stack by their sum, difference or product. The result is computed in the storage
+ * of previously consumed operands when there are some.
  *
+ * @param interpreter
+ * @param instruction
+ * @return Reason of the failure, or NULL.
  */
-static void dicelang_exec_routine_multiplication(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static const char *dicelang_exec_binary(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
 {
     struct dicelang_distrib tmp_distrib = { };
 
-    while (context->values_stack_index + 1 < interpreter->values_stack->length) {
-        tmp_distrib = dicelang_distrib_multiply(RANGE_LAST(interpreter->values_stack, -1), RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-
-        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        range_pop(RANGE_TO_ANY(interpreter->values_stack));
-        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->alloc);
-        range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    if (interpreter->values_stack->length < 2) {
+        return "missing operand.";
+    }
 
-        range_push(RANGE_TO_ANY(interpreter->values_stack), &tmp_distrib);
+    tmp_distrib = dicelang_interpreter_take_buffer(interpreter);
+
+    switch (instruction->opcode) {
+        case DBC_add:
+            dicelang_distrib_add_into(&tmp_distrib, RANGE_LAST(interpreter->values_stack, -1), RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+            break;
+        case DBC_substract:
+            dicelang_distrib_substract_into(&tmp_distrib, RANGE_LAST(interpreter->values_stack, -1), RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+            break;
+        default:
+            dicelang_distrib_multiply_into(&tmp_distrib, RANGE_LAST(interpreter->values_stack, -1), RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+            break;
     }
+
+    dicelang_interpreter_give_buffer(interpreter, &RANGE_LAST(interpreter->values_stack));
+    range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    dicelang_interpreter_give_buffer(interpreter, &RANGE_LAST(interpreter->values_stack));
+    range_pop(RANGE_TO_ANY(interpreter->values_stack));
+
+    dicelang_interpreter_push(interpreter, &tmp_distrib);
+
+    return nullptr;
 }
 
 /**
- * @brief
+ * @brief Replaces the value on top of the stack by the roll of a die with as many faces.
  *
+ * @param interpreter
+ * @param instruction
+ * @return Reason of the failure, or NULL.
  */
-static void dicelang_exec_routine_function_call(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static const char *dicelang_exec_dice(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
 {
-    struct dicelang_token indentifier = { };
-    struct dicelang_function called = { };
-    struct dicelang_distrib returned_value = { };
+    (void) instruction;
 
-    if (context->node->children->length == 0) {
-        return;
+    struct dicelang_distrib tmp_distrib = { };
+
+    if (interpreter->values_stack->length < 1) {
+        return "missing number of faces.";
     }
 
-    indentifier = context->node->children->data[0]->token;
+    tmp_distrib = dicelang_distrib_dice(RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
 
-    if (dicelang_function_map_get(interpreter->functions, indentifier.value.source, indentifier.value.source_length, &called)) {
+    dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+    range_pop(RANGE_TO_ANY(interpreter->values_stack));
 
-        if (called.nb_args != (interpreter->values_stack->length - context->values_stack_index)) {
-            return;
-        }
+    dicelang_interpreter_push(interpreter, &tmp_distrib);
 
-        if (called.returns_value) {
-            returned_value = dicelang_distrib_create_empty(interpreter->alloc);
-            called.func_impl(interpreter->values_stack->data + context->values_stack_index, &returned_value, interpreter->alloc);
-            range_push(RANGE_TO_ANY(interpreter->values_stack), &returned_value);
-        } else {
-            called.func_impl(interpreter->values_stack->data + context->values_stack_index, NULL, interpreter->alloc);
-        }
-    }
+    return nullptr;
 }
 
 /**
- * @brief
+ * @brief Calls a function with the values on top of the stack, and replaces them with its result if it is used.
  *
+ * @param interpreter
+ * @param instruction
+ * @return Reason of the failure, or NULL.
  */
-static void dicelang_exec_routine_variable_access(struct dicelang_interpreter *interpreter, struct dicelang_exec_context *context)
+static const char *dicelang_exec_call(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
 {
-    (void) interpreter;
-
-    struct dicelang_token indentifier = { };
-    struct dicelang_distrib var_value = { };
+    struct dicelang_distrib returned_value = { };
+    size_t first_arg = 0;
 
-    if (context->node->children->length == 0) {
-        return;
+    if (interpreter->values_stack->length < instruction->nb_args) {
+        return "missing argument.";
     }
 
-    indentifier = context->node->children->data[0]->token;
+    first_arg = interpreter->values_stack->length - instruction->nb_args;
 
-    if (dicelang_variable_map_get(interpreter->variables, indentifier.value.source, indentifier.value.source_length, &var_value, interpreter->alloc)) {
-        range_push(RANGE_TO_ANY(interpreter->values_stack), &var_value);
+    if (instruction->returns_value) {
+        returned_value = dicelang_distrib_create_empty(interpreter->temporaries);
+        instruction->function(interpreter->values_stack->data + first_arg, &returned_value, &interpreter->options, interpreter->temporaries);
+    } else {
+        instruction->function(interpreter->values_stack->data + first_arg, NULL, &interpreter->options, interpreter->temporaries);
     }
-}
 
-// -------------------------------------------------------------------------------------------------
-// -------------------------------------------------------------------------------------------------
+    while (interpreter->values_stack->length > first_arg) {
+        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+        range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    }
 
-static void dicelang_builtin_print(struct dicelang_distrib *input, struct dicelang_distrib *output, struct allocator alloc)
-{
-    (void) output;
-    (void) alloc;
+    if (instruction->keeps_result) {
+        dicelang_interpreter_push(interpreter, &returned_value);
+    } else {
+        dicelang_distrib_destroy(&returned_value, interpreter->temporaries);
+    }
 
-    size_t sum = 0;
-    size_t max = 0;
-    f32 ratio = 0.f;
-    f32 relative_ratio = 0.f;
+    return nullptr;
+}
 
-    for (size_t i = 0 ; i < input->values->length ; i++) {
-        sum += input->values->data[i].count;
+/**
+ * @brief Moves the value on top of the stack into a variable, releasing its previous value.
+ *
+ * @param interpreter
+ * @param instruction
+ * @return Reason of the failure, or NULL.
+ */
+static const char *dicelang_exec_store(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
+{
+    struct dicelang_distrib val = { };
 
-        if (input->values->data[i].count > max) {
-            max = input->values->data[i].count;
-        }
+    if (interpreter->values_stack->length < 1) {
+        return "missing assigned value.";
     }
 
-    printf("%ld ---\n", input->values->length);
-    for (size_t i = 0 ; i < input->values->length ; i++) {
-        ratio = (f32) input->values->data[i].count / (f32) sum;
-        relative_ratio = (f32) input->values->data[i].count / (f32) max;
+    val = RANGE_LAST(interpreter->values_stack);
 
-        printf("% 4d\t%.3f ", input->values->data[i].val, ratio);
+    // the value outlives the statement : it is moved out of the temporaries, unless it already is a variable's storage
+    if (!val.references) {
+        val = dicelang_distrib_copy(val, interpreter->alloc);
+        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+    }
+    range_pop(RANGE_TO_ANY(interpreter->values_stack));
 
-        for (size_t j = 0 ; j < (size_t) (relative_ratio * 40.) ; j++) {
-            printf("|");
+    // slots are given in order, so the first assignment of a variable usually appends a single one
+    if (instruction->slot >= interpreter->variables->length) {
+        interpreter->variables = range_ensure_capacity(interpreter->alloc, RANGE_TO_ANY(interpreter->variables), (instruction->slot + 1) - interpreter->variables->length);
+        for (size_t i = interpreter->variables->length ; i <= instruction->slot ; i++) {
+            range_push(RANGE_TO_ANY(interpreter->variables), &(struct dicelang_distrib) { });
         }
+    }
 
-        printf("\n");
+    if (instruction->slot >= interpreter->variables->length) {
+        dicelang_distrib_destroy(&val, interpreter->alloc);
+        return "could not store the variable.";
     }
+
+    dicelang_distrib_destroy(interpreter->variables->data + instruction->slot, interpreter->alloc);
+    interpreter->variables->data[instruction->slot] = val;
+
+    return nullptr;
 }
 
-static void dicelang_builtin_count(struct dicelang_distrib *input, struct dicelang_distrib *output, struct allocator alloc)
+/**
+ * @brief Ends a statement : values it left on the stack are released, and so are all temporaries it allocated.
+ *
+ * @param interpreter
+ * @param instruction
+ * @return Reason of the failure, or NULL.
+ */
+static const char *dicelang_exec_end_statement(struct dicelang_interpreter *interpreter, const struct dicelang_instruction *instruction)
 {
-    (void) input;
-    (void) output;
-    (void) alloc;
+    (void) instruction;
+
+    while (interpreter->values_stack->length > 0) {
+        dicelang_distrib_destroy(&RANGE_LAST(interpreter->values_stack), interpreter->temporaries);
+        range_pop(RANGE_TO_ANY(interpreter->values_stack));
+    }
+
+    // kept buffers live in the arena too
+    dicelang_interpreter_drop_buffers(interpreter);
+    dicelang_arena_reset(interpreter->arena);
 
+    return nullptr;
 }
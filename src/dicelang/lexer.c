@@ -8,250 +8,210 @@
  * @copyright Copyright (c) 2024
  *
  */
+
+#include <string.h>
+
 #include <dicelang.h>
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief Data representing some partial transition. Used to map a token flavour to some other token flavour in a transition array.
+ * @brief Classes of characters the lexer tells apart. Characters of a same class always lead to the same transitions.
  *
- * @see dicelang_token_definitions
+ * @see dicelang_char_classes
  */
-struct dicelang_token_transition {
-    enum dicelang_token_flavour to;
-    bool is_endpoint;
+enum dicelang_char_class {
+    DCHAR_other = 0,                ///< Character that cannot appear in a token.
+    DCHAR_end,                      ///< Text terminator.
+    DCHAR_newline,
+    DCHAR_letter,                   ///< Any letter, lower or upper case, except 'd'.
+    DCHAR_d,                        ///< Either the dice operator or a letter.
+    DCHAR_digit,
+    DCHAR_underscore,
+    DCHAR_colon,
+    DCHAR_comma,
+    DCHAR_plus,
+    DCHAR_minus,
+    DCHAR_star,
+    DCHAR_open_parenthesis,
+    DCHAR_close_parenthesis,
+    DCHAR_open_bracket,
+    DCHAR_close_bracket,
+    DCHAR_open_sq_bracket,
+    DCHAR_close_sq_bracket,
+
+    DCHAR_NUMBER,
 };
 
-/// Trap transition. Must translate to a zeroed-out transition !
-#define dicelang_token_no_transition (struct dicelang_token_transition) { .to = DTOK_invalid, .is_endpoint = false }
-/// Empty transition. Used as a starting point before parsing a token.
-#define dicelang_token_empty_transition (struct dicelang_token_transition) { .to = DTOK_empty, .is_endpoint = false }
+/**
+ * @brief States of the lexer while reading a token. States before DLEX_RUNS can read more characters, states after it are
+ * single-character tokens that end as soon as they are reached.
+ */
+enum dicelang_lexer_state {
+    DLEX_trap = 0,                  ///< No transition exists from the current state for the character read. Must be zero !
+    DLEX_start,                     ///< Nothing read yet.
+    DLEX_line_end,
+    DLEX_identifier,
+    DLEX_value,
+    DLEX_dice,                      ///< A lone 'd', that becomes an identifier if it is followed by a letter.
+
+    DLEX_RUNS,
+
+    DLEX_file_end = DLEX_RUNS,
+    DLEX_designator,
+    DLEX_separator,
+    DLEX_op_addition,
+    DLEX_op_substraction,
+    DLEX_op_multiplication,
+    DLEX_open_parenthesis,
+    DLEX_close_parenthesis,
+    DLEX_open_bracket,
+    DLEX_close_bracket,
+    DLEX_open_sq_bracket,
+    DLEX_close_sq_bracket,
+
+    DLEX_NUMBER,
+};
 
 /**
- * @brief Map from a character, to a token flavour, to a transition to another token flavour.
- * Accessing [c][tok] will give a transition to the valid token that the language knows of. If there is none, a dicelang_token_no_transition is given.
+ * @brief Map from a character to its class. Characters the language does not use are DCHAR_other.
  */
-static const struct dicelang_token_transition dicelang_token_definitions[][DTOK_NUMBER] = {
-        ['\0']  = { [DTOK_empty] = { DTOK_file_end, true } },
-
-        ['\n']  = { [DTOK_empty] = { DTOK_line_end, true },
-                    [DTOK_line_end] = { DTOK_line_end, true } },
-
-        ['a']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['b']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['c']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-
-        ['d']   = { [DTOK_empty]        = { DTOK_op_d, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-
-        ['e']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['f']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['g']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['h']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['i']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['j']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['k']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['l']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['m']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['n']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['o']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['p']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['q']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['r']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['s']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['t']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['u']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['v']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['w']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['x']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['y']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['z']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-
-        ['A']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['B']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['C']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['D']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['E']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['F']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['G']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['H']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['I']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['J']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['K']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['L']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['M']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['N']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['O']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['P']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['Q']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['R']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['S']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['T']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['U']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['V']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['W']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['X']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['Y']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-        ['Z']   = { [DTOK_empty]        = { DTOK_identifier, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-
-        ['0']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['1']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['2']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['3']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['4']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['5']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['6']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['7']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['8']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-        ['9']   = { [DTOK_empty]        = { DTOK_value, true },
-                    [DTOK_value]        = { DTOK_value, true },
-                    [DTOK_identifier]   = { DTOK_identifier, true } },
-
-
-        ['_']   = { [DTOK_identifier]   = { DTOK_identifier, true },
-                    [DTOK_op_d]            = { DTOK_identifier, true } },
-
-        [':']   = { [DTOK_empty] = { DTOK_designator,     true } },
-        [',']   = { [DTOK_empty] = { DTOK_separator,      true } },
-        ['+']   = { [DTOK_empty] = { DTOK_op_addition,       true } },
-        ['-']   = { [DTOK_empty] = { DTOK_op_substraction,   true } },
-        ['*']   = { [DTOK_empty] = { DTOK_op_multiplication, true } },
-
-        ['(']   = { [DTOK_empty] = { DTOK_open_parenthesis,  true } },
-        [')']   = { [DTOK_empty] = { DTOK_close_parenthesis, true } },
-        ['{']   = { [DTOK_empty] = { DTOK_open_bracket,      true } },
-        ['}']   = { [DTOK_empty] = { DTOK_close_bracket,     true } },
-        ['[']   = { [DTOK_empty] = { DTOK_open_sq_bracket,   true } },
-        [']']   = { [DTOK_empty] = { DTOK_close_sq_bracket,  true } },
+static const u8 dicelang_char_classes[256] = {
+        ['\0'] = DCHAR_end,
+        ['\n'] = DCHAR_newline,
+
+        ['a'] = DCHAR_letter, ['b'] = DCHAR_letter, ['c'] = DCHAR_letter, ['d'] = DCHAR_d,      ['e'] = DCHAR_letter,
+        ['f'] = DCHAR_letter, ['g'] = DCHAR_letter, ['h'] = DCHAR_letter, ['i'] = DCHAR_letter, ['j'] = DCHAR_letter,
+        ['k'] = DCHAR_letter, ['l'] = DCHAR_letter, ['m'] = DCHAR_letter, ['n'] = DCHAR_letter, ['o'] = DCHAR_letter,
+        ['p'] = DCHAR_letter, ['q'] = DCHAR_letter, ['r'] = DCHAR_letter, ['s'] = DCHAR_letter, ['t'] = DCHAR_letter,
+        ['u'] = DCHAR_letter, ['v'] = DCHAR_letter, ['w'] = DCHAR_letter, ['x'] = DCHAR_letter, ['y'] = DCHAR_letter,
+        ['z'] = DCHAR_letter,
+
+        ['A'] = DCHAR_letter, ['B'] = DCHAR_letter, ['C'] = DCHAR_letter, ['D'] = DCHAR_letter, ['E'] = DCHAR_letter,
+        ['F'] = DCHAR_letter, ['G'] = DCHAR_letter, ['H'] = DCHAR_letter, ['I'] = DCHAR_letter, ['J'] = DCHAR_letter,
+        ['K'] = DCHAR_letter, ['L'] = DCHAR_letter, ['M'] = DCHAR_letter, ['N'] = DCHAR_letter, ['O'] = DCHAR_letter,
+        ['P'] = DCHAR_letter, ['Q'] = DCHAR_letter, ['R'] = DCHAR_letter, ['S'] = DCHAR_letter, ['T'] = DCHAR_letter,
+        ['U'] = DCHAR_letter, ['V'] = DCHAR_letter, ['W'] = DCHAR_letter, ['X'] = DCHAR_letter, ['Y'] = DCHAR_letter,
+        ['Z'] = DCHAR_letter,
+
+        ['0'] = DCHAR_digit, ['1'] = DCHAR_digit, ['2'] = DCHAR_digit, ['3'] = DCHAR_digit, ['4'] = DCHAR_digit,
+        ['5'] = DCHAR_digit, ['6'] = DCHAR_digit, ['7'] = DCHAR_digit, ['8'] = DCHAR_digit, ['9'] = DCHAR_digit,
+
+        ['_'] = DCHAR_underscore,
+
+        [':'] = DCHAR_colon,
+        [','] = DCHAR_comma,
+        ['+'] = DCHAR_plus,
+        ['-'] = DCHAR_minus,
+        ['*'] = DCHAR_star,
+
+        ['('] = DCHAR_open_parenthesis,
+        [')'] = DCHAR_close_parenthesis,
+        ['{'] = DCHAR_open_bracket,
+        ['}'] = DCHAR_close_bracket,
+        ['['] = DCHAR_open_sq_bracket,
+        [']'] = DCHAR_close_sq_bracket,
 };
 
+/**
+ * @brief Map from a lexer state, to a class of character, to the state reached by reading such a character.
+ * Only states that can read more characters have a row. A missing transition is a DLEX_trap.
+ */
+_Alignas(64) static const u8 dicelang_token_transitions[DLEX_RUNS][DCHAR_NUMBER] = {
+        [DLEX_start] = {
+                [DCHAR_end]     = DLEX_file_end,
+                [DCHAR_newline] = DLEX_line_end,
+                [DCHAR_letter]  = DLEX_identifier,
+                [DCHAR_d]       = DLEX_dice,
+                [DCHAR_digit]   = DLEX_value,
+
+                [DCHAR_colon]   = DLEX_designator,
+                [DCHAR_comma]   = DLEX_separator,
+                [DCHAR_plus]    = DLEX_op_addition,
+                [DCHAR_minus]   = DLEX_op_substraction,
+                [DCHAR_star]    = DLEX_op_multiplication,
+
+                [DCHAR_open_parenthesis]  = DLEX_open_parenthesis,
+                [DCHAR_close_parenthesis] = DLEX_close_parenthesis,
+                [DCHAR_open_bracket]      = DLEX_open_bracket,
+                [DCHAR_close_bracket]     = DLEX_close_bracket,
+                [DCHAR_open_sq_bracket]   = DLEX_open_sq_bracket,
+                [DCHAR_close_sq_bracket]  = DLEX_close_sq_bracket,
+        },
+
+        [DLEX_line_end] = {
+                [DCHAR_newline] = DLEX_line_end,
+        },
+
+        [DLEX_identifier] = {
+                [DCHAR_letter]     = DLEX_identifier,
+                [DCHAR_d]          = DLEX_identifier,
+                [DCHAR_digit]      = DLEX_identifier,
+                [DCHAR_underscore] = DLEX_identifier,
+        },
+
+        [DLEX_value] = {
+                [DCHAR_digit] = DLEX_value,
+        },
+
+        [DLEX_dice] = {
+                [DCHAR_letter]     = DLEX_identifier,
+                [DCHAR_d]          = DLEX_identifier,
+                [DCHAR_underscore] = DLEX_identifier,
+        },
+};
+
+/**
+ * @brief Map from a lexer state to the token flavour it ends on. The trap and start states do not end a valid token.
+ */
+static const u8 dicelang_token_flavours[DLEX_NUMBER] = {
+        [DLEX_trap]              = DTOK_invalid,
+        [DLEX_start]             = DTOK_invalid,
+        [DLEX_line_end]          = DTOK_line_end,
+        [DLEX_identifier]        = DTOK_identifier,
+        [DLEX_value]             = DTOK_value,
+        [DLEX_dice]              = DTOK_op_d,
+
+        [DLEX_file_end]          = DTOK_file_end,
+        [DLEX_designator]        = DTOK_designator,
+        [DLEX_separator]         = DTOK_separator,
+        [DLEX_op_addition]       = DTOK_op_addition,
+        [DLEX_op_substraction]   = DTOK_op_substraction,
+        [DLEX_op_multiplication] = DTOK_op_multiplication,
+        [DLEX_open_parenthesis]  = DTOK_open_parenthesis,
+        [DLEX_close_parenthesis] = DTOK_close_parenthesis,
+        [DLEX_open_bracket]      = DTOK_open_bracket,
+        [DLEX_close_bracket]     = DTOK_close_bracket,
+        [DLEX_open_sq_bracket]   = DTOK_open_sq_bracket,
+        [DLEX_close_sq_bracket]  = DTOK_close_sq_bracket,
+};
+
+/// Average length of a token and the blanks after it, used to guess the number of tokens in a text.
+#define DICELANG_TOKEN_EXPECTED_LENGTH (4u)
+
+/// Byte with only its lowest bit set, in each of the bytes of a word.
+#define DICELANG_SWAR_ONES (0x0101010101010101ull)
+/// Byte with only its highest bit set, in each of the bytes of a word.
+#define DICELANG_SWAR_HIGHS (0x8080808080808080ull)
+
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 // Reads one token from a string and consumes the characters read.
-static struct dicelang_token dicelang_token_read(const char **text, u32 line, u32 col);
+static struct dicelang_token dicelang_token_read(const char **text, const char *text_end);
+
+// Skips the characters that keep the lexer in the same identifier or value state.
+static const char *dicelang_token_skip_run(const char *text, const char *text_end, u8 state);
+// Skips whitespaces and comments.
+static const char *dicelang_token_skip_blanks(const char *text, const char *text_end);
+
+// Loads eight characters of a text at once.
+static inline u64 dicelang_swar_load(const char *text);
+// Marks the bytes of a word that are in some range of ascii characters.
+static inline u64 dicelang_swar_between(u64 word, u8 low, u8 high);
+// Counts the characters before the first marked byte of a word.
+static inline size_t dicelang_swar_first(u64 marks);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
@@ -270,8 +230,8 @@ RANGE_TOKEN *dicelang_tokenize(const char *source_code, struct dicelang_error *e
 {
     RANGE_TOKEN *read_tokens = nullptr;
     struct dicelang_token tok = { .flavour = DTOK_empty };
-    u32 line = 1u;
-    u32 col = 1u;
+    u8 previous_flavour = DTOK_line_end;
+    const char *source_end = nullptr;
 
     if (!source_code) {
         error_sink->flavour = DERR_INTERNAL;
@@ -279,41 +239,38 @@ RANGE_TOKEN *dicelang_tokenize(const char *source_code, struct dicelang_error *e
         return nullptr;
     }
 
-    read_tokens = range_create_dynamic(alloc, sizeof(*read_tokens->data), 512u);
+    // the scanners read several characters at once, and must know where to stop
+    source_end = source_code + strlen(source_code);
+    read_tokens = range_create_dynamic(alloc, sizeof(*read_tokens->data), ((size_t) (source_end - source_code) / DICELANG_TOKEN_EXPECTED_LENGTH) + 16u);
+    if (!read_tokens) {
+        error_sink->flavour = DERR_INTERNAL;
+        error_sink->what = "could not allocate the memory to tokenize the program.";
+        return nullptr;
+    }
 
     while ((tok.flavour != DTOK_invalid) && (tok.flavour != DTOK_file_end)) {
         // skipping whitespaces & comments
-        while ((*source_code == ' ') || (*source_code == '\t') || (*source_code == '#')) {
-            // whitespaces until some other char
-            if ((*source_code == ' ') || (*source_code == '\t')) {
-                source_code += 1;
-                col += 1;
-            }
-            // comments until end of line
-            if (*source_code == '#') {
-                while (*source_code && (*source_code != '\n')) {
-                    source_code += 1;
-                }
-            }
-        }
+        source_code = dicelang_token_skip_blanks(source_code, source_end);
 
         // one token read at a time
-        tok = dicelang_token_read(&source_code, line, col);
-
-        // updating the line / column pair
-        if (tok.flavour == DTOK_line_end) {
-            col = 1;
-            line += tok.value.source_length;
-        } else {
-            col += tok.value.source_length;
+        tok = dicelang_token_read(&source_code, source_end);
+
+        // repeating newlines, and the ones starting the text, are dropped
+        if ((tok.flavour == DTOK_line_end) && (previous_flavour == DTOK_line_end)) {
+            continue;
         }
+        previous_flavour = tok.flavour;
 
-        if ((tok.flavour != DTOK_line_end)
-            || (read_tokens->length && (read_tokens->data[read_tokens->length-1].flavour != DTOK_line_end))) {
-            // adding the token in the range if not a repeating newline
-            read_tokens = range_ensure_capacity(alloc, RANGE_TO_ANY(read_tokens), 1u);
-            range_push(RANGE_TO_ANY(read_tokens), &tok);
+        if (read_tokens->length == read_tokens->capacity) {
+            read_tokens = range_ensure_capacity(alloc, RANGE_TO_ANY(read_tokens), read_tokens->capacity);
         }
+        if (read_tokens->length == read_tokens->capacity) {
+            error_sink->flavour = DERR_INTERNAL;
+            error_sink->what = "could not allocate the memory to tokenize the program.";
+            return read_tokens;
+        }
+        read_tokens->data[read_tokens->length] = tok;
+        read_tokens->length += 1;
     }
 
     if (tok.flavour == DTOK_invalid) {
@@ -325,24 +282,35 @@ RANGE_TOKEN *dicelang_tokenize(const char *source_code, struct dicelang_error *e
     return read_tokens;
 }
 
+
 /**
  * @brief Prints a range of token to a file.
  * For debug purposes.
  *
  * @param[in] tokens
+ * @param[in] source_code Text the tokens were read from.
  * @param[in] to_file
  */
-void dicelang_token_dump(RANGE_TOKEN *tokens, FILE *to_file)
+void dicelang_token_dump(RANGE_TOKEN *tokens, const char *source_code, FILE *to_file)
 {
-    if (!tokens) {
+    struct dicelang_position where = { .line = 1u, .col = 1u };
+    const char *read_up_to = source_code;
+
+    if (!tokens || !source_code) {
         return;
     }
 
+    // tokens are in the order of the text, so their positions are found in one pass
     for (size_t i = 0u ; i < tokens->length ; i++) {
-        dicelang_token_print(tokens->data[i], to_file);
+        if (tokens->data[i].source) {
+            where = dicelang_position_advance(where, read_up_to, tokens->data[i].source);
+            read_up_to = tokens->data[i].source;
+        }
+        dicelang_token_print(tokens->data[i], where, to_file);
     }
 }
 
+
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
@@ -350,45 +318,171 @@ void dicelang_token_dump(RANGE_TOKEN *tokens, FILE *to_file)
  * @brief Reads one token from a string, and consumes the character(s) representing this token.
  *
  * @param[inout] text Actual script from which the token is read.
- * @param[in] line Line we are at, very nicely, generously and fabulously provided by the caller.
- * @param[in] col Column we are at, very nicely, generously and fabulously provided by the caller.
+ * @param[in] text_end Terminator of the script.
  * @return struct DTOK
  */
-static struct dicelang_token dicelang_token_read(const char **text, u32 line, u32 col)
+static struct dicelang_token dicelang_token_read(const char **text, const char *text_end)
 {
-    struct dicelang_token_transition current_transition = dicelang_token_empty_transition;
-    struct dicelang_token_transition next_transition = dicelang_token_no_transition;
+    u8 state = DLEX_start;
+    u8 next_state = DLEX_trap;
     const char *value = nullptr;
 
     if(!text || !*text) {
-        return (struct dicelang_token) { .flavour = DTOK_invalid, .where = { line, col } };
+        return (struct dicelang_token) { .flavour = DTOK_invalid };
     }
 
     value = *text;
 
     do {
         // fetching the eventual transition
-        next_transition = dicelang_token_definitions[(size_t) **text][current_transition.to];
+        next_state = dicelang_token_transitions[state][dicelang_char_classes[(unsigned char) **text]];
 
-        // no transition exists, we are either at the end of a valid token (.is_endpoint is set) or a syntax error occurred.
-        if (next_transition.to == DTOK_invalid) {
+        // no transition exists, we are either at the end of a valid token or a syntax error occurred.
+        if (next_state == DLEX_trap) {
             break;
         }
 
         // happy path, we advance through the token
         *text += 1;
-        current_transition = next_transition;
-    } while (**text != '\0');
+        state = next_state;
+
+        // identifiers and values do not change state until their end, so they are read in bulk
+        if ((state == DLEX_identifier) || (state == DLEX_value)) {
+            *text = dicelang_token_skip_run(*text, text_end, state);
+        }
+    } while (state < DLEX_RUNS);
 
     // actual token is valid !
-    if (current_transition.is_endpoint) {
+    if (state != DLEX_start) {
         return (struct dicelang_token) {
-                .flavour = current_transition.to,
-                .value = { value, (uintptr_t) *text - (uintptr_t) value },
-                .where = { line, col }
+                .flavour = dicelang_token_flavours[state],
+                .source = value,
+                .source_length = (u32) (*text - value),
         };
     }
 
-    // syntax error....
-    return (struct dicelang_token) { .flavour = DTOK_invalid, .where = { line, col } };
+    // syntax error.... the token is empty, but still locates the error
+    return (struct dicelang_token) { .flavour = DTOK_invalid, .source = value };
+}
+
+/**
+ * @brief Skips the characters that an identifier or a value can be made of, eight at a time while the text is long enough.
+ *
+ * @param[in] text
+ * @param[in] text_end Terminator of the text.
+ * @param[in] state Either DLEX_identifier or DLEX_value.
+ * @return const char* First character that would end the token.
+ */
+static const char *dicelang_token_skip_run(const char *text, const char *text_end, u8 state)
+{
+    u64 word = 0;
+    u64 inside = 0;
+
+    while (text_end - text >= (ptrdiff_t) sizeof(word)) {
+        word = dicelang_swar_load(text);
+
+        inside = dicelang_swar_between(word, '0', '9');
+        if (state == DLEX_identifier) {
+            inside |= dicelang_swar_between(word, 'a', 'z') | dicelang_swar_between(word, 'A', 'Z') | dicelang_swar_between(word, '_', '_');
+        }
+
+        if (inside != DICELANG_SWAR_HIGHS) {
+            return text + dicelang_swar_first(~inside & DICELANG_SWAR_HIGHS);
+        }
+        text += sizeof(word);
+    }
+
+    while (dicelang_token_transitions[state][dicelang_char_classes[(unsigned char) *text]] == state) {
+        text += 1;
+    }
+
+    return text;
+}
+
+/**
+ * @brief Skips spaces, tabulations, and comments up to their line end.
+ *
+ * @param[in] text
+ * @param[in] text_end Terminator of the text.
+ * @return const char* First character of the next token.
+ */
+static const char *dicelang_token_skip_blanks(const char *text, const char *text_end)
+{
+    u64 word = 0;
+    u64 blanks = 0;
+    const char *line_end = nullptr;
+
+    while (true) {
+        while (text_end - text >= (ptrdiff_t) sizeof(word)) {
+            word = dicelang_swar_load(text);
+            blanks = dicelang_swar_between(word, ' ', ' ') | dicelang_swar_between(word, '\t', '\t');
+
+            if (blanks != DICELANG_SWAR_HIGHS) {
+                text += dicelang_swar_first(~blanks & DICELANG_SWAR_HIGHS);
+                break;
+            }
+            text += sizeof(word);
+        }
+
+        while ((*text == ' ') || (*text == '\t')) {
+            text += 1;
+        }
+
+        if (*text != '#') {
+            return text;
+        }
+
+        // comments until end of line
+        line_end = memchr(text, '\n', (size_t) (text_end - text));
+        text = line_end ? line_end : text_end;
+    }
+}
+
+/**
+ * @brief
+ *
+ * @param[in] text At least eight characters.
+ * @return u64
+ */
+static inline u64 dicelang_swar_load(const char *text)
+{
+    u64 word = 0;
+
+    memcpy(&word, text, sizeof(word));
+
+    return word;
+}
+
+/**
+ * @brief Sets the highest bit of the bytes of a word that are between two ascii characters (included), and clears everything else.
+ * Bytes out of the ascii range are never marked.
+ *
+ * @param[in] word
+ * @param[in] low Lowest character of the range, under 128.
+ * @param[in] high Highest character of the range, under 128.
+ * @return u64
+ */
+static inline u64 dicelang_swar_between(u64 word, u8 low, u8 high)
+{
+    // with their highest bit set, none of the bytes can borrow from the next one
+    u64 lifted = (word & ~DICELANG_SWAR_HIGHS) | DICELANG_SWAR_HIGHS;
+    u64 at_least_low = lifted - (DICELANG_SWAR_ONES * low);
+    u64 above_high = lifted - (DICELANG_SWAR_ONES * (u64) (high + 1));
+
+    return at_least_low & ~above_high & ~word & DICELANG_SWAR_HIGHS;
+}
+
+/**
+ * @brief
+ *
+ * @param[in] marks Word with at least one byte marked by its highest bit.
+ * @return size_t
+ */
+static inline size_t dicelang_swar_first(u64 marks)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (size_t) __builtin_clzll(marks) / 8;
+#else
+    return (size_t) __builtin_ctzll(marks) / 8;
+#endif
 }
@@ -8,159 +8,258 @@
  * @copyright Copyright (c) 2024
  *
  */
+#include <stdio.h>
+
 #include <ustd/range.h>
+#include <ustd/testutilities.h>
 
 #include <dicelang.h>
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-static struct dicelang_parse_node *dicelang_parse_node_create(struct dicelang_token token, struct dicelang_parse_node *parent, struct allocator alloc);
+/**
+ * @brief Grammar rules, each parsed by the function of the same name.
+ */
+enum dicelang_parse_rule {
+    DPARSE_none = 0,            ///< No rule. Returned by a rule that is done.
+    DPARSE_statement,
+    DPARSE_assignment,
+    DPARSE_function_call,
+    DPARSE_addition,
+    DPARSE_multiplication,
+    DPARSE_operand,
+    DPARSE_dice,
+    DPARSE_expr_set,
+    DPARSE_var_access,
+};
+
+/**
+ * @brief A grammar rule being parsed. A rule nested in another one is a frame pushed over the other's instead of a recursive call,
+ * so nesting expressions only grows the frames range.
+ */
+struct dicelang_parse_frame {
+    u8 rule;
+    /** How far the rule went. The rule's function resumes from there once the nested rule is done. Rules looping over any
+    number of terms only tell their first entry from the others, so the step never counts the terms. */
+    u8 step;
+    /** Node the rule is created under. */
+    u32 parent;
+    /** Node the rule created. */
+    u32 node;
+};
+
+/**
+ * @brief State of a parse : position of the parser in the tokens it reads, and the tree built so far.
+ * Tokens are consumed by moving the position forward, the tokens themselves are left untouched.
+ */
+struct dicelang_parser {
+    const RANGE_TOKEN *tokens;
+    size_t position;
+
+    RANGE_PARSE_NODE *tree;
+    /** Set when the tree could not grow, in which case it misses some nodes. */
+    bool out_of_memory;
+
+    /** Rules being parsed, the innermost last. */
+    RANGE(struct dicelang_parse_frame) *frames;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static u32 dicelang_parse_node_create(struct dicelang_parser *parser, struct dicelang_token token, u32 parent, struct allocator alloc);
 
 // -------------------------------------------------------------------------------------------------
 
-static bool expect(RANGE_TOKEN *tokens, enum dicelang_token_flavour what, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static bool accept(RANGE_TOKEN *tokens, enum dicelang_token_flavour what, struct dicelang_parse_node *parent, struct allocator alloc);
-static bool lookup(const RANGE_TOKEN *tokens, size_t offset, enum dicelang_token_flavour what);
+static bool expect(struct dicelang_parser *parser, enum dicelang_token_flavour what, u32 parent, struct dicelang_error *error_sink, struct allocator alloc);
+static bool accept(struct dicelang_parser *parser, enum dicelang_token_flavour what, u32 parent, struct allocator alloc);
+static bool lookup(const struct dicelang_parser *parser, size_t offset, enum dicelang_token_flavour what);
 
 // -------------------------------------------------------------------------------------------------
 
-static void statement     (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void assignment    (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void function_call (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void addition      (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void dice          (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void multiplication(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void operand       (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void expr_set      (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
-static void var_access    (RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc);
+static void dicelang_parse_rule(struct dicelang_parser *parser, enum dicelang_parse_rule rule, u32 parent, struct dicelang_error *error_sink, struct allocator alloc);
+
+static enum dicelang_parse_rule statement     (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule assignment    (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule function_call (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule addition      (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule dice          (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule multiplication(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule operand       (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule expr_set      (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
+static enum dicelang_parse_rule var_access    (struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief Constructs a tree of syntax nodes by consuming a set of tokens, and returns its root node.
+ * @brief Constructs a tree of syntax nodes by consuming a set of tokens. All the nodes are stored in the returned range, the root first.
  *
- * @param[inout] tokens Range of tokens describing a program. The range will be emptied but not deallocated.
+ * @param[in] tokens Range of tokens describing a program. The range is read but left untouched.
  * @param[inout] error Error sink that might be filled with some parsing error after the function return. Cannot be NULL !
  * @param[in] alloc Allocator used to create the tree.
  *
- * @return struct dicelang_parse_node *
+ * @return RANGE_PARSE_NODE *
  */
-struct dicelang_parse_node *dicelang_parse(RANGE_TOKEN *tokens, struct dicelang_error *error_sink, struct allocator alloc)
+RANGE_PARSE_NODE *dicelang_parse(const RANGE_TOKEN *tokens, struct dicelang_error *error_sink, struct allocator alloc)
 {
+    struct dicelang_parser parser = { .tokens = tokens, .position = 0 };
+    u32 program = DICELANG_PARSE_NODE_NONE;
+
     if (!tokens) {
         error_sink->flavour = DERR_INTERNAL;
         error_sink->what = "Tried to parse null-ed tokens.";
         return nullptr;
     }
 
-    struct dicelang_parse_node *program = dicelang_parse_node_create((struct dicelang_token) { .flavour = DSTX_program }, nullptr, alloc);
+    // most tokens end up wrapped in a couple of syntax nodes
+    parser.tree = range_create_dynamic(alloc, sizeof(*parser.tree->data), (2 * tokens->length) + 1);
+    parser.frames = range_create_dynamic(alloc, sizeof(*parser.frames->data), 32);
+    if (!parser.frames) {
+        parser.out_of_memory = true;
+    }
+    program = dicelang_parse_node_create(&parser, (struct dicelang_token) { .flavour = DSTX_program }, DICELANG_PARSE_NODE_NONE, alloc);
 
-    accept(tokens, DTOK_line_end, program, alloc);
-    statement(tokens, program, error_sink, alloc);
+    accept(&parser, DTOK_line_end, program, alloc);
+    dicelang_parse_rule(&parser, DPARSE_statement, program, error_sink, alloc);
 
-    while (accept(tokens, DTOK_line_end, program, alloc)) {
-        if (!lookup(tokens, 0, DTOK_file_end)) {
-            statement(tokens, program, error_sink, alloc);
+    // nothing is read past the first error
+    while ((error_sink->flavour == DERR_NONE) && accept(&parser, DTOK_line_end, program, alloc)) {
+        if (!lookup(&parser, 0, DTOK_file_end)) {
+            dicelang_parse_rule(&parser, DPARSE_statement, program, error_sink, alloc);
         }
     }
 
-    expect(tokens, DTOK_file_end, program, error_sink, alloc);
+    expect(&parser, DTOK_file_end, program, error_sink, alloc);
+
+    if (parser.out_of_memory && (error_sink->flavour == DERR_NONE)) {
+        error_sink->flavour = DERR_INTERNAL;
+        error_sink->what = "parser could not allocate the tree.";
+    }
+
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(parser.frames));
 
-    return program;
+    return parser.tree;
 }
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief Recursively prints a parse tree to some file.
+ * @brief Prints a parse tree to some file, depth-wise. The tree is walked through the links between its nodes.
  *
- * @param[in] node Node to print from.
+ * @param[in] tree Tree to print.
+ * @param[in] source_code Text the tree was parsed from.
  * @param[in] to_file Target stream.
  */
-void dicelang_parse_node_dump(const struct dicelang_parse_node *node, FILE *to_file)
+void dicelang_parse_node_dump(const RANGE_PARSE_NODE *tree, const char *source_code, FILE *to_file)
 {
-    if (!node) {
+    u32 node = 0;
+
+    if (!tree || (tree->length == 0)) {
         return;
     }
 
-    dicelang_parse_node_print(node, to_file);
-
-    for (size_t i = 0 ; i < node->children->length ; i++) {
-        dicelang_parse_node_dump(node->children->data[i], to_file);
+    while (node != DICELANG_PARSE_NODE_NONE) {
+        dicelang_parse_node_print(tree, node, source_code, to_file);
+
+        if (tree->data[node].first_child != DICELANG_PARSE_NODE_NONE) {
+            node = tree->data[node].first_child;
+        } else {
+            // climbing back up to the first ancestor with some sibling left
+            while ((node != DICELANG_PARSE_NODE_NONE) && (tree->data[node].next_sibling == DICELANG_PARSE_NODE_NONE)) {
+                node = tree->data[node].parent;
+            }
+            if (node != DICELANG_PARSE_NODE_NONE) {
+                node = tree->data[node].next_sibling;
+            }
+        }
     }
 }
 
 /**
- * @brief Recursively prints a parse tree to some file.
+ * @brief Prints a single node of a parse tree to some file, with its number of children.
  *
- * @param[in] node Node to print.
+ * @param[in] tree Tree the node belongs to.
+ * @param[in] node Index of the node to print.
+ * @param[in] source_code Text the tree was parsed from.
  * @param[in] to_file Target stream.
  */
-void dicelang_parse_node_print(const struct dicelang_parse_node *node, FILE *to_file)
+void dicelang_parse_node_print(const RANGE_PARSE_NODE *tree, u32 node, const char *source_code, FILE *to_file)
 {
-    if (!node) {
+    u32 nb_children = 0;
+
+    if (!tree || (node >= tree->length)) {
         return;
     }
 
-    fprintf(to_file, "[%ld]\t", node->children->length);
-    dicelang_token_print(node->token, to_file);
+    for (u32 child = tree->data[node].first_child ; child != DICELANG_PARSE_NODE_NONE ; child = tree->data[child].next_sibling) {
+        nb_children += 1;
+    }
+
+    fprintf(to_file, "[%u]\t", nb_children);
+    dicelang_token_print(tree->data[node].token, dicelang_token_position(tree->data[node].token, source_code), to_file);
 }
 
 /**
- * @brief Recursively destroys a parse tree, releasing the memory used by a node and all its children.
+ * @brief Destroys a parse tree. All of its nodes being stored together, they are released at once.
  *
- * @param[inout] node Node holding the memory to release.
+ * @param[inout] tree Tree holding the memory to release.
  * @param[in] alloc Allocator previously used to build the parse tree.
  */
-void dicelang_parse_node_destroy(struct dicelang_parse_node **node, struct allocator alloc)
+void dicelang_parse_node_destroy(RANGE_PARSE_NODE **tree, struct allocator alloc)
 {
-    if (!node || !*node) {
+    if (!tree) {
         return;
     }
 
-    for (size_t i = 0 ; i < (*node)->children->length ; i++) {
-        dicelang_parse_node_destroy((*node)->children->data + i, alloc);
-    }
-
-    range_destroy_dynamic(alloc, &RANGE_TO_ANY((*node)->children));
-    alloc.free(alloc, *node);
-
-    *node = nullptr;
+    range_destroy_dynamic(alloc, &RANGE_TO_ANY(*tree));
 }
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
 /**
- * @brief Creates a new syntax node representing a token.
- * It may be linked to a parent node, in which case this parent's node will have its children collection modified, and maybe reallocated.
+ * @brief Creates a new syntax node representing a token, at the end of the tree being built.
+ * It may be linked to a parent node, in which case it becomes the last of this parent's children.
  *
+ * @param[inout] parser
  * @param[in] token
- * @param[inout] parent
+ * @param[in] parent Index of the parent node, or DICELANG_PARSE_NODE_NONE.
  * @param[in] alloc
- * @return struct dicelang_parse_node*
+ * @return Index of the new node, or DICELANG_PARSE_NODE_NONE if the tree could not grow.
  */
-static struct dicelang_parse_node *dicelang_parse_node_create(struct dicelang_token token, struct dicelang_parse_node *parent, struct allocator alloc)
+static u32 dicelang_parse_node_create(struct dicelang_parser *parser, struct dicelang_token token, u32 parent, struct allocator alloc)
 {
-    struct dicelang_parse_node *new_node = alloc.malloc(alloc, sizeof(*new_node));
+    u32 new_node = DICELANG_PARSE_NODE_NONE;
 
-    if (!new_node) {
-        return nullptr;
+    if (parser->tree && (parser->tree->length == parser->tree->capacity)) {
+        parser->tree = range_ensure_capacity(alloc, RANGE_TO_ANY(parser->tree), parser->tree->capacity);
+    }
+    if (!parser->tree || (parser->tree->length == parser->tree->capacity) || (parser->tree->length >= DICELANG_PARSE_NODE_NONE)) {
+        parser->out_of_memory = true;
+        return DICELANG_PARSE_NODE_NONE;
     }
 
-    *new_node = (struct dicelang_parse_node) {
+    new_node = (u32) parser->tree->length;
+    parser->tree->data[new_node] = (struct dicelang_parse_node) {
             .token = token,
 
             .parent = parent,
-            .children = range_create_dynamic(alloc, sizeof(*new_node->children->data), 8),
+            .first_child = DICELANG_PARSE_NODE_NONE,
+            .last_child = DICELANG_PARSE_NODE_NONE,
+            .next_sibling = DICELANG_PARSE_NODE_NONE,
     };
+    parser->tree->length += 1;
 
-    if (parent) {
-        parent->children = range_ensure_capacity(alloc, RANGE_TO_ANY(parent->children), 1);
-        range_push(RANGE_TO_ANY(parent->children), &new_node);
+    if (parent != DICELANG_PARSE_NODE_NONE) {
+        if (parser->tree->data[parent].last_child == DICELANG_PARSE_NODE_NONE) {
+            parser->tree->data[parent].first_child = new_node;
+        } else {
+            parser->tree->data[parser->tree->data[parent].last_child].next_sibling = new_node;
+        }
+        parser->tree->data[parent].last_child = new_node;
     }
 
     return new_node;
@@ -172,9 +271,8 @@ static struct dicelang_parse_node *dicelang_parse_node_create(struct dicelang_to
 /**
  * @brief Requires that the leading token in the set is of some flavour. If not, a syntax error is generated.
  * On success, this will consume the leading token and add a new child node under the supplied parent.
- * In this case, if the parent is null, no node will be created but the leading token will still be removed.
  *
- * @param[inout] tokens
+ * @param[inout] parser
  * @param[in] what
  * @param[in] parent
  * @param[inout] error_sink
@@ -182,19 +280,19 @@ static struct dicelang_parse_node *dicelang_parse_node_create(struct dicelang_to
  * @return true
  * @return false
  */
-static bool expect(RANGE_TOKEN *tokens, enum dicelang_token_flavour what, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static bool expect(struct dicelang_parser *parser, enum dicelang_token_flavour what, u32 parent, struct dicelang_error *error_sink, struct allocator alloc)
 {
     if (error_sink->flavour != DERR_NONE) {
         return false;
     }
 
-    if (accept(tokens, what, parent, alloc)) {
+    if (accept(parser, what, parent, alloc)) {
         return true;
     }
 
     error_sink->flavour = DERR_SYNTAX;
-    if (tokens && (tokens->length > 0)) {
-        error_sink->token = tokens->data[0];
+    if (parser->position < parser->tokens->length) {
+        error_sink->token = parser->tokens->data[parser->position];
         error_sink->what = "unexpected token";
     } else {
         error_sink->token = (struct dicelang_token) { };
@@ -207,23 +305,22 @@ static bool expect(RANGE_TOKEN *tokens, enum dicelang_token_flavour what, struct
 /**
  * @brief Tries to match the leading token against some flavour, without creating an error on failure.
  * On success, this will consume the leading token and add a new child node under the supplied parent.
- * In this case, if the parent is null, no node will be created but the leading token will still be removed.
+ * Nothing is consumed under a missing parent.
  *
- * @param[inout] tokens
+ * @param[inout] parser
  * @param[in] what
  * @param[in] parent
  * @param[in] alloc
  * @return true
  * @return false
  */
-static bool accept(RANGE_TOKEN *tokens, enum dicelang_token_flavour what, struct dicelang_parse_node *parent, struct allocator alloc)
+static bool accept(struct dicelang_parser *parser, enum dicelang_token_flavour what, u32 parent, struct allocator alloc)
 {
-    if (parent && lookup(tokens, 0, what)) {
-        if (parent) {
-            (void) dicelang_parse_node_create(tokens->data[0], parent, alloc);
-        }
+    if ((parent != DICELANG_PARSE_NODE_NONE) && lookup(parser, 0, what)) {
+        (void) dicelang_parse_node_create(parser, parser->tokens->data[parser->position], parent, alloc);
 
-        return range_remove(RANGE_TO_ANY(tokens), 0);
+        parser->position += 1;
+        return true;
     }
     return false;
 }
@@ -231,160 +328,371 @@ static bool accept(RANGE_TOKEN *tokens, enum dicelang_token_flavour what, struct
 /**
  * @brief Peeks at the leading token, returning true if it matches some flavour without consuming it.
  *
- * @param[in] tokens
+ * @param[in] parser
+ * @param[in] offset How far from the leading token the peeked token is.
  * @param[in] what
  * @return true
  * @return false
  */
-static bool lookup(const RANGE_TOKEN *tokens, size_t offset, enum dicelang_token_flavour what)
+static bool lookup(const struct dicelang_parser *parser, size_t offset, enum dicelang_token_flavour what)
 {
-    if (!tokens || (tokens->length <= offset)) {
+    if (!parser->tokens || (parser->tokens->length <= (parser->position + offset))) {
         return false;
     }
 
-    return tokens->data[offset].flavour == what;
+    return parser->tokens->data[parser->position + offset].flavour == what;
 }
 
 
+
+
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
-static void statement(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+/**
+ * @brief Parses a rule and all the rules nested in it, without recursion. The innermost rule is resumed until it is done, or
+ * until it asks for another rule to be parsed under the node it created.
+ * Parsing stops at the first error.
+ *
+ * @param[inout] parser
+ * @param[in] rule
+ * @param[in] parent Node the rule is created under.
+ * @param[inout] error_sink
+ * @param[in] alloc
+ */
+static void dicelang_parse_rule(struct dicelang_parser *parser, enum dicelang_parse_rule rule, u32 parent, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *statement_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_statement, }, parent, alloc);
+    struct dicelang_parse_frame *current = nullptr;
+    enum dicelang_parse_rule nested = DPARSE_none;
 
-    if (lookup(tokens, 1, DTOK_designator)) {
-        assignment(tokens, statement_node, error_sink, alloc);
-    } else {
-        function_call(tokens, statement_node, error_sink, alloc);
+    if (parser->out_of_memory) {
+        return;
+    }
+
+    range_clear(RANGE_TO_ANY(parser->frames));
+    range_push(RANGE_TO_ANY(parser->frames), &(struct dicelang_parse_frame) { .rule = rule, .parent = parent, .node = DICELANG_PARSE_NODE_NONE });
+
+    while ((parser->frames->length > 0) && (error_sink->flavour == DERR_NONE) && !parser->out_of_memory) {
+        current = parser->frames->data + (parser->frames->length - 1);
+
+        switch (current->rule) {
+            case DPARSE_statement:      nested = statement(parser, current, error_sink, alloc);       break;
+            case DPARSE_assignment:     nested = assignment(parser, current, error_sink, alloc);      break;
+            case DPARSE_function_call:  nested = function_call(parser, current, error_sink, alloc);   break;
+            case DPARSE_addition:       nested = addition(parser, current, error_sink, alloc);        break;
+            case DPARSE_multiplication: nested = multiplication(parser, current, error_sink, alloc);  break;
+            case DPARSE_operand:        nested = operand(parser, current, error_sink, alloc);         break;
+            case DPARSE_dice:           nested = dice(parser, current, error_sink, alloc);            break;
+            case DPARSE_expr_set:       nested = expr_set(parser, current, error_sink, alloc);        break;
+            case DPARSE_var_access:     nested = var_access(parser, current, error_sink, alloc);      break;
+            default:                    nested = DPARSE_none;                                         break;
+        }
+
+        if (nested == DPARSE_none) {
+            range_pop(RANGE_TO_ANY(parser->frames));
+            continue;
+        }
+
+        parent = current->node;
+        if (parser->frames->length == parser->frames->capacity) {
+            parser->frames = range_ensure_capacity(alloc, RANGE_TO_ANY(parser->frames), parser->frames->capacity);
+        }
+        if (parser->frames->length == parser->frames->capacity) {
+            parser->out_of_memory = true;
+            break;
+        }
+        parser->frames->data[parser->frames->length] = (struct dicelang_parse_frame) { .rule = nested, .parent = parent, .node = DICELANG_PARSE_NODE_NONE };
+        parser->frames->length += 1;
+    }
+}
+
+/**
+ * @brief
+ *
+ */
+static enum dicelang_parse_rule statement(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
+{
+    (void) error_sink;
+
+    if (frame->step++ > 0) {
+        return DPARSE_none;
+    }
+
+    frame->node = dicelang_parse_node_create(parser,
+            (struct dicelang_token) { .flavour = DSTX_statement, }, frame->parent, alloc);
+
+    if (lookup(parser, 1, DTOK_designator)) {
+        return DPARSE_assignment;
     }
+    return DPARSE_function_call;
 }
 
 /**
  * @brief
  *
  */
-static void assignment(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule assignment(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *assignment_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_assignment, }, parent, alloc);
+    if (frame->step++ > 0) {
+        return DPARSE_none;
+    }
+
+    frame->node = dicelang_parse_node_create(parser,
+            (struct dicelang_token) { .flavour = DSTX_assignment, }, frame->parent, alloc);
 
-    expect(tokens, DTOK_identifier, assignment_node, error_sink, alloc);
-    expect(tokens, DTOK_designator, assignment_node, error_sink, alloc);
-    addition(tokens, assignment_node, error_sink, alloc);
+    expect(parser, DTOK_identifier, frame->node, error_sink, alloc);
+    expect(parser, DTOK_designator, frame->node, error_sink, alloc);
+    return DPARSE_addition;
 }
 
 /**
  * @brief
  *
  */
-static void function_call(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule function_call(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *function_call_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_function_call, }, parent, alloc);
+    if (frame->step++ > 0) {
+        expect(parser, DTOK_close_parenthesis, frame->node, error_sink, alloc);
+        return DPARSE_none;
+    }
+
+    frame->node = dicelang_parse_node_create(parser,
+            (struct dicelang_token) { .flavour = DSTX_function_call, }, frame->parent, alloc);
 
-    expect(tokens, DTOK_identifier, function_call_node, error_sink, alloc);
-    expect(tokens, DTOK_open_parenthesis, function_call_node, error_sink, alloc);
-    expr_set(tokens, function_call_node, error_sink, alloc);
-    expect(tokens, DTOK_close_parenthesis, function_call_node, error_sink, alloc);
+    expect(parser, DTOK_identifier, frame->node, error_sink, alloc);
+    expect(parser, DTOK_open_parenthesis, frame->node, error_sink, alloc);
+    return DPARSE_expr_set;
 }
 
 /**
  * @brief
  *
  */
-static void addition(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule addition(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *expression_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_addition, }, parent, alloc);
+    (void) error_sink;
 
-    multiplication(tokens, expression_node, error_sink, alloc);
-    while (accept(tokens, DTOK_op_addition, expression_node, alloc) || accept(tokens, DTOK_op_substraction, expression_node, alloc)) {
-        multiplication(tokens, expression_node, error_sink, alloc);
+    if (frame->step == 0) {
+        frame->step = 1;
+        frame->node = dicelang_parse_node_create(parser,
+                (struct dicelang_token) { .flavour = DSTX_addition, }, frame->parent, alloc);
+        return DPARSE_multiplication;
     }
+
+    if (accept(parser, DTOK_op_addition, frame->node, alloc) || accept(parser, DTOK_op_substraction, frame->node, alloc)) {
+        return DPARSE_multiplication;
+    }
+    return DPARSE_none;
 }
 
 /**
  * @brief
  *
  */
-static void multiplication(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule multiplication(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *factor_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_multiplication, }, parent, alloc);
+    (void) error_sink;
+
+    if (frame->step == 0) {
+        frame->step = 1;
+        frame->node = dicelang_parse_node_create(parser,
+                (struct dicelang_token) { .flavour = DSTX_multiplication, }, frame->parent, alloc);
+        return DPARSE_operand;
+    }
 
-    operand(tokens, factor_node, error_sink, alloc);
-    while (accept(tokens, DTOK_op_multiplication, factor_node, alloc) || lookup(tokens, 0, DTOK_op_d)) {
-        operand(tokens, factor_node, error_sink, alloc);
+    if (accept(parser, DTOK_op_multiplication, frame->node, alloc) || lookup(parser, 0, DTOK_op_d)) {
+        return DPARSE_operand;
     }
+    return DPARSE_none;
 }
 
 /**
  * @brief
  *
  */
-static void dice(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule dice(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *dice_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_dice, }, parent, alloc);
+    frame->node = dicelang_parse_node_create(parser,
+            (struct dicelang_token) { .flavour = DSTX_dice, }, frame->parent, alloc);
 
-    expect(tokens, DTOK_value, dice_node, error_sink, alloc);
+    expect(parser, DTOK_value, frame->node, error_sink, alloc);
+    return DPARSE_none;
 }
 
 /**
  * @brief
  *
  */
-static void operand(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule operand(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *operand_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_operand, }, parent, alloc);
+    // resuming after the nested rule, the step is the token that opened it
+    if (frame->step == DTOK_open_parenthesis) {
+        expect(parser, DTOK_close_parenthesis, frame->node, error_sink, alloc);
+        return DPARSE_none;
+    } else if (frame->step == DTOK_open_sq_bracket) {
+        expect(parser, DTOK_close_sq_bracket, frame->node, error_sink, alloc);
+        return DPARSE_none;
+    } else if (frame->step > 0) {
+        return DPARSE_none;
+    }
 
-    if (accept(tokens, DTOK_open_parenthesis, operand_node, alloc)) {
-        addition(tokens, operand_node, error_sink, alloc);
-        expect(tokens, DTOK_close_parenthesis, operand_node, error_sink, alloc);
+    frame->node = dicelang_parse_node_create(parser,
+            (struct dicelang_token) { .flavour = DSTX_operand, }, frame->parent, alloc);
+    frame->step = DTOK_empty;
 
-    } else if (accept(tokens, DTOK_open_sq_bracket, operand_node, alloc)) {
-        expr_set(tokens, operand_node, error_sink, alloc);
-        expect(tokens, DTOK_close_sq_bracket, operand_node, error_sink, alloc);
+    if (accept(parser, DTOK_open_parenthesis, frame->node, alloc)) {
+        frame->step = DTOK_open_parenthesis;
+        return DPARSE_addition;
 
-    } else if (accept(tokens, DTOK_op_d, operand_node, alloc)) {
-        dice(tokens, operand_node, error_sink, alloc);
+    } else if (accept(parser, DTOK_open_sq_bracket, frame->node, alloc)) {
+        frame->step = DTOK_open_sq_bracket;
+        return DPARSE_expr_set;
 
-    } else if (accept(tokens, DTOK_value, operand_node, alloc)) {
+    } else if (accept(parser, DTOK_op_d, frame->node, alloc)) {
+        return DPARSE_dice;
 
-    } else if (lookup(tokens, 0, DTOK_identifier) && lookup(tokens, 1, DTOK_open_parenthesis)) {
-        function_call(tokens, operand_node, error_sink, alloc);
+    } else if (accept(parser, DTOK_value, frame->node, alloc)) {
+        return DPARSE_none;
+
+    } else if (lookup(parser, 0, DTOK_identifier) && lookup(parser, 1, DTOK_open_parenthesis)) {
+        return DPARSE_function_call;
 
-    } else {
-        var_access(tokens, operand_node, error_sink, alloc);
     }
+    return DPARSE_var_access;
 }
 
 /**
  * @brief
  *
  */
-static void expr_set(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule expr_set(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *expr_set_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_expression_set, }, parent, alloc);
+    (void) error_sink;
+
+    if (frame->step == 0) {
+        frame->step = 1;
+        frame->node = dicelang_parse_node_create(parser,
+                (struct dicelang_token) { .flavour = DSTX_expression_set, }, frame->parent, alloc);
+        return DPARSE_addition;
+    }
 
-    addition(tokens, expr_set_node, error_sink, alloc);
-    while (accept(tokens, DTOK_separator, expr_set_node, alloc)) {
-        addition(tokens, expr_set_node, error_sink, alloc);
+    if (accept(parser, DTOK_separator, frame->node, alloc)) {
+        return DPARSE_addition;
     }
+    return DPARSE_none;
 }
 
 /**
  * @brief
  *
  */
-static void var_access(RANGE_TOKEN *tokens, struct dicelang_parse_node *parent, struct dicelang_error *error_sink, struct allocator alloc)
+static enum dicelang_parse_rule var_access(struct dicelang_parser *parser, struct dicelang_parse_frame *frame, struct dicelang_error *error_sink, struct allocator alloc)
 {
-    struct dicelang_parse_node *var_node = dicelang_parse_node_create(
-            (struct dicelang_token) { .flavour = DSTX_variable_access, }, parent, alloc);
+    frame->node = dicelang_parse_node_create(parser,
+            (struct dicelang_token) { .flavour = DSTX_variable_access, }, frame->parent, alloc);
+
+    expect(parser, DTOK_identifier, frame->node, error_sink, alloc);
+    return DPARSE_none;
+}
 
-    expect(tokens, DTOK_identifier, var_node, error_sink, alloc);
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+tst_CREATE_TEST_SCENARIO(parse_long_chain,
+        {
+            const char *head;
+            const char *term;
+            const char *separator;
+            const char *tail;
+            size_t nb_terms;
+
+            enum dicelang_token_flavour chain;
+            enum dicelang_token_flavour chained;
+            size_t expected_chained;
+        },
+        {
+            struct allocator alloc = make_system_allocator();
+            struct dicelang_error error = { };
+            static char source[8192] = { };
+            size_t length = 0;
+            RANGE_TOKEN *tokens = nullptr;
+            RANGE_PARSE_NODE *tree = nullptr;
+            size_t nb_chains = 0;
+            size_t nb_chained = 0;
+
+            length += (size_t) snprintf(source + length, sizeof(source) - length, "%s", data->head);
+            for (size_t i = 0 ; i < data->nb_terms ; i++) {
+                length += (size_t) snprintf(source + length, sizeof(source) - length, "%s%s", (i > 0) ? data->separator : "", data->term);
+            }
+            snprintf(source + length, sizeof(source) - length, "%s", data->tail);
+
+            tokens = dicelang_tokenize(source, &error, alloc);
+            tree = dicelang_parse(tokens, &error, alloc);
+            tst_assert(error.flavour == DERR_NONE, "chain of %d terms rejected : %s", (int) data->nb_terms, error.what);
+
+            // a single chain node holds all terms
+            for (size_t i = 0 ; tree && (i < tree->length) ; i++) {
+                nb_chains += (tree->data[i].token.flavour == data->chain);
+                nb_chained += (tree->data[i].token.flavour == data->chained);
+            }
+            tst_assert_equal(1, nb_chains, "chain nodes count of %d");
+            tst_assert_equal(data->expected_chained, nb_chained, "chained nodes count of %d");
+
+            dicelang_parse_node_destroy(&tree, alloc);
+            range_destroy_dynamic(alloc, &RANGE_TO_ANY(tokens));
+        }
+)
+
+tst_CREATE_TEST_CASE(parse_long_sum, parse_long_chain,
+        .head = "print(",
+        .term = "1d2",
+        .separator = " + ",
+        .tail = ")\n",
+        .nb_terms = 300,
+
+        .chain = DSTX_addition,
+        .chained = DSTX_multiplication,
+        .expected_chained = 300,
+)
+tst_CREATE_TEST_CASE(parse_long_product, parse_long_chain,
+        .head = "x : ",
+        .term = "2",
+        .separator = " * ",
+        .tail = "\n",
+        .nb_terms = 300,
+
+        .chain = DSTX_multiplication,
+        .chained = DSTX_operand,
+        .expected_chained = 300,
+)
+tst_CREATE_TEST_CASE(parse_long_arguments, parse_long_chain,
+        .head = "print(",
+        .term = "1",
+        .separator = ", ",
+        .tail = ")\n",
+        .nb_terms = 300,
+
+        .chain = DSTX_expression_set,
+        .chained = DSTX_addition,
+        .expected_chained = 300,
+)
+tst_CREATE_TEST_CASE(parse_long_set, parse_long_chain,
+        .head = "x : [",
+        .term = "1",
+        .separator = ", ",
+        .tail = "]\n",
+        .nb_terms = 300,
+
+        .chain = DSTX_expression_set,
+        .chained = DSTX_addition,
+        // the set itself is an operand of the assigned addition
+        .expected_chained = 301,
+)
+
+void dicelang_parse_test(void)
+{
+    tst_run_test_case(parse_long_sum);
+    tst_run_test_case(parse_long_product);
+    tst_run_test_case(parse_long_arguments);
+    tst_run_test_case(parse_long_set);
 }
@@ -1,10 +1,13 @@
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 
 #include <dicelang.h>
 
+#include "serve.h"
+
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
 
@@ -20,6 +23,12 @@
 static void print_usage(const char *prog_name, FILE *stream);
 // File reading failure helper.
 static void print_failed_fileread(const char *file_name, FILE *stream);
+// Bad flag helper.
+static void print_bad_flag(const char *flag, FILE *stream);
+// Command line flags parsing helper.
+static bool read_flag(const char *arg, struct dicelang_options *options);
+// Server flag parsing helper.
+static bool read_serve_flag(const char *arg, bool *serve, const char **socket_path);
 
 // -------------------------------------------------------------------------------------------------
 // -------------------------------------------------------------------------------------------------
@@ -27,15 +36,48 @@ static void print_failed_fileread(const char *file_name, FILE *stream);
 // MAIN BEGINS HERE
 int main(int argc, const char *argv[])
 {
+    // flags are consumed by moving argv forward, past the program name
+    const char *prog_name = argv[0];
     FILE *f = nullptr;
+    struct dicelang_options cli_options = { };
+    bool cli_approximate = false;
+    bool cli_stream = false;
+    bool cli_serve = false;
+    const char *cli_socket = nullptr;
+    struct dicelang_program program = { };
 
 #ifdef UNITTESTING
     dicelang_distrib_test();
+    dicelang_parse_test();
     return 0;
 #endif
 
-    if (argc != 2) {
-        print_usage(argv[0], stderr);
+    while ((argc > 1) && (read_flag(argv[1], &cli_options) || (strcmp(argv[1], "--stream") == 0) || read_serve_flag(argv[1], &cli_serve, &cli_socket))) {
+        cli_approximate = cli_approximate || cli_options.approximate;
+        cli_stream = cli_stream || (strcmp(argv[1], "--stream") == 0);
+        argv += 1;
+        argc -= 1;
+    }
+
+    if ((argc > 1) && (strncmp(argv[1], "--approximate", sizeof("--approximate") - 1) == 0)) {
+        print_bad_flag(argv[1], stderr);
+        print_usage(prog_name, stderr);
+        return -1;
+    }
+
+    if (cli_serve && cli_stream) {
+        fprintf(stderr, "--stream and --serve cannot be used together : requests are always read whole.\n");
+        print_usage(prog_name, stderr);
+        return -1;
+    }
+
+    if (cli_serve && (argc == 1)) {
+        // the command line takes precedence over the pragmas of every request
+        return dicelang_serve(cli_socket, cli_approximate ? cli_options : (struct dicelang_options) { });
+    }
+
+    if (cli_serve || (argc != 2)) {
+        print_usage(prog_name, stderr);
         return -1;
     }
 
@@ -46,12 +88,23 @@ int main(int argc, const char *argv[])
         return -2;
     }
 
+    if (cli_stream) {
+        // the command line takes precedence over the script's pragmas
+        program = dicelang_program_stream_from_file(f, cli_approximate ? &cli_options : nullptr, make_system_allocator());
+        fclose(f);
+    } else {
+        program = dicelang_program_create_from_file(f, make_system_allocator());
+        fclose(f);
+
+        // the command line takes precedence over the script's pragmas
+        if (cli_approximate) {
+            program.options = cli_options;
+        }
 
-    struct dicelang_program program = dicelang_program_create_from_file(f, make_system_allocator());
-    fclose(f);
+        dicelang_interpret(program.code, program.options, &program.error, make_system_allocator());
+    }
 
-    dicelang_interpret(program.parse_tree, &program.error, make_system_allocator());
-    dicelang_error_print(program.error, stderr);
+    dicelang_error_print(program.error, program.source_code, program.first_line, stderr);
 
     dicelang_program_destroy(&program, make_system_allocator());
 
@@ -73,8 +126,12 @@ static void print_usage(const char *prog_name, FILE *stream)
         return;
     }
 
-    fprintf(stream, "I need a script to work ! Usage :\n\t$%s FILE\n\n", prog_name);
+    fprintf(stream, "I need a script to work ! Usage :\n\t$%s [--approximate[=EPSILON]] [--stream] FILE\n", prog_name);
+    fprintf(stream, "\t$%s [--approximate[=EPSILON]] --serve[=SOCKET]\n\n", prog_name);
     fprintf(stream, "with FILE being a dicelang script.\n");
+    fprintf(stream, "--approximate computes probabilities as doubles, dropping those below EPSILON (default %g).\n", DICELANG_DEFAULT_EPSILON);
+    fprintf(stream, "--stream interprets the script one line at a time, as it is read.\n");
+    fprintf(stream, "--serve answers evaluation requests read from the standard input, or from the clients of the unix socket SOCKET.\n");
 }
 
 /**
@@ -90,4 +147,80 @@ static void print_failed_fileread(const char *file_name, FILE *stream)
     }
 
     fprintf(stream, "Failed to open file \"%s\" : %s\n", file_name, strerror(errno));
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Prints the malformed flag error to some file.
+ *
+ * @param[in] flag
+ * @param[in] stream
+ */
+static void print_bad_flag(const char *flag, FILE *stream)
+{
+    if (!flag || !stream) {
+        return;
+    }
+
+    fprintf(stream, "Bad flag \"%s\" : expected --approximate, or --approximate=EPSILON with a positive EPSILON.\n", flag);
+}
+
+/**
+ * @brief Reads the "--approximate[=EPSILON]" flag.
+ *
+ * @param[in] arg Command line argument.
+ * @param[out] options Options set by the flag. Left untouched if the argument is not a valid flag.
+ * @return true if the argument is the flag, with a valid epsilon if there is one.
+ */
+static bool read_flag(const char *arg, struct dicelang_options *options)
+{
+    static const char flag[] = "--approximate";
+    struct dicelang_options read_options = { .approximate = true, .epsilon = DICELANG_DEFAULT_EPSILON };
+    char *end = nullptr;
+
+    if (!arg || !options || (strncmp(arg, flag, sizeof(flag) - 1) != 0)) {
+        return false;
+    }
+
+    arg += sizeof(flag) - 1;
+
+    if (*arg == '=') {
+        read_options.epsilon = strtod(arg + 1, &end);
+        if ((end == arg + 1) || (*end != '\0') || !(read_options.epsilon > 0.)) {
+            return false;
+        }
+    } else if (*arg != '\0') {
+        return false;
+    }
+
+    *options = read_options;
+
+    return true;
+}
+
+/**
+ * @brief Reads the "--serve[=SOCKET]" flag.
+ *
+ * @param[in] arg Command line argument.
+ * @param[out] serve Set if the argument is the flag.
+ * @param[out] socket_path Path of the socket, if one is given.
+ * @return true if the argument is the flag, with a non-empty path if there is one.
+ */
+static bool read_serve_flag(const char *arg, bool *serve, const char **socket_path)
+{
+    static const char flag[] = "--serve";
+
+    if (!arg || !serve || !socket_path || (strncmp(arg, flag, sizeof(flag) - 1) != 0)) {
+        return false;
+    }
+
+    arg += sizeof(flag) - 1;
+
+    if ((*arg != '\0') && ((*arg != '=') || (arg[1] == '\0'))) {
+        return false;
+    }
+
+    *serve = true;
+    *socket_path = (*arg == '=') ? arg + 1 : nullptr;
+
+    return true;
+}
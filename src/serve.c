@@ -0,0 +1,350 @@
+/**
+ * @file serve.c
+ * @author gabriel
+ * @brief Long-running mode of the program. Requests are evaluated one after the other in the same context, reset between them,
+ * so the process startup and the warm-up of the interpreter are paid once for all of them.
+ *
+ * A request is a header line "FORMAT [LENGTH]", FORMAT being "text" or "csv", followed by the script :
+ * - exactly LENGTH bytes of it if the length is given ;
+ * - all lines up to the first empty one otherwise.
+ * Each request is answered with a header line "ok LENGTH" or "error LENGTH", followed by LENGTH bytes of output : what the script
+ * printed, and the description of its error if it failed.
+ *
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "serve.h"
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/// Largest script a length-delimited request can announce.
+#define DICELANG_SERVE_MAX_LENGTH (64ul * 1024ul * 1024ul)
+
+/**
+ * @brief Outcome of reading a request.
+ */
+enum dicelang_serve_read {
+    /** A script was read. */
+    DSERVE_request,
+    /** The header of the request could not be understood. */
+    DSERVE_malformed,
+    /** The input ended, or failed. */
+    DSERVE_end,
+};
+
+/**
+ * @brief Storage of the requests being read, reused from one request to the next.
+ */
+struct dicelang_serve_buffers {
+    char *line;
+    size_t line_capacity;
+
+    char *script;
+    size_t script_length;
+    size_t script_capacity;
+};
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+static int dicelang_serve_socket(struct dicelang_context *context, const char *socket_path);
+static void dicelang_serve_stream(struct dicelang_context *context, FILE *from, FILE *to);
+static enum dicelang_serve_read dicelang_serve_read_request(struct dicelang_serve_buffers *buffers, FILE *from, enum dicelang_print_format *out_format);
+static bool dicelang_serve_reserve(struct dicelang_serve_buffers *buffers, size_t length);
+static void dicelang_serve_answer(struct dicelang_context *context, const char *script, enum dicelang_print_format format, FILE *to);
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Answers requests read from the standard input until it ends, or from the clients of a Unix socket forever.
+ * Clients of the socket are served one after the other.
+ *
+ * @param[in] socket_path Path of the socket to listen on, or NULL to use the standard input and output.
+ * @param[in] options Numeric mode of the computed distributions, used by all requests.
+ * @return Exit status of the program.
+ */
+int dicelang_serve(const char *socket_path, struct dicelang_options options)
+{
+    struct dicelang_context *context = dicelang_context_create(options, make_system_allocator());
+    int status = 0;
+
+    if (!context) {
+        fprintf(stderr, "Failed to create an evaluation context.\n");
+        return -3;
+    }
+
+    if (socket_path) {
+        status = dicelang_serve_socket(context, socket_path);
+    } else {
+        dicelang_serve_stream(context, stdin, stdout);
+    }
+
+    dicelang_context_destroy(&context);
+
+    return status;
+}
+
+// -------------------------------------------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------
+
+/**
+ * @brief Listens on a Unix socket, and answers the requests of each client until it disconnects.
+ * A socket left at this path by a previous server is replaced.
+ *
+ * @param[inout] context
+ * @param[in] socket_path
+ * @return Exit status of the program, when the socket fails.
+ */
+static int dicelang_serve_socket(struct dicelang_context *context, const char *socket_path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct stat existing = { };
+    int server = -1;
+    int client = -1;
+    int client_copy = -1;
+    FILE *from = nullptr;
+    FILE *to = nullptr;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path \"%s\" is too long.\n", socket_path);
+        return -4;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    if ((stat(socket_path, &existing) == 0) && S_ISSOCK(existing.st_mode)) {
+        unlink(socket_path);
+    }
+
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((server < 0) || (bind(server, (struct sockaddr *) &address, sizeof(address)) < 0) || (listen(server, 16) < 0)) {
+        fprintf(stderr, "Failed to listen on \"%s\" : %s\n", socket_path, strerror(errno));
+        if (server >= 0) {
+            close(server);
+        }
+        return -4;
+    }
+
+    // a client leaving before its answer is written must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        client = accept(server, nullptr, nullptr);
+        if ((client < 0) && (errno == EINTR)) {
+            continue;
+        } else if (client < 0) {
+            break;
+        }
+
+        client_copy = dup(client);
+        from = fdopen(client, "r");
+        to = (client_copy >= 0) ? fdopen(client_copy, "w") : nullptr;
+
+        if (from && to) {
+            dicelang_serve_stream(context, from, to);
+        }
+
+        if (from) {
+            fclose(from);
+        } else {
+            close(client);
+        }
+        if (to) {
+            fclose(to);
+        } else if (client_copy >= 0) {
+            close(client_copy);
+        }
+    }
+
+    fprintf(stderr, "Failed to accept a client on \"%s\" : %s\n", socket_path, strerror(errno));
+    close(server);
+    unlink(socket_path);
+
+    return -4;
+}
+
+/**
+ * @brief Answers the requests read from a stream until it ends.
+ *
+ * @param[inout] context
+ * @param[in] from
+ * @param[in] to
+ */
+static void dicelang_serve_stream(struct dicelang_context *context, FILE *from, FILE *to)
+{
+    struct dicelang_serve_buffers buffers = { };
+    enum dicelang_serve_read outcome = DSERVE_request;
+    enum dicelang_print_format format = DPRINT_text;
+    static const char malformed[] = "dicelang: bad request\nexpected a header line \"text|csv [LENGTH]\"\n";
+
+    while ((outcome = dicelang_serve_read_request(&buffers, from, &format)) != DSERVE_end) {
+        if (outcome == DSERVE_malformed) {
+            fprintf(to, "error %zu\n%s", sizeof(malformed) - 1, malformed);
+            fflush(to);
+        } else {
+            dicelang_serve_answer(context, buffers.script, format, to);
+        }
+    }
+
+    free(buffers.line);
+    free(buffers.script);
+}
+
+/**
+ * @brief Reads the header of a request, and the script following it.
+ * Blank lines before the header are skipped.
+ *
+ * @param[inout] buffers Storage of the read header and script.
+ * @param[in] from
+ * @param[out] out_format Format asked for by the request.
+ * @return enum dicelang_serve_read
+ */
+static enum dicelang_serve_read dicelang_serve_read_request(struct dicelang_serve_buffers *buffers, FILE *from, enum dicelang_print_format *out_format)
+{
+    ssize_t nb_read = 0;
+    char *cursor = nullptr;
+    char *end = nullptr;
+    size_t length = 0;
+
+    do {
+        nb_read = getline(&buffers->line, &buffers->line_capacity, from);
+        if (nb_read < 0) {
+            return DSERVE_end;
+        }
+
+        while ((nb_read > 0) && ((buffers->line[nb_read - 1] == '\n') || (buffers->line[nb_read - 1] == '\r'))) {
+            nb_read -= 1;
+        }
+        buffers->line[nb_read] = '\0';
+    } while (nb_read == 0);
+
+    cursor = buffers->line;
+    if (strncmp(cursor, "text", 4) == 0) {
+        *out_format = DPRINT_text;
+        cursor += 4;
+    } else if (strncmp(cursor, "csv", 3) == 0) {
+        *out_format = DPRINT_csv;
+        cursor += 3;
+    } else {
+        return DSERVE_malformed;
+    }
+
+    buffers->script_length = 0;
+
+    if (*cursor == ' ') {
+        // length-delimited : the script is the next bytes, whatever they are
+        length = strtoul(cursor + 1, &end, 10);
+        if ((end == cursor + 1) || (*end != '\0') || (length > DICELANG_SERVE_MAX_LENGTH)) {
+            return DSERVE_malformed;
+        }
+        if (!dicelang_serve_reserve(buffers, length) || (fread(buffers->script, 1, length, from) != length)) {
+            return DSERVE_end;
+        }
+        buffers->script_length = length;
+        buffers->script[length] = '\0';
+
+        return DSERVE_request;
+    } else if (*cursor != '\0') {
+        return DSERVE_malformed;
+    }
+
+    // newline-delimited : the script ends on an empty line, or with the input
+    while (((nb_read = getline(&buffers->line, &buffers->line_capacity, from)) > 0)
+            && (strcmp(buffers->line, "\n") != 0) && (strcmp(buffers->line, "\r\n") != 0)) {
+        if (!dicelang_serve_reserve(buffers, (size_t) nb_read)) {
+            return DSERVE_end;
+        }
+        memcpy(buffers->script + buffers->script_length, buffers->line, (size_t) nb_read);
+        buffers->script_length += (size_t) nb_read;
+    }
+
+    if (!dicelang_serve_reserve(buffers, 0)) {
+        return DSERVE_end;
+    }
+    buffers->script[buffers->script_length] = '\0';
+
+    return DSERVE_request;
+}
+
+/**
+ * @brief Grows the script storage so some more characters, and a null terminator, can be written after the script being read.
+ *
+ * @param[inout] buffers
+ * @param[in] length Number of characters to make room for.
+ * @return false if the script storage could not grow.
+ */
+static bool dicelang_serve_reserve(struct dicelang_serve_buffers *buffers, size_t length)
+{
+    char *grown = nullptr;
+    size_t capacity = buffers->script_capacity ? buffers->script_capacity : 256;
+
+    while (capacity < buffers->script_length + length + 1) {
+        capacity *= 2;
+    }
+
+    if (capacity > buffers->script_capacity) {
+        grown = realloc(buffers->script, capacity);
+        if (!grown) {
+            return false;
+        }
+        buffers->script = grown;
+        buffers->script_capacity = capacity;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Evaluates a script in a fresh state of the context, and writes the answer to the request.
+ * The output of the script is gathered before it is written, so its length can be sent first.
+ *
+ * @param[inout] context
+ * @param[in] script Null-terminated script.
+ * @param[in] format How the script prints distributions.
+ * @param[in] to
+ */
+static void dicelang_serve_answer(struct dicelang_context *context, const char *script, enum dicelang_print_format format, FILE *to)
+{
+    char *body = nullptr;
+    size_t body_length = 0;
+    FILE *body_file = open_memstream(&body, &body_length);
+    struct dicelang_error error = { };
+
+    if (!body_file) {
+        fprintf(to, "error 0\n");
+        fflush(to);
+        return;
+    }
+
+    dicelang_context_reset(context);
+    dicelang_context_redirect(context, body_file, format);
+    dicelang_context_evaluate(context, script, &error);
+    dicelang_context_redirect(context, nullptr, DPRINT_text);
+
+    if (error.flavour != DERR_NONE) {
+        dicelang_error_print(error, script, 1, body_file);
+    }
+    fclose(body_file);
+
+    fprintf(to, "%s %zu\n", (error.flavour == DERR_NONE) ? "ok" : "error", body_length);
+    fwrite(body, 1, body_length, to);
+    fflush(to);
+
+    free(body);
+}
@@ -0,0 +1,19 @@
+/**
+ * @file serve.h
+ * @author gabriel
+ * @brief Long-running mode of the program, answering evaluation requests read from the standard input or a local socket.
+ * @version 0.1
+ * @date 2025-01-20
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef __SERVE_H__
+#define __SERVE_H__
+
+#include <dicelang.h>
+
+// Answers requests until the input ends, or forever when listening on a socket.
+int dicelang_serve(const char *socket_path, struct dicelang_options options);
+
+#endif